@@ -0,0 +1,69 @@
+// A few lines of harness shared by the benchmarks.  Every benchmark prints
+// one JSON object per line, so runs can be collected and compared with
+// whatever is to hand, e.g.
+//
+//   QueueContention > before.jsonl
+//
+// Anything the core logs goes to stderr, out of the way of the results.
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// How many times each benchmark is run; the fastest and the median run
+// are reported.
+static const int kBenchmarkRuns = 5;
+
+// Runs 'body', which performs 'operations' operations, kBenchmarkRuns
+// times, calling 'setUp' before each run, outside the timing.  Prints
+//
+//   {"benchmark":"<name>",<params>,"operations":N,"ns_per_op_min":...,"ns_per_op_median":...}
+//
+// where 'params' is a JSON fragment describing the variant, e.g.
+// "\"rows\":1000", or empty.
+template <typename SetUp, typename Body>
+void RunBenchmark(const char *name, const std::string &params, long long operations, SetUp setUp, Body body)
+{
+	std::vector<double> nanosPerOp;
+	for (int run = 0; run < kBenchmarkRuns; ++run)
+	{
+		setUp();
+
+		auto start = std::chrono::steady_clock::now();
+		body();
+		auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+		nanosPerOp.push_back(elapsed / operations);
+	}
+
+	std::sort(nanosPerOp.begin(), nanosPerOp.end());
+	std::printf("{\"benchmark\":\"%s\"%s%s,\"operations\":%lld,\"ns_per_op_min\":%.1f,\"ns_per_op_median\":%.1f}\n",
+		name,
+		params.empty() ? "" : ",",
+		params.c_str(),
+		operations,
+		nanosPerOp.front(),
+		nanosPerOp[nanosPerOp.size() / 2]);
+	std::fflush(stdout);
+}
+
+template <typename Body>
+void RunBenchmark(const char *name, const std::string &params, long long operations, Body body)
+{
+	RunBenchmark(name, params, operations, [] {}, body);
+}
+
+// A JSON fragment for one integer parameter.
+inline std::string Param(const char *key, long long value)
+{
+	return std::string("\"") + key + "\":" + std::to_string(value);
+}
+
+inline std::string Param(const char *key, const char *value)
+{
+	return std::string("\"") + key + "\":\"" + value + "\"";
+}
@@ -0,0 +1,79 @@
+// Clock benchmark.
+//
+// Every event is stamped with the time when it's logged, on the caller's
+// thread.  Measures Clock's reads against reading the system clock
+// directly: on Windows, the GetSystemTime and SystemTimeToFileTime that
+// events used to be stamped with; elsewhere, std::chrono::system_clock.
+//
+// Builds with the core; see CMakeLists.txt.
+
+// The core headers expect what the precompiled header provides.
+#include "pch.h"
+
+#include "Benchmark.h"
+
+#include "Clock.h"
+
+#include <chrono>
+#include <cstdio>
+
+using namespace Amplitude;
+
+static const int kReads = 1000000;
+
+#ifdef _WIN32
+static int64 ReadSystemTime()
+{
+	SYSTEMTIME systime;
+	GetSystemTime(&systime);
+
+	FILETIME filetime;
+	SystemTimeToFileTime(&systime, &filetime);
+
+	LARGE_INTEGER date;
+	date.HighPart = filetime.dwHighDateTime;
+	date.LowPart = filetime.dwLowDateTime;
+	return (date.QuadPart - 11644473600000LL * 10000) / 10000;
+}
+#else
+static int64 ReadSystemTime()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+#endif
+
+int main()
+{
+	int64 sink = 0;
+
+	RunBenchmark("Clock.System", "", kReads, [&]
+	{
+		for (int i = 0; i < kReads; ++i)
+		{
+			sink += ReadSystemTime();
+		}
+	});
+
+	RunBenchmark("Clock.NowMillis", "", kReads, [&]
+	{
+		for (int i = 0; i < kReads; ++i)
+		{
+			sink += Clock::NowMillis();
+		}
+	});
+
+	RunBenchmark("Clock.MonotonicMillis", "", kReads, [&]
+	{
+		for (int i = 0; i < kReads; ++i)
+		{
+			sink += Clock::MonotonicMillis();
+		}
+	});
+
+	// Keep the reads from being optimized away.
+	if (sink == 0)
+	{
+		std::printf("\n");
+	}
+	return 0;
+}
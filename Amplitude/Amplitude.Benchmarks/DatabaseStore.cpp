@@ -0,0 +1,197 @@
+// Event store benchmark for Database.
+//
+// Measures what the worker pays to store events, one at a time and in a
+// batch's single transaction, what an upload pays to read a batch back
+// out, and what it costs to find and remove the oldest events when the
+// store is over its limit; each against stores of 100, 1,000 and 100,000
+// events.  Reads come back as JSON, with the event IDs spliced in.  Also
+// what it costs to skip expired events while reading, and to purge them.
+//
+// Builds with the core; see CMakeLists.txt.  Writes a scratch database in
+// the working directory.
+
+// The core headers expect what the precompiled header provides.
+#include "pch.h"
+
+#include "Benchmark.h"
+
+#include "Database.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace Amplitude;
+
+static const wchar_t * const kPath = L"DatabaseStore.db";
+static const int kRowCounts[] = { 100, 1000, 100000 };
+static const int kInserts = 200;
+static const int kBatchSizes[] = { 10, 100 };
+static const int kReads = 200;
+static const int kReadSizes[] = { 10, 100 };
+static const int kLookups = 2000;
+
+// The worker trims the store by EVENT_REMOVE_BATCH_SIZE events at a time.
+static const int kTrimSize = 20;
+static const int kTrims = 50;
+
+static const int kPurgeChunk = 100;
+
+// Events are stamped a millisecond apart from here.
+static const int64 kTimestamp = 1420070400000LL;
+
+// Roughly what EventReporter stores for an event with a few properties.
+static std::wstring MakeEvent(int sequence)
+{
+	return L"{\"event_type\":\"view activated\",\"timestamp\":\"1420070400000\",\"session_id\":\"1420070000000\","
+		L"\"device_id\":\"0123456789abcdef0123456789abcdef\",\"version_code\":\"1.0.0.0\",\"version_name\":\"1.0.0.0\","
+		L"\"country\":\"US\",\"language\":\"en\",\"client\":\"Windows Store\",\"api_properties\":{},"
+		L"\"custom_properties\":{\"story\":\"" + std::to_wstring(sequence) + L"\",\"source\":\"front page\"},"
+		L"\"global_properties\":{\"theme\":\"dark\"}}";
+}
+
+// A fresh store holding 'rows' events, with IDs from 1.
+static void Reset(int rows)
+{
+	std::remove("DatabaseStore.db");
+
+	Database db(kPath);
+	std::vector<EventRecord> backlog;
+	for (int i = 0; i < rows; ++i)
+	{
+		backlog.push_back(EventRecord(MakeEvent(i), kTimestamp + i));
+	}
+	if (!backlog.empty())
+	{
+		db.AddEvents(backlog);
+	}
+}
+
+// Each insert is its own transaction, as for events logged one at a time.
+static void InsertSingle(int rows)
+{
+	RunBenchmark("Database.AddEvent", Param("rows", rows), kInserts, [rows]
+	{
+		Reset(rows);
+	}, []
+	{
+		Database db(kPath);
+		for (int i = 0; i < kInserts; ++i)
+		{
+			db.AddEvent(MakeEvent(i), kTimestamp + i);
+		}
+	});
+}
+
+static void InsertBatch(int rows, int batchSize)
+{
+	std::vector<EventRecord> batch;
+	for (int i = 0; i < batchSize; ++i)
+	{
+		batch.push_back(EventRecord(MakeEvent(i), kTimestamp + i));
+	}
+
+	const int batches = kInserts * 10 / batchSize;
+	RunBenchmark("Database.AddEvents", Param("rows", rows) + "," + Param("batch", batchSize), static_cast<long long>(batches) * batchSize, [rows]
+	{
+		Reset(rows);
+	}, [&batch, batches]
+	{
+		Database db(kPath);
+		for (int i = 0; i < batches; ++i)
+		{
+			db.AddEvents(batch);
+		}
+	});
+}
+
+// Reads the oldest events, as an upload does, without deleting them;
+// optionally skipping the older half of the store as expired.
+static void ReadBatch(int rows, int limit, bool expiry)
+{
+	Reset(rows);
+
+	auto minTimestamp = expiry ? kTimestamp + rows / 2 : LLONG_MIN;
+	auto params = Param("rows", rows) + "," + Param("limit", limit) + "," + Param("expiry", expiry ? "half" : "none");
+	RunBenchmark("Database.GetEventsSince", params, kReads, [limit, minTimestamp]
+	{
+		Database db(kPath);
+		for (int i = 0; i < kReads; ++i)
+		{
+			db.GetEventsSince(-1, limit, minTimestamp);
+		}
+	});
+}
+
+// Finds where a trim ends, as the worker does once the store is over its
+// limit.
+static void FindNth(int rows)
+{
+	Reset(rows);
+
+	RunBenchmark("Database.GetNthEventId", Param("rows", rows) + "," + Param("n", kTrimSize), kLookups, []
+	{
+		Database db(kPath);
+		for (int i = 0; i < kLookups; ++i)
+		{
+			db.GetNthEventId(kTrimSize);
+		}
+	});
+}
+
+// Removes the oldest events a trim at a time.
+static void Trim(int rows)
+{
+	const int trims = std::min(kTrims, rows / kTrimSize);
+	RunBenchmark("Database.RemoveEvents", Param("rows", rows) + "," + Param("n", kTrimSize), trims, [rows]
+	{
+		Reset(rows);
+	}, [trims]
+	{
+		Database db(kPath);
+		for (int i = 1; i <= trims; ++i)
+		{
+			db.RemoveEvents(static_cast<int64>(i) * kTrimSize);
+		}
+	});
+}
+
+// Expires the whole store a chunk at a time, as the idle purge does.
+static void PurgeExpired(int rows)
+{
+	RunBenchmark("Database.RemoveExpiredEvents", Param("rows", rows) + "," + Param("chunk", kPurgeChunk), rows, [rows]
+	{
+		Reset(rows);
+	}, [rows]
+	{
+		Database db(kPath);
+		while (db.RemoveExpiredEvents(kTimestamp + rows, kPurgeChunk) > 0)
+		{
+		}
+	});
+}
+
+int main()
+{
+	for (auto rows : kRowCounts)
+	{
+		InsertSingle(rows);
+		for (auto batchSize : kBatchSizes)
+		{
+			InsertBatch(rows, batchSize);
+		}
+		for (auto limit : kReadSizes)
+		{
+			ReadBatch(rows, limit, false);
+			ReadBatch(rows, limit, true);
+		}
+		FindNth(rows);
+		Trim(rows);
+		PurgeExpired(rows);
+	}
+
+	std::remove("DatabaseStore.db");
+	return 0;
+}
@@ -0,0 +1,97 @@
+// Event serialization benchmark: building an event's JsonObject, as
+// EventReporter::BuildEvent does for every event, and the Stringify that
+// turns it into what's stored, with the global properties' JSON spliced
+// onto the end.
+//
+// BuildEvent needs an initialized reporter, so this builds the same object,
+// field for field, from fixed values; the session bookkeeping is left out.
+// JsonObject is WinRT, so this builds with /ZW, e.g.:
+//
+//   cl /ZW /O2 /EHsc EventSerialization.cpp
+
+#include "Benchmark.h"
+
+#include <string>
+
+using Platform::String;
+using Windows::Data::Json::JsonObject;
+using Windows::Data::Json::JsonValue;
+
+static const int kEvents = 20000;
+static const int kPropertyCounts[] = { 0, 4, 16 };
+
+static JsonObject^ MakeProperties(int count)
+{
+	auto properties = ref new JsonObject();
+	for (int i = 0; i < count; ++i)
+	{
+		auto key = L"property" + std::to_wstring(i);
+		properties->SetNamedValue(ref new String(key.c_str()), JsonValue::CreateStringValue("front page"));
+	}
+	return properties;
+}
+
+static JsonObject^ BuildEvent(JsonObject ^eventProperties, int64 timestamp)
+{
+	auto eventObj = ref new JsonObject();
+	eventObj->SetNamedValue("event_type", JsonValue::CreateStringValue("view activated"));
+	eventObj->SetNamedValue("timestamp", JsonValue::CreateStringValue(timestamp.ToString()));
+	eventObj->SetNamedValue("session_id", JsonValue::CreateStringValue("1420070000000"));
+	eventObj->SetNamedValue("device_id", JsonValue::CreateStringValue("0123456789abcdef0123456789abcdef"));
+	eventObj->SetNamedValue("version_code", JsonValue::CreateStringValue("1.0.0.0"));
+	eventObj->SetNamedValue("version_name", JsonValue::CreateStringValue("1.0.0.0"));
+	eventObj->SetNamedValue("country", JsonValue::CreateStringValue("US"));
+	eventObj->SetNamedValue("language", JsonValue::CreateStringValue("en"));
+	eventObj->SetNamedValue("client", JsonValue::CreateStringValue("Windows Store"));
+	eventObj->SetNamedValue("api_properties", ref new JsonObject());
+	eventObj->SetNamedValue("custom_properties", eventProperties);
+	return eventObj;
+}
+
+static std::wstring Serialize(JsonObject ^eventObj, const std::wstring &globalProperties)
+{
+	auto json = eventObj->Stringify();
+	std::wstring result(json->Data(), json->Length() - 1);
+	result.append(L",\"global_properties\":");
+	result.append(globalProperties);
+	result.push_back(L'}');
+	return result;
+}
+
+static void Build(int properties)
+{
+	auto eventProperties = MakeProperties(properties);
+
+	RunBenchmark("BuildEvent", Param("properties", properties), kEvents, [eventProperties]
+	{
+		for (int i = 0; i < kEvents; ++i)
+		{
+			BuildEvent(eventProperties, 1420070400000LL + i);
+		}
+	});
+}
+
+static void Stringify(int properties)
+{
+	auto eventObj = BuildEvent(MakeProperties(properties), 1420070400000LL);
+	std::wstring globalProperties(MakeProperties(2)->Stringify()->Data());
+
+	RunBenchmark("JsonObject.Stringify", Param("properties", properties), kEvents, [eventObj, globalProperties]
+	{
+		for (int i = 0; i < kEvents; ++i)
+		{
+			Serialize(eventObj, globalProperties);
+		}
+	});
+}
+
+[Platform::MTAThread]
+int main(Platform::Array<String^>^)
+{
+	for (auto properties : kPropertyCounts)
+	{
+		Build(properties);
+		Stringify(properties);
+	}
+	return 0;
+}
@@ -0,0 +1,87 @@
+// Contention benchmark for the worker queue implementations.
+//
+// N producer threads each enqueue a fixed number of work items as fast as
+// they can, while one consumer drains and runs them, as WorkerThread does;
+// producers retry when the queue is full.  Timed until the consumer has
+// run every item.
+//
+// Builds with the core; see CMakeLists.txt.
+
+// The core headers expect what the precompiled header provides.
+#include "pch.h"
+
+#include "Benchmark.h"
+
+#include "MpscQueue.h"
+#include "SynchronizedQueue.h"
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Amplitude;
+
+typedef std::function<void()> WorkItem;
+
+static const int kItemsPerProducer = 250000;
+static const int kProducerCounts[] = { 1, 2, 4, 8 };
+
+template <typename Queue>
+static void Run(const char *name, int producers)
+{
+	const long long total = static_cast<long long>(producers) * kItemsPerProducer;
+
+	RunBenchmark((std::string(name) + ".Contention").c_str(), Param("producers", producers), total, [producers, total]
+	{
+		Queue queue(1024);
+		std::atomic<long long> sum(0);
+
+		// The consumer stops after the expected number of items rather than
+		// on Complete(), so that the measurement doesn't include any
+		// shutdown cost.
+		std::thread consumer([&queue, total]
+		{
+			WorkItem item;
+			for (long long i = 0; i < total && queue.TryDequeue(item); ++i)
+			{
+				item();
+			}
+		});
+
+		std::vector<std::thread> threads;
+		for (int p = 0; p < producers; ++p)
+		{
+			threads.emplace_back([&queue, &sum]
+			{
+				for (int i = 0; i < kItemsPerProducer; ++i)
+				{
+					const WorkItem item = [&sum, i] { sum += i; };
+					while (!queue.TryEnqueue(item))
+					{
+						std::this_thread::yield();
+					}
+				}
+			});
+		}
+
+		for (auto &thread : threads)
+		{
+			thread.join();
+		}
+		consumer.join();
+
+		queue.Complete();
+	});
+}
+
+int main()
+{
+	for (auto producers : kProducerCounts)
+	{
+		Run<SynchronizedQueue<WorkItem>>("SynchronizedQueue", producers);
+		Run<MpscQueue<WorkItem>>("MpscQueue", producers);
+	}
+	return 0;
+}
@@ -0,0 +1,63 @@
+// Upload encoding benchmark: the checksum sent with every upload.
+//
+// Measures ComputeUploadChecksum, which converts the batch to UTF-8 and
+// hashes it with MD5, for batches of the sizes UploadPipeline sends.
+//
+// Builds with the core; see CMakeLists.txt.
+
+// The core headers expect what the precompiled header provides.
+#include "pch.h"
+
+#include "Benchmark.h"
+
+#include "UploadPipeline.h"
+
+#include <string>
+
+using namespace Amplitude;
+
+static const int kChecksums = 2000;
+static const int kBatchSizes[] = { 1, 30, 100 };
+
+static std::wstring MakeBatch(int events)
+{
+	std::wstring batch(L"[");
+	for (int i = 0; i < events; ++i)
+	{
+		if (i > 0)
+		{
+			batch += L",";
+		}
+		batch += L"{\"event_id\":" + std::to_wstring(i) + L",\"event_type\":\"view activated\",\"timestamp\":\"1420070400000\","
+			L"\"session_id\":\"1420070000000\",\"device_id\":\"0123456789abcdef0123456789abcdef\",\"client\":\"Windows Store\","
+			L"\"custom_properties\":{\"title\":\"Caf\u00e9 \u2014 \u65e5\u672c\"}}";
+	}
+	batch += L"]";
+	return batch;
+}
+
+static void Checksum(int events)
+{
+	UploadRequest request;
+	request.apiVersion = L"2";
+	request.apiKey = L"0123456789abcdef0123456789abcdef";
+	request.events = MakeBatch(events);
+	request.uploadTime = L"1420070400000";
+
+	RunBenchmark("ComputeUploadChecksum", Param("events", events) + "," + Param("chars", static_cast<long long>(request.events.size())), kChecksums, [&request]
+	{
+		for (int i = 0; i < kChecksums; ++i)
+		{
+			ComputeUploadChecksum(request);
+		}
+	});
+}
+
+int main()
+{
+	for (auto events : kBatchSizes)
+	{
+		Checksum(events);
+	}
+	return 0;
+}
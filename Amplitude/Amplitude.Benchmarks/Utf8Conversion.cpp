@@ -0,0 +1,112 @@
+// UTF-16 to UTF-8 conversion benchmark, and back.
+//
+// Every event is converted on its way into SQLite and again on its way out
+// for upload; Database.cpp does it with std::wstring_convert, OverflowFile
+// with the Win32 calls.  Measures both (the Win32 ones on Windows only) on
+// event-sized strings, all ASCII and with some non-ASCII text mixed in.
+//
+// Only needs a C++11 compiler, e.g.:
+//
+//   cl /O2 /EHsc Utf8Conversion.cpp
+//   g++ -std=c++11 -O2 Utf8Conversion.cpp
+
+#include "Benchmark.h"
+
+#include <codecvt>
+#include <locale>
+#include <string>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+static const int kConversions = 20000;
+static const size_t kLengths[] = { 64, 512, 4096 };
+
+static std::wstring MakeText(size_t length, bool ascii)
+{
+	// Roughly the shape of an event: JSON punctuation, words and numbers.
+	static const wchar_t kAscii[] = L"{\"event_type\":\"view activated\",\"timestamp\":\"1420070400000\"}";
+	static const wchar_t kMixed[] = L"{\"title\":\"Caf\u00e9 \u2013 \u65e5\u672c\u8a9e \u00fcber alles\"}";
+
+	const wchar_t *source = ascii ? kAscii : kMixed;
+	auto sourceLength = std::char_traits<wchar_t>::length(source);
+
+	std::wstring text;
+	text.reserve(length);
+	while (text.size() < length)
+	{
+		text.push_back(source[text.size() % sourceLength]);
+	}
+	return text;
+}
+
+static void Run(size_t length, bool ascii)
+{
+	auto wide = MakeText(length, ascii);
+	auto params = Param("chars", static_cast<long long>(length)) + "," + Param("text", ascii ? "ascii" : "mixed");
+
+	std::wstring_convert<std::codecvt_utf8<wchar_t>, wchar_t> converter;
+	auto narrow = converter.to_bytes(wide);
+
+	size_t sink = 0;
+
+	RunBenchmark("Utf16ToUtf8.wstring_convert", params, kConversions, [&]
+	{
+		for (int i = 0; i < kConversions; ++i)
+		{
+			std::wstring_convert<std::codecvt_utf8<wchar_t>, wchar_t> c;
+			sink += c.to_bytes(wide).size();
+		}
+	});
+
+	RunBenchmark("Utf8ToUtf16.wstring_convert", params, kConversions, [&]
+	{
+		for (int i = 0; i < kConversions; ++i)
+		{
+			std::wstring_convert<std::codecvt_utf8<wchar_t>, wchar_t> c;
+			sink += c.from_bytes(narrow).size();
+		}
+	});
+
+#ifdef _WIN32
+	RunBenchmark("Utf16ToUtf8.WideCharToMultiByte", params, kConversions, [&]
+	{
+		for (int i = 0; i < kConversions; ++i)
+		{
+			auto size = WideCharToMultiByte(CP_UTF8, 0, wide.data(), static_cast<int>(wide.size()), nullptr, 0, nullptr, nullptr);
+			std::string result(size, '\0');
+			WideCharToMultiByte(CP_UTF8, 0, wide.data(), static_cast<int>(wide.size()), &result[0], size, nullptr, nullptr);
+			sink += result.size();
+		}
+	});
+
+	RunBenchmark("Utf8ToUtf16.MultiByteToWideChar", params, kConversions, [&]
+	{
+		for (int i = 0; i < kConversions; ++i)
+		{
+			auto size = MultiByteToWideChar(CP_UTF8, 0, narrow.data(), static_cast<int>(narrow.size()), nullptr, 0);
+			std::wstring result(size, L'\0');
+			MultiByteToWideChar(CP_UTF8, 0, narrow.data(), static_cast<int>(narrow.size()), &result[0], size);
+			sink += result.size();
+		}
+	});
+#endif
+
+	// Keep the conversions from being optimized away.
+	if (sink == 0)
+	{
+		std::printf("\n");
+	}
+}
+
+int main()
+{
+	for (auto length : kLengths)
+	{
+		Run(length, true);
+		Run(length, false);
+	}
+	return 0;
+}
@@ -0,0 +1,152 @@
+// Allocation benchmark for work items.
+//
+// Enqueues work items shaped like the ones EventReporter::CheckedLogEvent
+// queues (four handles, a timestamp and a flag) into a queue with room for
+// all of them, then drains and runs them, for std::function and for
+// UniqueFunction.  Every heap allocation is counted; each result carries
+// the number made by one pass over the items, as "allocations".
+//
+// Builds with the core; see CMakeLists.txt.
+
+// The core headers expect what the precompiled header provides.
+#include "pch.h"
+
+#include "Benchmark.h"
+
+#include "MpscQueue.h"
+#include "UniqueFunction.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string>
+
+using namespace Amplitude;
+
+static std::atomic<long long> gAllocations(0);
+
+void* operator new(size_t size)
+{
+	gAllocations++;
+	if (auto p = std::malloc(size == 0 ? 1 : size))
+	{
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+	std::free(p);
+}
+
+// The other forms all come down to the two above, so that nothing is
+// allocated or freed behind the count's back.
+void operator delete(void *p, size_t) noexcept
+{
+	operator delete(p);
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete[](void *p) noexcept
+{
+	operator delete(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+	operator delete(p);
+}
+
+static const unsigned int kItems = 100000;
+
+// Stand-ins for the handles a real work item captures.
+static int gName, gProperties, gApiProperties, gGlobalProperties;
+
+static long long gSum;
+
+template <typename WorkItem>
+static void Enqueue(MpscQueue<WorkItem> &queue)
+{
+	const void *name = &gName;
+	const void *properties = &gProperties;
+	const void *apiProperties = &gApiProperties;
+	const void *globalProperties = &gGlobalProperties;
+
+	for (unsigned int i = 0; i < kItems; ++i)
+	{
+		long long timestamp = i;
+		bool checkSession = (i & 1) != 0;
+		queue.TryEnqueue([=]
+		{
+			if (checkSession && name != properties && apiProperties != globalProperties)
+			{
+				gSum += timestamp;
+			}
+		});
+	}
+}
+
+template <typename WorkItem>
+static void Drain(MpscQueue<WorkItem> &queue)
+{
+	queue.Complete();
+	WorkItem item;
+	while (queue.TryDequeue(item))
+	{
+		item();
+	}
+}
+
+template <typename WorkItem>
+static void Run(const char *label)
+{
+	typedef MpscQueue<WorkItem> Queue;
+
+	// Counted in a pass of their own, as the timed runs also count the
+	// harness's bookkeeping.
+	long long enqueueAllocations;
+	long long drainAllocations;
+	{
+		Queue queue(kItems);
+		auto before = gAllocations.load();
+		Enqueue(queue);
+		enqueueAllocations = gAllocations.load() - before;
+
+		before = gAllocations.load();
+		Drain(queue);
+		drainAllocations = gAllocations.load() - before;
+	}
+
+	std::unique_ptr<Queue> queue;
+
+	RunBenchmark("WorkItem.Enqueue", Param("function", label) + "," + Param("allocations", enqueueAllocations), kItems, [&queue]
+	{
+		queue.reset(new Queue(kItems));
+	}, [&queue]
+	{
+		Enqueue(*queue);
+	});
+
+	RunBenchmark("WorkItem.Drain", Param("function", label) + "," + Param("allocations", drainAllocations), kItems, [&queue]
+	{
+		queue.reset(new Queue(kItems));
+		Enqueue(*queue);
+	}, [&queue]
+	{
+		Drain(*queue);
+	});
+}
+
+int main()
+{
+	Run<std::function<void()>>("std::function");
+	Run<UniqueFunction<void()>>("UniqueFunction");
+	return 0;
+}
@@ -0,0 +1,99 @@
+// Dispatch benchmark for WorkerThread.
+//
+// Measures what it costs to hand work to the worker: the time for one
+// producer to queue an item and for the worker to start running it, one
+// item at a time, and the throughput of producers queueing items as fast
+// as the worker will take them.
+//
+// Builds with the core; see CMakeLists.txt.
+
+// The core headers expect what the precompiled header provides.
+#include "pch.h"
+
+#include "Benchmark.h"
+
+#include "WorkerThread.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+using namespace Amplitude;
+
+static const int kRoundTrips = 20000;
+static const int kItemsPerProducer = 200000;
+static const int kProducerCounts[] = { 1, 2, 4 };
+
+// One item at a time: queue it, and wait until it has run.  The worker is
+// idle each time, so this includes waking it up.
+static void RoundTrip()
+{
+	WorkerThread worker;
+
+	RunBenchmark("WorkerThread.RoundTrip", "", kRoundTrips, [&worker]
+	{
+		std::mutex mutex;
+		std::condition_variable ran;
+		for (int i = 0; i < kRoundTrips; ++i)
+		{
+			auto done = false;
+			std::unique_lock<std::mutex> lock(mutex);
+			worker.TryAddWorkItem([&]
+			{
+				std::lock_guard<std::mutex> inner(mutex);
+				done = true;
+				ran.notify_one();
+			});
+			ran.wait(lock, [&done] { return done; });
+		}
+	});
+}
+
+// Producers queue small items as fast as they can, retrying when the
+// queue is full; timed until the worker has run them all.
+static void Throughput(int producers)
+{
+	WorkerThread worker;
+	const long long total = static_cast<long long>(producers) * kItemsPerProducer;
+
+	RunBenchmark("WorkerThread.Throughput", Param("producers", producers), total, [&worker, producers, total]
+	{
+		std::atomic<long long> ran(0);
+
+		std::vector<std::thread> threads;
+		for (int p = 0; p < producers; ++p)
+		{
+			threads.emplace_back([&worker, &ran]
+			{
+				for (int i = 0; i < kItemsPerProducer; ++i)
+				{
+					while (!worker.TryAddWorkItem([&ran] { ran.fetch_add(1, std::memory_order_relaxed); }))
+					{
+						std::this_thread::yield();
+					}
+				}
+			});
+		}
+
+		for (auto &thread : threads)
+		{
+			thread.join();
+		}
+
+		while (ran.load() < total)
+		{
+			std::this_thread::yield();
+		}
+	});
+}
+
+int main()
+{
+	RoundTrip();
+	for (auto producers : kProducerCounts)
+	{
+		Throughput(producers);
+	}
+	return 0;
+}
@@ -0,0 +1,125 @@
+#include "pch.h"
+#include "Aggregator.h"
+
+#include <algorithm>
+
+using namespace Amplitude;
+
+const std::vector<double>&
+Aggregator::GetBucketBounds()
+{
+	// Roughly logarithmic, 1-2-5 steps; suits latencies in milliseconds and
+	// sizes in bytes/items alike.
+	static const double kBounds[] = {
+		1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000
+	};
+	static const std::vector<double> bounds(std::begin(kBounds), std::end(kBounds));
+	return bounds;
+}
+
+Aggregator::Aggregator() : dirty(false), startTime(0)
+{
+}
+
+std::wstring
+Aggregator::MakeKey(const std::wstring &name, const std::wstring &properties)
+{
+	// A unit separator can't show up in serialized JSON unescaped, so keys
+	// can't collide.
+	std::wstring key;
+	key.reserve(name.length() + 1 + properties.length());
+	key.append(name);
+	key.push_back(L'\x1f');
+	key.append(properties);
+	return key;
+}
+
+bool
+Aggregator::MarkDirty(int64 now)
+{
+	if (dirty)
+	{
+		return false;
+	}
+
+	dirty = true;
+	startTime = now;
+	return true;
+}
+
+bool
+Aggregator::Increment(const std::wstring &name, const std::wstring &properties, int64 delta, int64 now)
+{
+	auto key = MakeKey(name, properties);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = counters.find(key);
+	if (it == counters.end())
+	{
+		Counter counter = { name, properties, 0 };
+		it = counters.emplace(std::move(key), std::move(counter)).first;
+	}
+
+	it->second.count += delta;
+	return MarkDirty(now);
+}
+
+bool
+Aggregator::Observe(const std::wstring &name, const std::wstring &properties, double value, int64 now)
+{
+	auto key = MakeKey(name, properties);
+	const auto &bounds = GetBucketBounds();
+
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = histograms.find(key);
+	if (it == histograms.end())
+	{
+		Histogram histogram = { name, properties, 0, 0.0, value, value, std::vector<int64>(bounds.size() + 1) };
+		it = histograms.emplace(std::move(key), std::move(histogram)).first;
+	}
+
+	auto &histogram = it->second;
+	histogram.count++;
+	histogram.sum += value;
+	histogram.min = std::min(histogram.min, value);
+	histogram.max = std::max(histogram.max, value);
+
+	auto bucket = std::lower_bound(bounds.begin(), bounds.end(), value) - bounds.begin();
+	histogram.buckets[bucket]++;
+
+	return MarkDirty(now);
+}
+
+bool
+Aggregator::Drain(Snapshot &snapshot)
+{
+	std::unordered_map<std::wstring, Counter> drainedCounters;
+	std::unordered_map<std::wstring, Histogram> drainedHistograms;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!dirty)
+		{
+			return false;
+		}
+
+		drainedCounters.swap(counters);
+		drainedHistograms.swap(histograms);
+		snapshot.startTime = startTime;
+		dirty = false;
+	}
+
+	snapshot.counters.clear();
+	snapshot.histograms.clear();
+
+	for (auto &entry : drainedCounters)
+	{
+		snapshot.counters.push_back(std::move(entry.second));
+	}
+
+	for (auto &entry : drainedHistograms)
+	{
+		snapshot.histograms.push_back(std::move(entry.second));
+	}
+
+	return true;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Amplitude
+{
+	// Accumulates counters and histograms in memory, so that events which
+	// exist only to be counted cost a hash lookup instead of a database row.
+	// Series are keyed by name plus the serialized properties, which are kept
+	// verbatim so they can be reported with the summary.
+	//
+	// Thread-safe; recording happens on the caller's thread, draining on the
+	// worker.
+	class Aggregator
+	{
+	public:
+		// Upper bounds of the fixed histogram buckets; a final, unbounded
+		// bucket catches everything larger.
+		static const std::vector<double>& GetBucketBounds();
+
+		struct Counter
+		{
+			std::wstring name;
+			std::wstring properties;
+			int64 count;
+		};
+
+		struct Histogram
+		{
+			std::wstring name;
+			std::wstring properties;
+			int64 count;
+			double sum;
+			double min;
+			double max;
+			std::vector<int64> buckets;
+		};
+
+		struct Snapshot
+		{
+			int64 startTime;
+			std::vector<Counter> counters;
+			std::vector<Histogram> histograms;
+		};
+
+		Aggregator();
+
+		Aggregator(Aggregator const&) = delete;
+		Aggregator& operator=(Aggregator const&) = delete;
+
+		// Both return true if this was the first thing recorded since the
+		// last drain, i.e. if a flush ought to be scheduled.
+		bool Increment(const std::wstring &name, const std::wstring &properties, int64 delta, int64 now);
+		bool Observe(const std::wstring &name, const std::wstring &properties, double value, int64 now);
+
+		// Takes everything recorded so far, leaving the aggregator empty.
+		// Returns false if there was nothing to take.
+		bool Drain(Snapshot &snapshot);
+
+	private:
+		bool MarkDirty(int64 now);
+
+		static std::wstring MakeKey(const std::wstring &name, const std::wstring &properties);
+
+		std::mutex mutex;
+		bool dirty;
+		int64 startTime;
+		std::unordered_map<std::wstring, Counter> counters;
+		std::unordered_map<std::wstring, Histogram> histograms;
+	};
+}
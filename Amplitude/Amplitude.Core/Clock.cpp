@@ -0,0 +1,104 @@
+#include "pch.h"
+#include "Clock.h"
+
+#include <atomic>
+#include <chrono>
+
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+using namespace Amplitude;
+
+// How long the offset is trusted for.
+static const int64 kCalibrationIntervalMillis = 1000;
+
+#ifdef _WIN32
+
+static int64 ReadPerformanceFrequency()
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	return frequency.QuadPart;
+}
+
+static const int64 gPerformanceFrequency = ReadPerformanceFrequency();
+
+#endif
+
+static int64 ReadWallClockMillis()
+{
+#ifdef _WIN32
+	FILETIME filetime;
+	GetSystemTimeAsFileTime(&filetime);
+
+	ULARGE_INTEGER date;
+	date.HighPart = filetime.dwHighDateTime;
+	date.LowPart = filetime.dwLowDateTime;
+
+	// From 100-nanosecond intervals since 1601 to milliseconds since 1970.
+	return static_cast<int64>(date.QuadPart / 10000) - 11644473600000LL;
+#else
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+#endif
+}
+
+int64
+Clock::MonotonicMillis()
+{
+#ifdef _WIN32
+	// Keeps counting while the device sleeps.  Split, so that the
+	// multiplication can't overflow however long the device has been up.
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return counter.QuadPart / gPerformanceFrequency * 1000 + counter.QuadPart % gPerformanceFrequency * 1000 / gPerformanceFrequency;
+#elif defined(CLOCK_BOOTTIME)
+	// Unlike CLOCK_MONOTONIC, keeps counting while the device sleeps.
+	timespec now;
+	clock_gettime(CLOCK_BOOTTIME, &now);
+	return static_cast<int64>(now.tv_sec) * 1000 + now.tv_nsec / 1000000;
+#else
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// The system clock minus the monotonic one, as of the last calibration,
+// and when the next one is due.  Calibrated once up front, so that no
+// caller ever sees an offset that hasn't been sampled.
+static std::atomic<int64> gOffset(ReadWallClockMillis() - Clock::MonotonicMillis());
+static std::atomic<int64> gNextCalibration(Clock::MonotonicMillis() + kCalibrationIntervalMillis);
+
+static void Calibrate()
+{
+	auto wall = ReadWallClockMillis();
+	gOffset.store(wall - Clock::MonotonicMillis(), std::memory_order_relaxed);
+}
+
+int64
+Clock::NowMillis()
+{
+	auto monotonic = MonotonicMillis();
+
+	// Whoever notices that a calibration is due does it; everyone else
+	// carries on with the old offset meanwhile.
+	auto next = gNextCalibration.load(std::memory_order_relaxed);
+	if (monotonic >= next && gNextCalibration.compare_exchange_strong(next, monotonic + kCalibrationIntervalMillis, std::memory_order_relaxed))
+	{
+		Calibrate();
+	}
+
+	return monotonic + gOffset.load(std::memory_order_relaxed);
+}
+
+int64
+Clock::ToMonotonicMillis(int64 wallMillis)
+{
+	return wallMillis - gOffset.load(std::memory_order_relaxed);
+}
+
+void
+Clock::Recalibrate()
+{
+	gNextCalibration.store(MonotonicMillis() + kCalibrationIntervalMillis, std::memory_order_relaxed);
+	Calibrate();
+}
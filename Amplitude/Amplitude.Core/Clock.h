@@ -0,0 +1,37 @@
+#pragma once
+
+namespace Amplitude
+{
+	// Time for events and sessions.  Reading the system clock through
+	// GetSystemTime and SystemTimeToFileTime for every event is slow, and
+	// the result jumps whenever the clock is set.  Clock reads a monotonic
+	// counter instead, and turns it into wall-clock time with an offset
+	// sampled from the system clock, sampled again once a second has
+	// passed on the counter.
+	class Clock
+	{
+	public:
+		// Milliseconds since the Unix epoch, for stamping events.  Follows
+		// the system clock when it's set, within a second.
+		static int64 NowMillis();
+
+		// Milliseconds since some arbitrary point; only differences mean
+		// anything.  Never goes backward, whatever the system clock does,
+		// so it's what to measure durations with.  Includes time the
+		// device spends asleep, where the platform allows.
+		static int64 MonotonicMillis();
+
+		// Where a wall-clock time from NowMillis falls on the monotonic
+		// clock, by the current offset; exact unless the system clock has
+		// been set since.  Only for times that weren't stamped on both
+		// clocks at once, e.g. read back from disk.
+		static int64 ToMonotonicMillis(int64 wallMillis);
+
+		// Samples the system clock now rather than at the next second, e.g.
+		// when the app resumes.
+		static void Recalibrate();
+
+	private:
+		Clock();
+	};
+}
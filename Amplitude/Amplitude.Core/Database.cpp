@@ -0,0 +1,787 @@
+#include "pch.h"
+#include "Database.h"
+#include "Trace.h"
+#include "Utf8.h"
+
+#include <cassert>
+#include <climits>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+using std::string;
+
+using namespace Amplitude;
+
+// SQLite requires SQL to be encoded as UTF-8; as these are all ASCII, we're good.  Just FYI.
+static const char * const kCreateTable = "CREATE TABLE IF NOT EXISTS events (id INTEGER PRIMARY KEY AUTOINCREMENT, event TEXT, timestamp INTEGER);";
+static const char * const kGetSchemaVersion = "PRAGMA user_version;";
+static const char * const kGetColumns = "PRAGMA table_info(events);";
+static const char * const kAddTimestampColumn = "ALTER TABLE events ADD COLUMN timestamp INTEGER;";
+static const char * const kCreateTimestampIndex = "CREATE INDEX IF NOT EXISTS events_timestamp ON events (timestamp);";
+static const char * const kSetSchemaVersion = "PRAGMA user_version = 2;";
+static const char * const kInsertEvent = "INSERT INTO events (event, timestamp) VALUES (?, ?);";
+static const char * const kGetLastEventId = "SELECT seq FROM sqlite_sequence WHERE name = 'events';";
+static const char * const kCopyEventsBetween = "INSERT INTO events (event, timestamp) SELECT event, timestamp FROM events WHERE id > ?1 AND id < ?2 ORDER BY id;";
+static const char * const kDeleteEventsBetween = "DELETE FROM events WHERE id > ?1 AND id < ?2;";
+static const char * const kBeginTransaction = "BEGIN IMMEDIATE;";
+static const char * const kCommitTransaction = "COMMIT;";
+static const char * const kRollbackTransaction = "ROLLBACK;";
+static const char * const kGetEventsSince = "SELECT id, event FROM events WHERE id < ? AND (timestamp IS NULL OR timestamp >= ?) ORDER BY id ASC LIMIT ?;";
+static const char * const KGetEventCount = "SELECT COUNT(id) FROM events;";
+static const char * const kGetNthEventId = "SELECT id FROM events LIMIT 1 OFFSET (? - 1);";
+static const char * const kDeleteEventsBefore = "DELETE FROM events WHERE id <= ?;";
+static const char * const kDeleteSingleEvent = "DELETE FROM events WHERE id = ?;";
+static const char * const kDeleteExpiredEvents = "DELETE FROM events WHERE id IN (SELECT id FROM events WHERE timestamp < ? ORDER BY timestamp LIMIT ?);";
+static const char * const kReplaceInEvents = "UPDATE events SET event = replace(event, ?1, ?2) WHERE instr(event, ?1) > 0;";
+static const char * const kGetPageCount = "PRAGMA page_count;";
+static const char * const kGetPageSize = "PRAGMA page_size;";
+
+// Version 2 added the timestamp column and its index.
+static const int kSchemaVersion = 2;
+
+#ifdef __cplusplus_winrt
+// Declared as extern in <sqlite.h>, need to define it here
+char * sqlite3_temp_directory;
+#endif
+
+//
+// IHasDatabase
+//
+// Base class that holds a SQLite database pointer and routines
+// that are common to Database and Statement that require such
+// a pointer.
+
+class IHasDatabase
+{
+public:
+	IHasDatabase(IHasDatabase const&) = delete;
+	IHasDatabase(IHasDatabase&&) = delete;
+	IHasDatabase& operator=(IHasDatabase const&) = delete;
+
+protected:
+	sqlite3 *db_;
+
+	IHasDatabase() {}
+
+	void Check(int rc, int expected = SQLITE_OK);
+};
+
+void IHasDatabase::Check(int rc, int expected)
+{
+	if (rc != expected)
+	{
+		auto msg = sqlite3_errmsg(db_);
+		throw std::runtime_error(msg);
+	}
+}
+
+
+//
+// Statement
+//
+// A lightweight RAII wrapper around sqlite3 prepared statements.
+
+class Statement : protected IHasDatabase
+{
+public:
+	Statement(sqlite3 *db, const char *sql);
+	~Statement();
+
+	void Bind(int index, int value);
+	void Bind(int index, int64 value);
+	void Bind(int index, const std::string &value);
+
+	void Reset();
+
+	bool Step();
+	int Exec();
+
+	int GetColumnCount();
+
+	int IntColumn(int index);
+	int64 Int64Column(int index);
+	string TextColumn(int index);
+private:
+	sqlite3_stmt *stmt;
+};
+
+Statement::Statement(sqlite3 *db, const char * sql)
+{
+	db_ = db;
+
+	auto rc = sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr);
+	Check(rc, SQLITE_OK);
+}
+
+Statement::~Statement()
+{
+	auto rc = sqlite3_finalize(stmt);
+#ifdef DEBUG
+	if (rc != SQLITE_OK)
+	{
+		std::string msg(sqlite3_errmsg(db_));
+		std::cout << msg << std::endl;
+	}
+#endif
+}
+
+void
+Statement::Bind(int index, int value)
+{
+	auto rc = sqlite3_bind_int(stmt, index, value);
+	Check(rc, SQLITE_OK);
+}
+
+void
+Statement::Bind(int index, int64 value)
+{
+	auto rc = sqlite3_bind_int64(stmt, index, value);
+	Check(rc, SQLITE_OK);
+}
+
+void
+Statement::Bind(int index, const std::string  &value)
+{
+	auto rc = sqlite3_bind_text(stmt, index, value.data(), value.length(), SQLITE_STATIC);
+	Check(rc, SQLITE_OK);
+}
+
+void
+Statement::Reset()
+{
+	auto rc = sqlite3_reset(stmt);
+	Check(rc, SQLITE_OK);
+}
+
+bool
+Statement::Step()
+{
+	auto rc = sqlite3_step(stmt);
+
+	if (rc == SQLITE_ROW)
+	{
+		return true;
+	}
+
+	if (rc == SQLITE_DONE)
+	{
+		return false;
+	}
+
+	Check(rc, -1); // force an exception
+	throw std::logic_error("Impossible");
+}
+
+int
+Statement::Exec()
+{
+	auto rc = sqlite3_step(stmt);
+
+	Check(rc, SQLITE_DONE);
+
+	return sqlite3_changes(db_);
+}
+
+int
+Statement::GetColumnCount()
+{
+	return sqlite3_column_count(stmt);
+}
+
+int
+Statement::IntColumn(int index)
+{
+	return sqlite3_column_int(stmt, index);
+}
+
+int64
+Statement::Int64Column(int index)
+{
+	return sqlite3_column_int64(stmt, index);
+}
+
+string
+Statement::TextColumn(int index)
+{
+	auto chars = reinterpret_cast<const char *>(sqlite3_column_text(stmt, index));
+	if (chars == nullptr)
+	{
+		return string();
+	}
+	return string(chars, sqlite3_column_bytes(stmt, index));
+}
+
+
+//
+// Transaction
+//
+// Begins a transaction on construction; unless Commit() is called, it is
+// rolled back on destruction.  If one is already open on the connection,
+// this joins it instead, and leaves it to whoever opened it.
+
+class Transaction : protected IHasDatabase
+{
+public:
+	Transaction(sqlite3 *db);
+	~Transaction();
+
+	void Commit();
+
+private:
+	bool committed;
+	bool joined;
+};
+
+Transaction::Transaction(sqlite3 *db) : committed(false)
+{
+	db_ = db;
+
+	joined = sqlite3_get_autocommit(db_) == 0;
+	if (!joined)
+	{
+		Statement stmt(db_, kBeginTransaction);
+		stmt.Exec();
+	}
+}
+
+Transaction::~Transaction()
+{
+	if (!committed && !joined)
+	{
+		// Nothing sensible to do if this fails; SQLite will roll back
+		// the transaction when the connection closes anyways.
+		sqlite3_exec(db_, kRollbackTransaction, nullptr, nullptr, nullptr);
+	}
+}
+
+void
+Transaction::Commit()
+{
+	if (!joined)
+	{
+		Statement stmt(db_, kCommitTransaction);
+		stmt.Exec();
+	}
+	committed = true;
+}
+
+
+//
+// Database::Impl
+//
+// Private implementation details of the Amplitude SQLite database.
+
+class Database::Impl : protected IHasDatabase
+{
+public:
+	Impl(const wstring &path);
+	~Impl();
+
+	int64 AddEvent(const wstring &event, int64 timestamp);
+	int64 AddEvents(const vector<EventRecord> &events);
+	int64 AddEventAfter(const wstring &event, int64 timestamp, int64 afterId);
+
+	int64 GetLastEventId();
+	int64 GetEventCount();
+	int64 GetSizeInBytes();
+
+	pair<int64, wstring> GetEventsSince(int64 eventId, int limit, int64 minTimestamp);
+	int64 GetNthEventId(int n);
+
+	int RemoveEvents(int64 maxId);
+	int RemoveSingleEvent(int64 eventId);
+	int RemoveExpiredEvents(int64 before, int limit);
+
+	int ReplaceInEvents(const wstring &text, const wstring &replacement);
+
+	void BeginTransaction();
+	void CommitTransaction();
+	bool IsInTransaction() const;
+
+private:
+	void Migrate();
+
+	unique_ptr<Transaction> transaction;
+};
+
+Database::Impl::Impl(const wstring &path)
+{
+	auto narrowPath = ToUtf8(path);
+	auto rc = sqlite3_open(narrowPath.data(), &db_);
+	Check(rc, SQLITE_OK);
+
+	// Make sure the events table exists
+	Statement stmt(db_, kCreateTable);
+	stmt.Exec();
+
+	// Only reads the database header, so it's cheap to check every time.
+	Statement version(db_, kGetSchemaVersion);
+	if (version.Step() && version.IntColumn(0) < kSchemaVersion)
+	{
+		Migrate();
+	}
+}
+
+void
+Database::Impl::Migrate()
+{
+	Transaction txn(db_);
+
+	// Tables from before version 2 get the timestamp column.  Their events
+	// have none, and never expire.
+	auto hasTimestamp = false;
+	{
+		Statement columns(db_, kGetColumns);
+		while (columns.Step())
+		{
+			hasTimestamp = hasTimestamp || columns.TextColumn(1) == "timestamp";
+		}
+	}
+
+	if (!hasTimestamp)
+	{
+		Statement addColumn(db_, kAddTimestampColumn);
+		addColumn.Exec();
+	}
+
+	Statement createIndex(db_, kCreateTimestampIndex);
+	createIndex.Exec();
+
+	Statement setVersion(db_, kSetSchemaVersion);
+	setVersion.Exec();
+
+	txn.Commit();
+}
+
+Database::Impl::~Impl()
+{
+	// Roll back anything left uncommitted while we still can.
+	transaction.reset();
+
+	auto rc = sqlite3_close(db_);
+#ifdef DEBUG
+	if (rc != 0)
+	{
+		std::string msg(sqlite3_errmsg(db_));
+		std::cerr << msg << std::endl;
+	}
+#endif
+}
+
+int64
+Database::Impl::AddEvent(const wstring &event, int64 timestamp)
+{
+	AMPLITUDE_TRACE_SPAN("Database::AddEvent");
+
+	Statement stmt(db_, kInsertEvent);
+
+	auto str = ToUtf8(event);
+	stmt.Bind(1, str);
+	stmt.Bind(2, timestamp);
+
+	auto rows = stmt.Exec();
+
+	return sqlite3_last_insert_rowid(db_);
+}
+
+int64
+Database::Impl::AddEvents(const vector<EventRecord> &events)
+{
+	AMPLITUDE_TRACE_SPAN("Database::AddEvents");
+
+	Transaction txn(db_);
+	Statement stmt(db_, kInsertEvent);
+
+	for (const auto &event : events)
+	{
+		// Bind() doesn't copy the text, so it has to outlive the Exec().
+		auto str = ToUtf8(event.json);
+		stmt.Bind(1, str);
+		stmt.Bind(2, event.timestamp);
+		stmt.Exec();
+		stmt.Reset();
+	}
+
+	txn.Commit();
+
+	return sqlite3_last_insert_rowid(db_);
+}
+
+int64
+Database::Impl::AddEventAfter(const wstring &event, int64 timestamp, int64 afterId)
+{
+	AMPLITUDE_TRACE_SPAN("Database::AddEventAfter");
+
+	Transaction txn(db_);
+	auto eventId = AddEvent(event, timestamp);
+
+	// IDs only ever go up, so the events in between are copied after it,
+	// in order, and the originals removed.
+	Statement copy(db_, kCopyEventsBetween);
+	copy.Bind(1, afterId);
+	copy.Bind(2, eventId);
+	copy.Exec();
+
+	Statement remove(db_, kDeleteEventsBetween);
+	remove.Bind(1, afterId);
+	remove.Bind(2, eventId);
+	remove.Exec();
+
+	txn.Commit();
+
+	return eventId;
+}
+
+int64
+Database::Impl::GetLastEventId()
+{
+	AMPLITUDE_TRACE_SPAN("Database::GetLastEventId");
+
+	// AUTOINCREMENT keeps this, even once the events are gone.
+	Statement stmt(db_, kGetLastEventId);
+
+	auto result = 0LL;
+	if (stmt.Step())
+	{
+		result = stmt.Int64Column(0);
+	}
+	return result;
+}
+
+pair<int64, wstring>
+Database::Impl::GetEventsSince(int64 eventId, int limit, int64 minTimestamp)
+{
+	AMPLITUDE_TRACE_SPAN("Database::GetEventsSince");
+
+	// One query, whichever bounds apply; a negative LIMIT is no limit.
+	Statement stmt(db_, kGetEventsSince);
+	stmt.Bind(1, eventId >= 0 ? eventId : LLONG_MAX);
+	stmt.Bind(2, minTimestamp);
+	stmt.Bind(3, limit > 0 ? limit : -1);
+
+	// Built as UTF-8, as it comes out of SQLite, and converted once at the
+	// end.
+	string events("[");
+	auto maxId = -1LL;
+	while (stmt.Step())
+	{
+		auto id = stmt.Int64Column(0);
+		auto text = stmt.TextColumn(1);
+
+		if (id > maxId)
+		{
+			maxId = id;
+		}
+
+		if (events.size() > 1)
+		{
+			events.push_back(',');
+		}
+
+		// The ID goes in as the object's first member, so the event
+		// needn't be parsed just to add it.
+		events.append("{\"event_id\":");
+		events.append(std::to_string(id));
+
+		auto body = text.find_first_not_of(" \t\r\n", 1);
+		if (text.empty() || text[0] != '{' || body == string::npos)
+		{
+			throw std::runtime_error("Stored event is not a JSON object");
+		}
+
+		if (text[body] != '}')
+		{
+			events.push_back(',');
+		}
+		events.append(text, body, string::npos);
+	}
+	events.push_back(']');
+
+	return std::make_pair(maxId, FromUtf8(events));
+}
+
+int64
+Database::Impl::GetEventCount()
+{
+	AMPLITUDE_TRACE_SPAN("Database::GetEventCount");
+
+	Statement stmt(db_, KGetEventCount);
+
+	auto result = 0LL;
+	if (stmt.Step())
+	{
+		result = stmt.Int64Column(0);
+	}
+	return result;
+}
+
+int64
+Database::Impl::GetSizeInBytes()
+{
+	// Both only read the database header, so this is cheap.
+	Statement pageCount(db_, kGetPageCount);
+	Statement pageSize(db_, kGetPageSize);
+
+	if (!pageCount.Step() || !pageSize.Step())
+	{
+		return 0;
+	}
+	return pageCount.Int64Column(0) * pageSize.Int64Column(0);
+}
+
+int64
+Database::Impl::GetNthEventId(int n)
+{
+	Statement stmt(db_, kGetNthEventId);
+	stmt.Bind(1, n);
+
+	auto result = -1LL;
+	if (stmt.Step())
+	{
+		result = stmt.Int64Column(0);
+	}
+
+	return result;
+}
+
+int
+Database::Impl::RemoveEvents(int64 maxId)
+{
+	AMPLITUDE_TRACE_SPAN("Database::RemoveEvents");
+
+	Statement stmt(db_, kDeleteEventsBefore);
+	stmt.Bind(1, maxId);
+
+	return stmt.Exec();
+}
+
+int
+Database::Impl::RemoveSingleEvent(int64 eventId)
+{
+	Statement stmt(db_, kDeleteSingleEvent);
+	stmt.Bind(1, eventId);
+
+	return stmt.Exec();
+}
+
+int
+Database::Impl::RemoveExpiredEvents(int64 before, int limit)
+{
+	AMPLITUDE_TRACE_SPAN("Database::RemoveExpiredEvents");
+
+	Statement stmt(db_, kDeleteExpiredEvents);
+	stmt.Bind(1, before);
+	stmt.Bind(2, limit);
+
+	return stmt.Exec();
+}
+
+int
+Database::Impl::ReplaceInEvents(const wstring &text, const wstring &replacement)
+{
+	AMPLITUDE_TRACE_SPAN("Database::ReplaceInEvents");
+
+	// Bound without copying; they have to outlive the statement.
+	auto narrowText = ToUtf8(text);
+	auto narrowReplacement = ToUtf8(replacement);
+
+	Statement stmt(db_, kReplaceInEvents);
+	stmt.Bind(1, narrowText);
+	stmt.Bind(2, narrowReplacement);
+
+	return stmt.Exec();
+}
+
+
+void
+Database::Impl::BeginTransaction()
+{
+	if (transaction != nullptr)
+	{
+		throw std::logic_error("A transaction is already open");
+	}
+
+	transaction = std::make_unique<Transaction>(db_);
+}
+
+void
+Database::Impl::CommitTransaction()
+{
+	if (transaction == nullptr)
+	{
+		throw std::logic_error("No transaction is open");
+	}
+
+	transaction->Commit();
+	transaction.reset();
+}
+
+bool
+Database::Impl::IsInTransaction() const
+{
+	return transaction != nullptr;
+}
+
+
+// Database
+//
+// 
+
+
+Database::Database(const wstring &path) : impl(std::make_unique<Impl>(path))
+{
+}
+
+void
+Database::SetTempDirectory(const wstring &path)
+{
+	// Per http://www.sqlite.org/c3ref/temp_directory.html, the temp directory
+	// must be set *before* opening any database connections at all.
+	sqlite3_temp_directory = sqlite3_mprintf("%s", ToUtf8(path).c_str());
+}
+
+Database::~Database()
+{
+}
+
+int64
+Database::AddEvent(const wstring &event, int64 timestamp)
+{
+	return impl->AddEvent(event, timestamp);
+}
+
+int64
+Database::AddEvents(const vector<EventRecord> &events)
+{
+	return impl->AddEvents(events);
+}
+
+int64
+Database::AddEventAfter(const wstring &event, int64 timestamp, int64 afterId)
+{
+	return impl->AddEventAfter(event, timestamp, afterId);
+}
+
+int64
+Database::GetLastEventId()
+{
+	return impl->GetLastEventId();
+}
+
+pair<int64, wstring>
+Database::GetEventsSince(int64 eventId, int limit, int64 minTimestamp)
+{
+	return impl->GetEventsSince(eventId, limit, minTimestamp);
+}
+
+int64
+Database::GetNthEventId(int n)
+{
+	return impl->GetNthEventId(n);
+}
+
+int64
+Database::GetEventCount()
+{
+	return impl->GetEventCount();
+}
+
+int64
+Database::GetSizeInBytes()
+{
+	return impl->GetSizeInBytes();
+}
+
+int
+Database::RemoveEvents(int64 maxId)
+{
+	return impl->RemoveEvents(maxId);
+}
+
+int
+Database::RemoveSingleEvent(int64 eventId)
+{
+	return impl->RemoveSingleEvent(eventId);
+}
+
+int
+Database::RemoveExpiredEvents(int64 before, int limit)
+{
+	return impl->RemoveExpiredEvents(before, limit);
+}
+
+int
+Database::ReplaceInEvents(const wstring &text, const wstring &replacement)
+{
+	return impl->ReplaceInEvents(text, replacement);
+}
+
+void
+Database::BeginTransaction()
+{
+	impl->BeginTransaction();
+}
+
+void
+Database::CommitTransaction()
+{
+	impl->CommitTransaction();
+}
+
+bool
+Database::IsInTransaction() const
+{
+	return impl->IsInTransaction();
+}
+
+//
+// DatabaseUploadSource
+//
+
+DatabaseUploadSource::DatabaseUploadSource(OpenFunction open, std::function<int64()> boundary, std::function<int64()> expiry) :
+	open(open),
+	boundary(boundary),
+	expiry(expiry)
+{
+}
+
+UploadBatch
+DatabaseUploadSource::ReadBatch(int64 maxCount)
+{
+	auto db = open();
+	auto maxIdAndEvents = db->GetEventsSince(boundary(), maxCount < 0 ? -1 : static_cast<int>(maxCount), expiry());
+
+	UploadBatch batch;
+	batch.maxId = maxIdAndEvents.first;
+	if (batch.maxId != -1)
+	{
+		batch.events = std::move(maxIdAndEvents.second);
+	}
+	return batch;
+}
+
+int64
+DatabaseUploadSource::Delete(int64 maxId)
+{
+	auto db = open();
+
+	// The batch has been accepted, so deleting it mustn't be rolled back
+	// with the connection's transaction, or it would be uploaded again.
+	// Commit what the transaction holds so far, delete on its own, and
+	// start the transaction over for whatever comes next.
+	auto inTransaction = db->IsInTransaction();
+	if (inTransaction)
+	{
+		db->CommitTransaction();
+	}
+
+	db->RemoveEvents(maxId);
+	auto count = db->GetEventCount();
+
+	if (inTransaction)
+	{
+		db->BeginTransaction();
+	}
+	return count;
+}
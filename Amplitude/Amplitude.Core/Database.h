@@ -0,0 +1,120 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility> // for std::pair
+#include <vector>
+
+#include "UploadPipeline.h"
+
+namespace Amplitude
+{
+	using std::pair;
+	using std::unique_ptr;
+	using std::vector;
+	using std::wstring;
+
+	// An event to store: a JSON object, and when it happened.
+	struct EventRecord
+	{
+		EventRecord(wstring json, int64 timestamp) :
+			json(std::move(json)),
+			timestamp(timestamp)
+		{
+		}
+
+		wstring json;
+		int64 timestamp;
+	};
+
+	// The event store: one row per event, as JSON text, with its timestamp
+	// alongside so that expired events can be found without parsing them.
+	// Failures are thrown as std::runtime_error.
+	class Database
+	{
+	public:
+		Database(const wstring &path);
+		~Database();
+
+		// Where SQLite puts its temporary files.  It can't find anywhere
+		// by itself under Windows Runtime, so the app has to say, before
+		// opening any database.
+		static void SetTempDirectory(const wstring &path);
+
+		// 'event' is a JSON object.
+		int64 AddEvent(const wstring &event, int64 timestamp);
+
+		// Adds all of the given events in a single transaction; either all
+		// of them are stored, or none are.  Returns the ID of the last one.
+		int64 AddEvents(const vector<EventRecord> &events);
+
+		// Stores an event where it would have gone had it been added right
+		// after the one with ID 'afterId': events added since then are
+		// moved after it, in their order, and given new IDs.  Uploads go
+		// by ID, so that's the order they're sent in.  All in a single
+		// transaction; returns the event's ID.
+		int64 AddEventAfter(const wstring &event, int64 timestamp, int64 afterId);
+
+		// The ID of the last event added, even if it has been removed
+		// since; zero if none ever was.
+		int64 GetLastEventId();
+
+		int64 GetEventCount();
+
+		// The size of the database file, including free pages.
+		int64 GetSizeInBytes();
+
+		// The events with IDs below eventId (-1 for any), oldest first and
+		// no more than 'limit' of them (if positive), as a JSON array,
+		// with each event's ID added as "event_id"; and the highest of
+		// those IDs, or -1 if there were no events.  Events stamped before
+		// minTimestamp (LLONG_MIN for none) are skipped, and count towards
+		// neither.
+		pair<int64, wstring> GetEventsSince(int64 eventId, int limit, int64 minTimestamp);
+		int64 GetNthEventId(int n);
+		
+		int RemoveEvents(int64 maxId);
+		int RemoveSingleEvent(int64 eventId);
+
+		// Removes up to 'limit' of the events stamped before 'before',
+		// oldest first; returns how many it removed.
+		int RemoveExpiredEvents(int64 before, int limit);
+
+		// Replaces every occurrence of 'text' in every stored event;
+		// returns the number of events changed.
+		int ReplaceInEvents(const wstring &text, const wstring &replacement);
+
+		// Everything written through this connection from here on joins one
+		// transaction, until CommitTransaction().  If that never happens,
+		// it's all rolled back when the connection is closed.
+		void BeginTransaction();
+		void CommitTransaction();
+		bool IsInTransaction() const;
+
+	private:
+		class Impl;
+		unique_ptr<Impl> impl;
+	};
+
+	// Feeds stored events to UploadPipeline.
+	class DatabaseUploadSource : public IUploadSource
+	{
+	public:
+		typedef std::function<std::shared_ptr<Database>()> OpenFunction;
+
+		// Events from 'boundary()' on are held back, and events stamped
+		// before 'expiry()' are skipped; -1 and LLONG_MIN mean neither.
+		// 'open' supplies the connection to use, so that the source can
+		// share one that's in the middle of a transaction.
+		DatabaseUploadSource(OpenFunction open, std::function<int64()> boundary, std::function<int64()> expiry);
+
+		UploadBatch ReadBatch(int64 maxCount) override;
+		int64 Delete(int64 maxId) override;
+
+	private:
+		OpenFunction open;
+		std::function<int64()> boundary;
+		std::function<int64()> expiry;
+	};
+}
@@ -0,0 +1,177 @@
+#include "pch.h"
+#include "EventCoalescer.h"
+
+#include <algorithm>
+
+using namespace Amplitude;
+
+static void HashInto(uint64_t &hash, const std::wstring &str)
+{
+	for (auto ch : str)
+	{
+		hash ^= static_cast<uint64_t>(ch);
+		hash *= 1099511628211ULL;
+	}
+}
+
+EventCoalescer::EventCoalescer() :
+	window(0),
+	count(0),
+	occupied(kCapacity),
+	slots(kCapacity)
+{
+}
+
+uint64_t
+EventCoalescer::Fingerprint(const std::wstring &name, const std::wstring &properties, const std::wstring &globalProperties)
+{
+	// 64-bit FNV-1a, with separators so that ("ab", "c") and ("a", "bc") differ.
+	uint64_t hash = 14695981039346656037ULL;
+	HashInto(hash, name);
+	hash ^= 0x1f;
+	hash *= 1099511628211ULL;
+	HashInto(hash, properties);
+	hash ^= 0x1f;
+	hash *= 1099511628211ULL;
+	HashInto(hash, globalProperties);
+	return hash;
+}
+
+void
+EventCoalescer::SetWindow(int64 windowMillis)
+{
+	window = std::max(0LL, windowMillis);
+}
+
+bool
+EventCoalescer::IsEnabled() const
+{
+	return window > 0;
+}
+
+EventCoalescer::Result
+EventCoalescer::Add(const std::wstring &name, const std::wstring &properties, const std::wstring &globalProperties, int64 timestamp, int64 monotonic)
+{
+	if (!IsEnabled())
+	{
+		return Result::Refused;
+	}
+
+	auto fingerprint = Fingerprint(name, properties, globalProperties);
+	for (size_t probe = 0; probe < kCapacity; ++probe)
+	{
+		auto index = (fingerprint + probe) % kCapacity;
+		if (!occupied[index])
+		{
+			if (count >= kMaxLoad)
+			{
+				return Result::Refused;
+			}
+
+			Entry entry = { fingerprint, name, properties, globalProperties, timestamp, timestamp, 1, monotonic };
+			occupied[index] = true;
+			slots[index] = std::move(entry);
+			++count;
+			return Result::Held;
+		}
+
+		auto &entry = slots[index];
+		if (entry.fingerprint == fingerprint && entry.name == name && entry.properties == properties && entry.globalProperties == globalProperties)
+		{
+			if (monotonic - entry.firstMonotonic >= window)
+			{
+				// Its window has closed, but it hasn't been flushed yet;
+				// merging now would stretch the window.
+				return Result::Refused;
+			}
+
+			entry.lastTimestamp = std::max(entry.lastTimestamp, timestamp);
+			entry.count++;
+			return Result::Merged;
+		}
+	}
+
+	return Result::Refused;
+}
+
+void
+EventCoalescer::Insert(Entry &&entry)
+{
+	for (size_t probe = 0; probe < kCapacity; ++probe)
+	{
+		auto index = (entry.fingerprint + probe) % kCapacity;
+		if (!occupied[index])
+		{
+			occupied[index] = true;
+			slots[index] = std::move(entry);
+			++count;
+			return;
+		}
+	}
+}
+
+void
+EventCoalescer::Flush(int64 now, bool all, const std::function<void(const Entry&)> &emit)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	std::vector<Entry> due;
+	std::vector<Entry> remaining;
+	for (size_t i = 0; i < kCapacity; ++i)
+	{
+		if (!occupied[i])
+		{
+			continue;
+		}
+
+		if (all || now - slots[i].firstMonotonic >= window)
+		{
+			due.push_back(std::move(slots[i]));
+		}
+		else
+		{
+			remaining.push_back(std::move(slots[i]));
+		}
+
+		occupied[i] = false;
+	}
+
+	// Removing entries from a linear-probed table breaks probe chains;
+	// with so few slots, it's simplest to re-insert whatever is left.
+	count = 0;
+	for (auto &entry : remaining)
+	{
+		Insert(std::move(entry));
+	}
+
+	std::sort(due.begin(), due.end(), [](const Entry &lhs, const Entry &rhs)
+	{
+		return lhs.firstMonotonic < rhs.firstMonotonic;
+	});
+
+	for (const auto &entry : due)
+	{
+		emit(entry);
+	}
+}
+
+int64
+EventCoalescer::GetNextDeadline() const
+{
+	auto deadline = -1LL;
+	for (size_t i = 0; i < kCapacity; ++i)
+	{
+		if (occupied[i])
+		{
+			auto closes = slots[i].firstMonotonic + window;
+			if (deadline == -1 || closes < deadline)
+			{
+				deadline = closes;
+			}
+		}
+	}
+	return deadline;
+}
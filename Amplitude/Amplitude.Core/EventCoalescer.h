@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace Amplitude
+{
+	// Holds events back for a short window, merging repeats of an event with
+	// the same name, properties and global properties into a single event
+	// with a count.
+	//
+	// Pending events live in a small open-addressed hash table keyed on a
+	// fingerprint of the name and serialized properties; the full strings are
+	// compared too, so distinct events are never merged.  When the table is
+	// full, new events are refused and should be logged as they are.
+	//
+	// Windows are measured on the monotonic clock (see Clock), so setting
+	// the device's clock neither holds events back nor lets them go early.
+	//
+	// Not thread-safe; it is only meant to be used from the worker thread.
+	class EventCoalescer
+	{
+	public:
+		struct Entry
+		{
+			uint64_t fingerprint;
+			std::wstring name;
+			std::wstring properties;
+
+			// As they were when the events were logged, serialized.
+			std::wstring globalProperties;
+
+			// When the first and the latest of the events happened, by the
+			// wall clock.
+			int64 firstTimestamp;
+			int64 lastTimestamp;
+			int64 count;
+
+			// When the first event happened, on the monotonic clock; its
+			// window runs from here.
+			int64 firstMonotonic;
+		};
+
+		enum class Result
+		{
+			// A pending event absorbed this one.
+			Merged,
+
+			// This event is now pending.
+			Held,
+
+			// This event can't be coalesced, and should be logged directly.
+			Refused
+		};
+
+		EventCoalescer();
+
+		EventCoalescer(EventCoalescer const&) = delete;
+		EventCoalescer& operator=(EventCoalescer const&) = delete;
+
+		// Zero (the default) disables coalescing.
+		void SetWindow(int64 windowMillis);
+		bool IsEnabled() const;
+
+		// 'monotonic' is the event's stamp on Clock::MonotonicMillis().
+		Result Add(const std::wstring &name, const std::wstring &properties, const std::wstring &globalProperties, int64 timestamp, int64 monotonic);
+
+		// Hands every pending event whose window has closed by 'now', on
+		// Clock::MonotonicMillis() (or every pending event, if 'all' is
+		// set), to 'emit', oldest first.
+		void Flush(int64 now, bool all, const std::function<void(const Entry&)> &emit);
+
+		// When the earliest pending window closes, on the monotonic clock,
+		// or -1 if nothing is pending.
+		int64 GetNextDeadline() const;
+
+	private:
+		static const size_t kCapacity = 64;
+
+		// Never fill the table beyond this, so probe sequences stay short.
+		static const size_t kMaxLoad = kCapacity * 3 / 4;
+
+		static uint64_t Fingerprint(const std::wstring &name, const std::wstring &properties, const std::wstring &globalProperties);
+
+		void Insert(Entry &&entry);
+
+		int64 window;
+		size_t count;
+		std::vector<bool> occupied;
+		std::vector<Entry> slots;
+	};
+}
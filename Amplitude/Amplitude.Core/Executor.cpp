@@ -0,0 +1,39 @@
+#include "pch.h"
+#include "Executor.h"
+
+using namespace Amplitude;
+
+ManualExecutor::ManualExecutor()
+{
+}
+
+bool
+ManualExecutor::Post(WorkItem item)
+{
+	std::lock_guard<std::mutex> lock(pendingMutex);
+	pending.push_back(std::move(item));
+	return true;
+}
+
+size_t
+ManualExecutor::RunPending()
+{
+	size_t count = 0;
+	for (;;)
+	{
+		WorkItem item;
+		{
+			std::lock_guard<std::mutex> lock(pendingMutex);
+			if (pending.empty())
+			{
+				return count;
+			}
+
+			item = std::move(pending.front());
+			pending.pop_front();
+		}
+
+		item();
+		++count;
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+
+#include "UniqueFunction.h"
+
+namespace Amplitude
+{
+	// Work items are move-only and usually don't need a heap allocation.
+	typedef UniqueFunction<void()> WorkItem;
+
+	// Somewhere to run work items.  Code that hands itself back to a thread
+	// to carry on, like UploadPipeline, does it through one of these, so that
+	// it can be driven by something other than a WorkerThread.
+	class IExecutor
+	{
+	public:
+		virtual ~IExecutor() {}
+
+		// Returns false if the item will never run.
+		virtual bool Post(WorkItem item) = 0;
+	};
+
+	// Holds on to whatever is posted until told to run it, on the calling
+	// thread.  Handy for stepping through asynchronous code by hand.
+	class ManualExecutor : public IExecutor
+	{
+	public:
+		ManualExecutor();
+
+		ManualExecutor(ManualExecutor const&) = delete;
+		ManualExecutor& operator=(ManualExecutor const&) = delete;
+
+		bool Post(WorkItem item) override;
+
+		// Runs items until there are none left, including any posted along
+		// the way.  Returns how many ran.
+		size_t RunPending();
+
+	private:
+		std::mutex pendingMutex;
+		std::deque<WorkItem> pending;
+	};
+}
@@ -0,0 +1,217 @@
+#include "pch.h"
+#include "IngestionFilter.h"
+
+#include <algorithm>
+#include <limits>
+
+using namespace Amplitude;
+
+const uint64_t IngestionFilter::kKeepAll = 1ULL << 32;
+const uint64_t IngestionFilter::kUnknownBucket = std::numeric_limits<uint64_t>::max();
+
+// 64-bit FNV-1a, folded to the upper 32 bits, which are the best-mixed.
+static uint64_t HashToBucket(const std::wstring &str)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	for (auto ch : str)
+	{
+		hash ^= static_cast<uint64_t>(ch);
+		hash *= 1099511628211ULL;
+	}
+	return hash >> 32;
+}
+
+IngestionFilter::Rule::Rule() :
+	tokensPerMilli(0.0),
+	capacity(0.0),
+	sampleThreshold(kKeepAll),
+	tokens(0.0),
+	lastRefill(0)
+{
+}
+
+IngestionFilter::IngestionFilter() :
+	hasRules(false),
+	deviceBucket(kUnknownBucket),
+	rateLimited(0),
+	sampledOut(0),
+	rules(std::make_shared<RuleSet>())
+{
+}
+
+IngestionFilter::Rule*
+IngestionFilter::Find(const RuleSet &rules, const wchar_t *eventType, size_t length)
+{
+	auto it = std::lower_bound(rules.begin(), rules.end(), length, [eventType](const Entry &entry, size_t length)
+	{
+		return entry.eventType.compare(0, std::wstring::npos, eventType, length) < 0;
+	});
+
+	if (it == rules.end() || it->eventType.compare(0, std::wstring::npos, eventType, length) != 0)
+	{
+		return nullptr;
+	}
+	return it->rule.get();
+}
+
+std::shared_ptr<IngestionFilter::Rule>
+IngestionFilter::CopyRule(const std::wstring &eventType) const
+{
+	auto rule = std::make_shared<Rule>();
+
+	auto existing = Find(*rules, eventType.data(), eventType.length());
+	if (existing != nullptr)
+	{
+		rule->tokensPerMilli = existing->tokensPerMilli;
+		rule->capacity = existing->capacity;
+		rule->sampleThreshold = existing->sampleThreshold;
+
+		std::lock_guard<std::mutex> lock(existing->bucketMutex);
+		rule->tokens = existing->tokens;
+		rule->lastRefill = existing->lastRefill;
+	}
+	return rule;
+}
+
+void
+IngestionFilter::Publish(const std::wstring &eventType, std::shared_ptr<Rule> rule)
+{
+	auto updated = std::make_shared<RuleSet>(*rules);
+
+	auto it = std::lower_bound(updated->begin(), updated->end(), eventType, [](const Entry &entry, const std::wstring &eventType)
+	{
+		return entry.eventType < eventType;
+	});
+
+	if (it != updated->end() && it->eventType == eventType)
+	{
+		it->rule = std::move(rule);
+	}
+	else
+	{
+		Entry entry;
+		entry.eventType = eventType;
+		entry.rule = std::move(rule);
+		updated->insert(it, std::move(entry));
+	}
+
+	std::atomic_store(&rules, std::shared_ptr<const RuleSet>(updated));
+	hasRules.store(true, std::memory_order_release);
+}
+
+void
+IngestionFilter::SetRateLimit(const std::wstring &eventType, double eventsPerSecond, int burst)
+{
+	std::lock_guard<std::mutex> lock(writeMutex);
+
+	auto rule = CopyRule(eventType);
+	if (eventsPerSecond > 0.0)
+	{
+		rule->tokensPerMilli = eventsPerSecond / 1000.0;
+		rule->capacity = std::max(1.0, static_cast<double>(burst));
+		rule->tokens = rule->capacity;
+	}
+	else
+	{
+		rule->tokensPerMilli = 0.0;
+	}
+
+	Publish(eventType, std::move(rule));
+}
+
+void
+IngestionFilter::SetSamplingRate(const std::wstring &eventType, double rate)
+{
+	rate = std::min(1.0, std::max(0.0, rate));
+
+	std::lock_guard<std::mutex> lock(writeMutex);
+
+	auto rule = CopyRule(eventType);
+	rule->sampleThreshold = static_cast<uint64_t>(rate * kKeepAll);
+
+	Publish(eventType, std::move(rule));
+}
+
+void
+IngestionFilter::SetDeviceId(const std::wstring &deviceId)
+{
+	deviceBucket.store(HashToBucket(deviceId), std::memory_order_relaxed);
+}
+
+Admission
+IngestionFilter::Admit(const wchar_t *eventType, size_t length, int64 nowMillis)
+{
+	if (!hasRules.load(std::memory_order_acquire))
+	{
+		return Admission::Admit;
+	}
+
+	// Held for the lookup; the rule itself is kept alive by the snapshot.
+	auto snapshot = std::atomic_load(&rules);
+	auto rule = Find(*snapshot, eventType, length);
+	if (rule == nullptr)
+	{
+		return Admission::Admit;
+	}
+
+	auto bucket = deviceBucket.load(std::memory_order_relaxed);
+	auto sampled = rule->sampleThreshold < kKeepAll;
+	if (sampled && bucket != kUnknownBucket && bucket >= rule->sampleThreshold)
+	{
+		++sampledOut;
+		return Admission::Drop;
+	}
+
+	if (rule->tokensPerMilli > 0.0)
+	{
+		std::lock_guard<std::mutex> lock(rule->bucketMutex);
+
+		auto elapsed = nowMillis - rule->lastRefill;
+		if (elapsed > 0)
+		{
+			rule->tokens = std::min(rule->capacity, rule->tokens + elapsed * rule->tokensPerMilli);
+			rule->lastRefill = nowMillis;
+		}
+
+		if (rule->tokens < 1.0)
+		{
+			++rateLimited;
+			return Admission::Drop;
+		}
+
+		rule->tokens -= 1.0;
+	}
+
+	return sampled && bucket == kUnknownBucket ? Admission::Defer : Admission::Admit;
+}
+
+bool
+IngestionFilter::AdmitDeferred(const wchar_t *eventType, size_t length)
+{
+	auto snapshot = std::atomic_load(&rules);
+	auto rule = Find(*snapshot, eventType, length);
+	if (rule == nullptr)
+	{
+		return true;
+	}
+
+	auto bucket = deviceBucket.load(std::memory_order_relaxed);
+	if (bucket != kUnknownBucket && bucket >= rule->sampleThreshold)
+	{
+		++sampledOut;
+		return false;
+	}
+	return true;
+}
+
+int64
+IngestionFilter::GetRateLimitedCount() const
+{
+	return rateLimited.load(std::memory_order_relaxed);
+}
+
+int64
+IngestionFilter::GetSampledOutCount() const
+{
+	return sampledOut.load(std::memory_order_relaxed);
+}
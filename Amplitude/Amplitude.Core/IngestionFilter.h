@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Amplitude
+{
+	enum class Admission
+	{
+		Admit,
+		Drop,
+
+		// The event type is sampled, and the device ID isn't known yet;
+		// hold the event, and ask AdmitDeferred() once it is.
+		Defer
+	};
+
+	// Decides, on the logging caller's thread, whether an event is admitted
+	// at all.  Events can be throttled per event type with a token bucket,
+	// and sampled per event type by device: a device either always or never
+	// reports a sampled event type, depending on a hash of its device ID.
+	//
+	// The rules are published as immutable snapshots, like the global
+	// properties, so Admit() neither allocates nor takes a lock shared by
+	// every event type; only an event type with a rate limit takes its own
+	// bucket's lock.  When no rules have been configured, Admit() doesn't
+	// even look at the snapshot.
+	class IngestionFilter
+	{
+	public:
+		IngestionFilter();
+
+		IngestionFilter(IngestionFilter const&) = delete;
+		IngestionFilter& operator=(IngestionFilter const&) = delete;
+
+		// Allows at most eventsPerSecond events of the given type on
+		// average, in bursts of up to burst events.  A non-positive rate
+		// removes the limit.
+		void SetRateLimit(const std::wstring &eventType, double eventsPerSecond, int burst);
+
+		// Keeps the given fraction of devices reporting this event type;
+		// 1.0 (or more) keeps all of them, 0.0 none.
+		void SetSamplingRate(const std::wstring &eventType, double rate);
+
+		// Sampling is keyed on the device ID; until it is known, events of
+		// sampled types are deferred.
+		void SetDeviceId(const std::wstring &deviceId);
+
+		// Admit or Drop, counting the event as dropped if so; or Defer, if
+		// the event type is sampled and the device ID isn't known yet.
+		// 'nowMillis' must come from a monotonic clock.
+		Admission Admit(const wchar_t *eventType, size_t length, int64 nowMillis);
+
+		// For an event that Admit() deferred, once SetDeviceId() has been
+		// called: whether this device's sample keeps it.  Its rate limit
+		// was applied when it was deferred.
+		bool AdmitDeferred(const wchar_t *eventType, size_t length);
+
+		int64 GetRateLimitedCount() const;
+		int64 GetSampledOutCount() const;
+
+	private:
+		struct Rule
+		{
+			Rule();
+
+			// Token bucket; a rate of zero means unlimited.
+			double tokensPerMilli;
+			double capacity;
+
+			// Sampling threshold, in [0, 2^32]; 2^32 keeps everyone.
+			uint64_t sampleThreshold;
+
+			// The bucket's contents, which change under any snapshot.
+			std::mutex bucketMutex;
+			double tokens;
+			int64 lastRefill;
+		};
+
+		struct Entry
+		{
+			std::wstring eventType;
+			std::shared_ptr<Rule> rule;
+		};
+
+		// Sorted by event type.  Never modified once published.
+		typedef std::vector<Entry> RuleSet;
+
+		static Rule* Find(const RuleSet &rules, const wchar_t *eventType, size_t length);
+
+		// A copy of the event type's rule, or a new one, for a writer to
+		// change and publish.
+		std::shared_ptr<Rule> CopyRule(const std::wstring &eventType) const;
+		void Publish(const std::wstring &eventType, std::shared_ptr<Rule> rule);
+
+		static const uint64_t kKeepAll;
+		static const uint64_t kUnknownBucket;
+
+		std::atomic<bool> hasRules;
+		std::atomic<uint64_t> deviceBucket;
+
+		std::atomic<int64> rateLimited;
+		std::atomic<int64> sampledOut;
+
+		std::shared_ptr<const RuleSet> rules;
+
+		// Serializes writers; readers never take it.
+		std::mutex writeMutex;
+	};
+}
@@ -0,0 +1,423 @@
+#include "pch.h"
+#include "Logger.h"
+
+#include "ThreadExit.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include "Utf8.h"
+#endif
+
+using namespace Amplitude;
+
+#ifdef _MSC_VER
+#define AMPLITUDE_THREAD_LOCAL __declspec(thread)
+#else
+#define AMPLITUDE_THREAD_LOCAL __thread
+#endif
+
+// Records kept per thread; at 256 bytes each, 32KB a thread.
+static const uint64_t kBufferSize = 128;
+
+// Once woken, the logger's thread waits this long for more records to
+// batch up, unless a buffer fills past kUrgentRecords first.
+static const std::chrono::milliseconds kDrainInterval(100);
+static const uint64_t kUrgentRecords = kBufferSize / 2;
+
+namespace
+{
+	struct LogRecord
+	{
+		LogLevel level;
+		char message[Logger::kMaxMessageSize + 1];
+	};
+
+	// One thread's records, waiting to be drained.  Only that thread
+	// writes, and only the drain reads, so a pair of counters is all the
+	// synchronization there is: the writer publishes a record by bumping
+	// 'head', and the drain frees its slot by bumping 'tail'.
+	//
+	// Both sides store their own counter, then read the other's, and
+	// whether the drain gets woken depends on what they see; so those are
+	// sequentially consistent, and a record can't slip in between the
+	// drain's last look and its going to sleep without one side noticing.
+	class LogBuffer
+	{
+	public:
+		LogBuffer() :
+			head(0),
+			tail(0),
+			dropped(0),
+			retired(false)
+		{
+		}
+
+		// The next free slot, or null if the drain hasn't caught up.
+		LogRecord* Reserve()
+		{
+			auto index = head.load(std::memory_order_relaxed);
+			if (index - tail.load(std::memory_order_acquire) == kBufferSize)
+			{
+				dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+				return nullptr;
+			}
+			return &records[index % kBufferSize];
+		}
+
+		// Returns how many records are waiting, counting this one.
+		uint64_t Commit()
+		{
+			auto index = head.load(std::memory_order_relaxed) + 1;
+			head.store(index);
+			return index - tail.load();
+		}
+
+		// Returns whether more was written while it drained.
+		bool DrainTo(Logger::Sink sink)
+		{
+			auto index = tail.load(std::memory_order_relaxed);
+			auto end = head.load(std::memory_order_acquire);
+
+			for (; index != end; ++index)
+			{
+				const auto &record = records[index % kBufferSize];
+				sink(record.level, record.message);
+				tail.store(index + 1);
+			}
+			return head.load() != end;
+		}
+
+		int64 GetDroppedCount() const
+		{
+			return dropped.load(std::memory_order_relaxed);
+		}
+
+		// Called by the writer as its thread exits; it writes nothing more.
+		void Retire()
+		{
+			retired.store(true, std::memory_order_release);
+		}
+
+		bool IsRetired() const
+		{
+			return retired.load(std::memory_order_acquire);
+		}
+
+	private:
+		LogRecord records[kBufferSize];
+		std::atomic<uint64_t> head;
+		std::atomic<uint64_t> tail;
+		std::atomic<int64> dropped;
+		std::atomic<bool> retired;
+	};
+
+	// Everything the drain needs.  It's never freed: the drain thread runs
+	// until the process ends, and mustn't find any of this destroyed under
+	// it on the way out.
+	struct LogState
+	{
+		// A thread's buffer is freed by the drain, once the thread has
+		// exited and the drain has handed on the last of its records.
+		std::mutex buffersMutex;
+		std::vector<LogBuffer*> buffers;
+		int64 retiredDropped;
+		bool started;
+
+		// Held while draining, so that Flush and the drain thread take
+		// turns and records reach the sink in order.
+		std::mutex drainMutex;
+
+		// The drain thread sleeps until 'signalled', i.e. a record has
+		// gone into an empty buffer or a thread has exited; then for up to
+		// kDrainInterval more, unless 'urgent', i.e. a buffer is filling.
+		std::mutex wakeMutex;
+		std::condition_variable wake;
+		bool signalled;
+		bool urgent;
+
+		std::atomic<Logger::Sink> sink;
+	};
+}
+
+static void DefaultSink(LogLevel level, const char *message)
+{
+	static const char *kLevelNames[] = { "DEBUG", "INFO", "WARNING", "ERROR" };
+	auto name = kLevelNames[static_cast<int>(level)];
+
+#ifdef _WIN32
+	auto line = FromUtf8(name, strlen(name)) + L": " + FromUtf8(message, strlen(message)) + L"\n";
+	OutputDebugStringW(line.c_str());
+#else
+	fprintf(stderr, "%s: %s\n", name, message);
+#endif
+}
+
+static LogState* CreateState()
+{
+	auto state = new LogState();
+	state->retiredDropped = 0;
+	state->started = false;
+	state->signalled = false;
+	state->urgent = false;
+	state->sink.store(DefaultSink);
+	return state;
+}
+
+static LogState *gState = CreateState();
+
+static AMPLITUDE_THREAD_LOCAL LogBuffer *tBuffer;
+
+static void WakeDrain(bool urgent)
+{
+	{
+		std::lock_guard<std::mutex> lock(gState->wakeMutex);
+		gState->signalled = true;
+		gState->urgent = gState->urgent || urgent;
+	}
+	gState->wake.notify_one();
+}
+
+static void FreeBuffer(LogBuffer *buffer)
+{
+	{
+		std::lock_guard<std::mutex> lock(gState->buffersMutex);
+		auto &buffers = gState->buffers;
+		buffers.erase(std::remove(buffers.begin(), buffers.end(), buffer), buffers.end());
+		gState->retiredDropped += buffer->GetDroppedCount();
+	}
+	delete buffer;
+}
+
+// Returns whether there's more to drain already.
+static bool Drain()
+{
+	std::lock_guard<std::mutex> lock(gState->drainMutex);
+
+	std::vector<LogBuffer*> buffers;
+	{
+		std::lock_guard<std::mutex> lock(gState->buffersMutex);
+		buffers = gState->buffers;
+	}
+
+	auto sink = gState->sink.load();
+	auto more = false;
+	for (auto buffer : buffers)
+	{
+		// Looked at before draining, so that if its thread has exited,
+		// this pass gets the last of its records.
+		auto retired = buffer->IsRetired();
+		if (buffer->DrainTo(sink))
+		{
+			more = true;
+		}
+		else if (retired)
+		{
+			FreeBuffer(buffer);
+		}
+	}
+	return more;
+}
+
+static void RunDrainThread()
+{
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(gState->wakeMutex);
+			gState->wake.wait(lock, []
+			{
+				return gState->signalled;
+			});
+			gState->wake.wait_for(lock, kDrainInterval, []
+			{
+				return gState->urgent;
+			});
+			gState->signalled = false;
+			gState->urgent = false;
+		}
+
+		if (Drain())
+		{
+			// Written to while draining, without waking anyone.
+			std::lock_guard<std::mutex> lock(gState->wakeMutex);
+			gState->signalled = true;
+		}
+	}
+}
+
+static void RetireBuffer(void *value)
+{
+	auto buffer = static_cast<LogBuffer*>(value);
+	if (tBuffer == buffer)
+	{
+		tBuffer = nullptr;
+	}
+	buffer->Retire();
+	WakeDrain(false);
+}
+
+// Wakes the drain for a record that has just gone in, if it's the first in
+// the buffer, or if the buffer is filling up.
+static void OnCommit(uint64_t waiting)
+{
+	if (waiting == 1 || waiting == kUrgentRecords)
+	{
+		WakeDrain(waiting == kUrgentRecords);
+	}
+}
+
+static LogBuffer* GetThreadBuffer()
+{
+	if (tBuffer == nullptr)
+	{
+		std::lock_guard<std::mutex> lock(gState->buffersMutex);
+		tBuffer = new LogBuffer();
+		gState->buffers.push_back(tBuffer);
+		AtThreadExit(RetireBuffer, tBuffer);
+
+		if (!gState->started)
+		{
+			gState->started = true;
+			std::thread(RunDrainThread).detach();
+		}
+	}
+	return tBuffer;
+}
+
+// Appends 'codePoint' as UTF-8 if it fits in the 'capacity' bytes left;
+// returns the number of bytes written, zero if it doesn't fit.
+static size_t EncodeUtf8(uint32_t codePoint, char *out, size_t capacity)
+{
+	if (codePoint < 0x80)
+	{
+		if (capacity < 1) return 0;
+		out[0] = static_cast<char>(codePoint);
+		return 1;
+	}
+	if (codePoint < 0x800)
+	{
+		if (capacity < 2) return 0;
+		out[0] = static_cast<char>(0xC0 | (codePoint >> 6));
+		out[1] = static_cast<char>(0x80 | (codePoint & 0x3F));
+		return 2;
+	}
+	if (codePoint < 0x10000)
+	{
+		if (capacity < 3) return 0;
+		out[0] = static_cast<char>(0xE0 | (codePoint >> 12));
+		out[1] = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+		out[2] = static_cast<char>(0x80 | (codePoint & 0x3F));
+		return 3;
+	}
+	if (capacity < 4) return 0;
+	out[0] = static_cast<char>(0xF0 | (codePoint >> 18));
+	out[1] = static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+	out[2] = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+	out[3] = static_cast<char>(0x80 | (codePoint & 0x3F));
+	return 4;
+}
+
+void
+Logger::SetSink(Sink sink)
+{
+	gState->sink.store(sink != nullptr ? sink : DefaultSink);
+}
+
+void
+Logger::Write(LogLevel level, const char *message)
+{
+	auto record = GetThreadBuffer()->Reserve();
+	if (record == nullptr)
+	{
+		return;
+	}
+
+	size_t length = 0;
+	while (length < kMaxMessageSize && message[length] != '\0')
+	{
+		++length;
+	}
+
+	if (message[length] != '\0')
+	{
+		// Cut short; don't leave half a character at the end.
+		while (length > 0 && (static_cast<unsigned char>(message[length]) & 0xC0) == 0x80)
+		{
+			--length;
+		}
+	}
+
+	record->level = level;
+	memcpy(record->message, message, length);
+	record->message[length] = '\0';
+	OnCommit(tBuffer->Commit());
+}
+
+void
+Logger::Write(LogLevel level, const wchar_t *message)
+{
+	auto record = GetThreadBuffer()->Reserve();
+	if (record == nullptr)
+	{
+		return;
+	}
+
+	size_t length = 0;
+	for (auto c = message; *c != L'\0'; ++c)
+	{
+		auto codePoint = static_cast<uint32_t>(*c);
+		if (sizeof(wchar_t) == 2 && codePoint >= 0xD800 && codePoint < 0xDC00)
+		{
+			auto low = static_cast<uint32_t>(c[1]);
+			if (low >= 0xDC00 && low < 0xE000)
+			{
+				codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+				++c;
+			}
+		}
+		if ((codePoint >= 0xD800 && codePoint < 0xE000) || codePoint > 0x10FFFF)
+		{
+			codePoint = 0xFFFD;
+		}
+
+		auto written = EncodeUtf8(codePoint, record->message + length, kMaxMessageSize - length);
+		if (written == 0)
+		{
+			break;
+		}
+		length += written;
+	}
+
+	record->level = level;
+	record->message[length] = '\0';
+	OnCommit(tBuffer->Commit());
+}
+
+void
+Logger::Flush()
+{
+	Drain();
+}
+
+int64
+Logger::GetDroppedCount()
+{
+	std::lock_guard<std::mutex> lock(gState->buffersMutex);
+
+	auto dropped = gState->retiredDropped;
+	for (auto buffer : gState->buffers)
+	{
+		dropped += buffer->GetDroppedCount();
+	}
+	return dropped;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+namespace Amplitude
+{
+	enum class LogLevel
+	{
+		Debug,
+		Info,
+		Warning,
+		Error
+	};
+
+	// Diagnostics, written asynchronously.  Writing a record copies it into
+	// the calling thread's own ring buffer; a background thread drains the
+	// buffers into the sink, in batches.  Only the record that goes into an
+	// empty buffer, or fills one halfway, takes a lock, to wake that thread,
+	// which otherwise sleeps.  A thread that writes faster than the drain
+	// keeps up loses records rather than waiting, and the loss is counted.
+	// A thread's buffer is freed once the thread has exited and its last
+	// records have been drained.
+	//
+	// Log through the AMPLITUDE_LOG_* macros below, not Write: below the
+	// level set by AMPLITUDE_LOG_LEVEL, they compile to nothing, arguments
+	// and all, so a message that has to be formatted costs nothing unless
+	// it's going to be written.
+	class Logger
+	{
+	public:
+		// Receives records on the logger's thread, one at a time, in order
+		// for each thread that wrote them.  'message' is UTF-8.
+		typedef void (*Sink)(LogLevel level, const char *message);
+
+		// Records longer than this, in UTF-8 bytes, are cut short.
+		static const int kMaxMessageSize = 240;
+
+		// The default sink is OutputDebugString on Windows, and stderr
+		// elsewhere.
+		static void SetSink(Sink sink);
+
+		static void Write(LogLevel level, const char *message);
+		static void Write(LogLevel level, const wchar_t *message);
+
+		// Hands everything written so far to the sink, on the calling
+		// thread, e.g. before the process goes away.
+		static void Flush();
+
+		// Records lost because a thread's buffer was full.
+		static int64 GetDroppedCount();
+
+	private:
+		Logger();
+	};
+}
+
+#define AMPLITUDE_LOG_LEVEL_DEBUG 0
+#define AMPLITUDE_LOG_LEVEL_INFO 1
+#define AMPLITUDE_LOG_LEVEL_WARNING 2
+#define AMPLITUDE_LOG_LEVEL_ERROR 3
+#define AMPLITUDE_LOG_LEVEL_NONE 4
+
+// Everything in debug builds; warnings and errors otherwise.
+#ifndef AMPLITUDE_LOG_LEVEL
+#if defined(_DEBUG) || defined(DEBUG)
+#define AMPLITUDE_LOG_LEVEL AMPLITUDE_LOG_LEVEL_DEBUG
+#else
+#define AMPLITUDE_LOG_LEVEL AMPLITUDE_LOG_LEVEL_WARNING
+#endif
+#endif
+
+#if AMPLITUDE_LOG_LEVEL <= AMPLITUDE_LOG_LEVEL_DEBUG
+#define AMPLITUDE_LOG_DEBUG(message) ::Amplitude::Logger::Write(::Amplitude::LogLevel::Debug, (message))
+#else
+#define AMPLITUDE_LOG_DEBUG(message) ((void) 0)
+#endif
+
+#if AMPLITUDE_LOG_LEVEL <= AMPLITUDE_LOG_LEVEL_INFO
+#define AMPLITUDE_LOG_INFO(message) ::Amplitude::Logger::Write(::Amplitude::LogLevel::Info, (message))
+#else
+#define AMPLITUDE_LOG_INFO(message) ((void) 0)
+#endif
+
+#if AMPLITUDE_LOG_LEVEL <= AMPLITUDE_LOG_LEVEL_WARNING
+#define AMPLITUDE_LOG_WARNING(message) ::Amplitude::Logger::Write(::Amplitude::LogLevel::Warning, (message))
+#else
+#define AMPLITUDE_LOG_WARNING(message) ((void) 0)
+#endif
+
+#if AMPLITUDE_LOG_LEVEL <= AMPLITUDE_LOG_LEVEL_ERROR
+#define AMPLITUDE_LOG_ERROR(message) ::Amplitude::Logger::Write(::Amplitude::LogLevel::Error, (message))
+#else
+#define AMPLITUDE_LOG_ERROR(message) ((void) 0)
+#endif
@@ -0,0 +1,177 @@
+#include "pch.h"
+#include "Md5.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace Amplitude;
+
+// Per-round shift amounts and sine-derived constants, from the RFC.
+static const uint32_t kShifts[64] =
+{
+	7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+	5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+	4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+	6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+};
+
+static const uint32_t kConstants[64] =
+{
+	0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+	0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+	0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+	0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+	0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+	0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+	0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+	0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+
+static uint32_t RotateLeft(uint32_t value, uint32_t bits)
+{
+	return (value << bits) | (value >> (32 - bits));
+}
+
+Md5::Md5() :
+	length(0)
+{
+	state[0] = 0x67452301;
+	state[1] = 0xefcdab89;
+	state[2] = 0x98badcfe;
+	state[3] = 0x10325476;
+}
+
+void
+Md5::Transform(const uint8_t block[64])
+{
+	// MD5 is little-endian, whatever we're running on.
+	uint32_t words[16];
+	for (int i = 0; i < 16; ++i)
+	{
+		words[i] = static_cast<uint32_t>(block[i * 4])
+			| static_cast<uint32_t>(block[i * 4 + 1]) << 8
+			| static_cast<uint32_t>(block[i * 4 + 2]) << 16
+			| static_cast<uint32_t>(block[i * 4 + 3]) << 24;
+	}
+
+	auto a = state[0];
+	auto b = state[1];
+	auto c = state[2];
+	auto d = state[3];
+
+	for (int i = 0; i < 64; ++i)
+	{
+		uint32_t f;
+		int g;
+		if (i < 16)
+		{
+			f = (b & c) | (~b & d);
+			g = i;
+		}
+		else if (i < 32)
+		{
+			f = (d & b) | (~d & c);
+			g = (5 * i + 1) % 16;
+		}
+		else if (i < 48)
+		{
+			f = b ^ c ^ d;
+			g = (3 * i + 5) % 16;
+		}
+		else
+		{
+			f = c ^ (b | ~d);
+			g = (7 * i) % 16;
+		}
+
+		auto next = d;
+		d = c;
+		c = b;
+		b = b + RotateLeft(a + f + kConstants[i] + words[g], kShifts[i]);
+		a = next;
+	}
+
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+}
+
+void
+Md5::Update(const void *data, size_t size)
+{
+	auto bytes = static_cast<const uint8_t*>(data);
+	auto buffered = static_cast<size_t>(length % 64);
+	length += size;
+
+	// Top up a partial block first, then hash whole blocks straight from
+	// the input.
+	if (buffered > 0)
+	{
+		auto fill = std::min(size, 64 - buffered);
+		memcpy(buffer + buffered, bytes, fill);
+		bytes += fill;
+		size -= fill;
+		buffered += fill;
+
+		if (buffered < 64)
+		{
+			return;
+		}
+		Transform(buffer);
+	}
+
+	for (; size >= 64; bytes += 64, size -= 64)
+	{
+		Transform(bytes);
+	}
+
+	memcpy(buffer, bytes, size);
+}
+
+void
+Md5::Update(const std::string &data)
+{
+	Update(data.data(), data.size());
+}
+
+void
+Md5::Finish(uint8_t digest[kDigestSize])
+{
+	auto bits = length * 8;
+
+	// A one bit, zeros up to 56 bytes into the last block, then the length
+	// in bits.
+	static const uint8_t kPadding[64] = { 0x80 };
+	auto buffered = static_cast<size_t>(length % 64);
+	Update(kPadding, buffered < 56 ? 56 - buffered : 120 - buffered);
+
+	uint8_t encodedLength[8];
+	for (int i = 0; i < 8; ++i)
+	{
+		encodedLength[i] = static_cast<uint8_t>(bits >> (8 * i));
+	}
+	Update(encodedLength, sizeof(encodedLength));
+
+	for (int i = 0; i < 16; ++i)
+	{
+		digest[i] = static_cast<uint8_t>(state[i / 4] >> (8 * (i % 4)));
+	}
+}
+
+std::wstring
+Md5::FinishHex()
+{
+	static const wchar_t kHex[] = L"0123456789abcdef";
+
+	uint8_t digest[kDigestSize];
+	Finish(digest);
+
+	std::wstring hex(kDigestSize * 2, L'0');
+	for (size_t i = 0; i < kDigestSize; ++i)
+	{
+		hex[i * 2] = kHex[digest[i] >> 4];
+		hex[i * 2 + 1] = kHex[digest[i] & 0xf];
+	}
+	return hex;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Amplitude
+{
+	// MD5 (RFC 1321), for upload checksums; not for anything that needs to
+	// be secure.  Feed it with Update, as many times as needed, then take
+	// the digest with Finish, once.
+	class Md5
+	{
+	public:
+		static const size_t kDigestSize = 16;
+
+		Md5();
+
+		void Update(const void *data, size_t size);
+		void Update(const std::string &data);
+
+		void Finish(uint8_t digest[kDigestSize]);
+
+		// The digest as lowercase hex.
+		std::wstring FinishHex();
+
+	private:
+		void Transform(const uint8_t block[64]);
+
+		uint32_t state[4];
+		uint64_t length;
+		uint8_t buffer[64];
+	};
+}
@@ -0,0 +1,518 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Amplitude
+{
+	// A lock-free, bounded, multi-producer single-consumer queue, with the
+	// same interface (and lanes) as SynchronizedQueue.
+	//
+	// Each lane is a ring of cells stamped with sequence numbers (after
+	// Vyukov's bounded queue): producers claim a slot with a single CAS on
+	// the tail, and the consumer claims one with a CAS on the head, which is
+	// uncontended unless a producer is evicting the oldest item to make
+	// room.  Head and tail live on separate cache lines so producers and the
+	// consumer don't false-share.
+	//
+	// Producers never block.  An idle consumer spins briefly, then parks on a
+	// condition variable; producers only touch the mutex if it is parked.
+	//
+	// An unbounded lane (size zero) is a ring that spills into a locked deque
+	// when full; once it has spilled, new items follow them into the deque
+	// until the consumer catches up, so that order is kept.
+	template <typename T>
+	class MpscQueue
+	{
+	public:
+		MpscQueue(unsigned int size = 1024);
+		MpscQueue(const std::vector<unsigned int> &laneSizes, unsigned int starvationLimit);
+		~MpscQueue();
+
+		MpscQueue(MpscQueue const&) = delete;
+		MpscQueue& operator=(MpscQueue const&) = delete;
+
+		bool TryEnqueue(const T &item, unsigned int lane = 0);
+		bool TryEnqueue(T&& item, unsigned int lane = 0);
+
+		// Blocks until an item is available, or the queue is completed
+		// and empty.  Must only be called from the one consumer thread.
+		bool TryDequeue(T &item);
+
+		// As SynchronizedQueue::DrainTo; must only be called from the one
+		// consumer thread.
+		template <typename Container>
+		size_t DrainTo(Container &container, size_t max);
+
+		// As DrainTo, but gives up waiting at 'deadline', returning zero.
+		template <typename Container>
+		size_t DrainUntil(Container &container, size_t max, std::chrono::steady_clock::time_point deadline);
+
+		// Takes the oldest item out of the given lane, without waiting, to
+		// make room for a newer one.  Safe to call from producers.
+		bool TryEvictOldest(unsigned int lane, T &item);
+
+		void Complete();
+
+	private:
+		static const size_t kCacheLine = 64;
+
+		// How often the consumer polls before parking.
+		static const int kSpinCount = 64;
+
+		// Ring size for unbounded lanes, before they spill.
+		static const unsigned int kUnboundedRingSize = 1024;
+
+		struct Cell
+		{
+			std::atomic<size_t> sequence;
+			T value;
+		};
+
+		class Lane
+		{
+		public:
+			Lane(unsigned int size);
+
+			bool TryPush(T &item);
+			bool TryPop(T &item);
+			bool TryEvict(T &item);
+
+			bool IsEmpty() const;
+
+			unsigned int skipped;
+
+		private:
+			bool TryPushRing(T &item);
+			bool TryPopRing(T &item);
+
+			const bool unbounded;
+			const size_t mask;
+			std::unique_ptr<Cell[]> cells;
+
+			char pad0[kCacheLine];
+			std::atomic<size_t> tail;
+			char pad1[kCacheLine - sizeof(std::atomic<size_t>)];
+
+			std::atomic<size_t> head;
+			char pad2[kCacheLine - sizeof(std::atomic<size_t>)];
+
+			std::atomic<size_t> spilled;
+			std::mutex spillMutex;
+			std::deque<T> spill;
+		};
+
+		static size_t RoundUpToPowerOfTwo(size_t n);
+
+		bool Push(T &item, unsigned int lane);
+		bool TryPopAny(T &item);
+		bool IsEmpty() const;
+
+		// Spins, then parks, until an item is available or the queue is
+		// completed (or the deadline passes, if there is one).  Returns false
+		// if there is nothing to take.
+		bool WaitForItems(bool hasDeadline = false, std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point());
+
+		template <typename Container>
+		size_t TakeItems(Container &container, size_t max);
+		void WakeConsumer();
+
+		const unsigned int starvationLimit;
+		std::vector<std::unique_ptr<Lane>> lanes;
+
+		std::atomic<bool> complete;
+		std::atomic<bool> parked;
+		std::mutex parkMutex;
+		std::condition_variable wakeup;
+	};
+
+	template <typename T>
+	size_t MpscQueue<T>::RoundUpToPowerOfTwo(size_t n)
+	{
+		size_t result = 2;
+		while (result < n)
+		{
+			result <<= 1;
+		}
+		return result;
+	}
+
+	template <typename T>
+	MpscQueue<T>::Lane::Lane(unsigned int size) :
+		skipped(0),
+		unbounded(size == 0),
+		mask(RoundUpToPowerOfTwo(size == 0 ? kUnboundedRingSize : size) - 1),
+		cells(new Cell[mask + 1]),
+		tail(0),
+		head(0),
+		spilled(0)
+	{
+		for (size_t i = 0; i <= mask; ++i)
+		{
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	template <typename T>
+	bool MpscQueue<T>::Lane::TryPushRing(T &item)
+	{
+		auto pos = tail.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			auto &cell = cells[pos & mask];
+			auto seq = cell.sequence.load(std::memory_order_acquire);
+			auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+
+			if (diff == 0)
+			{
+				if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					cell.value = std::move(item);
+					cell.sequence.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (diff < 0)
+			{
+				// The consumer hasn't freed this cell yet; we're full.
+				return false;
+			}
+			else
+			{
+				pos = tail.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	template <typename T>
+	bool MpscQueue<T>::Lane::TryPopRing(T &item)
+	{
+		auto pos = head.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			auto &cell = cells[pos & mask];
+			auto seq = cell.sequence.load(std::memory_order_acquire);
+			auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+
+			if (diff == 0)
+			{
+				if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					item = std::move(cell.value);
+					cell.value = T();
+					cell.sequence.store(pos + mask + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (diff < 0)
+			{
+				// Nothing has been written here yet; we're empty.
+				return false;
+			}
+			else
+			{
+				pos = head.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	template <typename T>
+	bool MpscQueue<T>::Lane::TryPush(T &item)
+	{
+		if (unbounded && spilled.load(std::memory_order_acquire) > 0)
+		{
+			std::lock_guard<std::mutex> lock(spillMutex);
+			if (!spill.empty())
+			{
+				spill.push_back(std::move(item));
+				spilled.fetch_add(1, std::memory_order_release);
+				return true;
+			}
+		}
+
+		if (TryPushRing(item))
+		{
+			return true;
+		}
+
+		if (!unbounded)
+		{
+			return false;
+		}
+
+		std::lock_guard<std::mutex> lock(spillMutex);
+		spill.push_back(std::move(item));
+		spilled.fetch_add(1, std::memory_order_release);
+		return true;
+	}
+
+	template <typename T>
+	bool MpscQueue<T>::Lane::TryPop(T &item)
+	{
+		// Anything in the ring went in before the spill started.
+		if (TryPopRing(item))
+		{
+			return true;
+		}
+
+		if (unbounded && spilled.load(std::memory_order_acquire) > 0)
+		{
+			std::lock_guard<std::mutex> lock(spillMutex);
+			if (!spill.empty())
+			{
+				item = std::move(spill.front());
+				spill.pop_front();
+				spilled.fetch_sub(1, std::memory_order_release);
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	template <typename T>
+	bool MpscQueue<T>::Lane::TryEvict(T &item)
+	{
+		// Only a full ring needs room made in it, and anything in the ring
+		// is older than what has spilled.
+		return TryPopRing(item);
+	}
+
+	template <typename T>
+	bool MpscQueue<T>::Lane::IsEmpty() const
+	{
+		auto pos = head.load(std::memory_order_relaxed);
+		auto seq = cells[pos & mask].sequence.load(std::memory_order_acquire);
+		return seq != pos + 1 && spilled.load(std::memory_order_acquire) == 0;
+	}
+
+	template <typename T>
+	MpscQueue<T>::MpscQueue(unsigned int size) :
+		starvationLimit(0),
+		complete(false),
+		parked(false)
+	{
+		lanes.emplace_back(new Lane(size));
+	}
+
+	template <typename T>
+	MpscQueue<T>::MpscQueue(const std::vector<unsigned int> &laneSizes, unsigned int starvationLimit) :
+		starvationLimit(starvationLimit),
+		complete(false),
+		parked(false)
+	{
+		for (auto size : laneSizes)
+		{
+			lanes.emplace_back(new Lane(size));
+		}
+	}
+
+	template <typename T>
+	MpscQueue<T>::~MpscQueue()
+	{
+		Complete();
+	}
+
+	template <typename T>
+	bool MpscQueue<T>::TryEnqueue(const T &item, unsigned int lane)
+	{
+		T copy(item);
+		return Push(copy, lane);
+	}
+
+	template <typename T>
+	bool MpscQueue<T>::TryEnqueue(T&& item, unsigned int lane)
+	{
+		return Push(item, lane);
+	}
+
+	template <typename T>
+	bool MpscQueue<T>::Push(T &item, unsigned int lane)
+	{
+		if (complete.load(std::memory_order_acquire) || lane >= lanes.size())
+		{
+			return false;
+		}
+
+		if (!lanes[lane]->TryPush(item))
+		{
+			return false;
+		}
+
+		// Pairs with the fence in TryDequeue: either we see that the
+		// consumer is parked, or it sees our item before parking.
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (parked.load(std::memory_order_relaxed))
+		{
+			WakeConsumer();
+		}
+
+		return true;
+	}
+
+	template <typename T>
+	void MpscQueue<T>::WakeConsumer()
+	{
+		std::lock_guard<std::mutex> lock(parkMutex);
+		wakeup.notify_one();
+	}
+
+	template <typename T>
+	bool MpscQueue<T>::IsEmpty() const
+	{
+		for (const auto &lane : lanes)
+		{
+			if (!lane->IsEmpty())
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	template <typename T>
+	bool MpscQueue<T>::TryPopAny(T &item)
+	{
+		// Same policy as SynchronizedQueue::NextLane: most urgent first,
+		// unless a less urgent lane has waited too long.
+		Lane *chosen = nullptr;
+		for (auto &lane : lanes)
+		{
+			if (lane->IsEmpty())
+			{
+				lane->skipped = 0;
+			}
+			else if (chosen == nullptr)
+			{
+				chosen = lane.get();
+			}
+			else if (starvationLimit > 0 && lane->skipped >= starvationLimit && chosen->skipped < starvationLimit)
+			{
+				chosen = lane.get();
+			}
+		}
+
+		if (chosen == nullptr || !chosen->TryPop(item))
+		{
+			return false;
+		}
+
+		for (auto &lane : lanes)
+		{
+			if (lane.get() != chosen && !lane->IsEmpty())
+			{
+				lane->skipped++;
+			}
+		}
+
+		chosen->skipped = 0;
+		return true;
+	}
+
+	template <typename T>
+	bool MpscQueue<T>::WaitForItems(bool hasDeadline, std::chrono::steady_clock::time_point deadline)
+	{
+		for (;;)
+		{
+			for (int spin = 0; spin < kSpinCount; ++spin)
+			{
+				if (!IsEmpty())
+				{
+					return true;
+				}
+
+				if (complete.load(std::memory_order_acquire))
+				{
+					return !IsEmpty();
+				}
+
+				std::this_thread::yield();
+			}
+
+			std::unique_lock<std::mutex> lock(parkMutex);
+			parked.store(true, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+
+			auto ready = [this]
+			{
+				return !IsEmpty() || complete.load(std::memory_order_acquire);
+			};
+
+			if (hasDeadline)
+			{
+				if (!wakeup.wait_until(lock, deadline, ready))
+				{
+					parked.store(false, std::memory_order_relaxed);
+					return false;
+				}
+			}
+			else
+			{
+				wakeup.wait(lock, ready);
+			}
+
+			parked.store(false, std::memory_order_relaxed);
+		}
+	}
+
+	template <typename T>
+	bool MpscQueue<T>::TryDequeue(T &item)
+	{
+		while (WaitForItems())
+		{
+			if (TryPopAny(item))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	template <typename T>
+	template <typename Container>
+	size_t MpscQueue<T>::DrainTo(Container &container, size_t max)
+	{
+		return WaitForItems() ? TakeItems(container, max) : 0;
+	}
+
+	template <typename T>
+	template <typename Container>
+	size_t MpscQueue<T>::DrainUntil(Container &container, size_t max, std::chrono::steady_clock::time_point deadline)
+	{
+		return WaitForItems(true, deadline) ? TakeItems(container, max) : 0;
+	}
+
+	template <typename T>
+	template <typename Container>
+	size_t MpscQueue<T>::TakeItems(Container &container, size_t max)
+	{
+		size_t count = 0;
+		T item;
+		while (count < max && TryPopAny(item))
+		{
+			container.push_back(std::move(item));
+			++count;
+		}
+
+		return count;
+	}
+
+	template <typename T>
+	bool MpscQueue<T>::TryEvictOldest(unsigned int lane, T &item)
+	{
+		return lane < lanes.size() && lanes[lane]->TryEvict(item);
+	}
+
+	template <typename T>
+	void MpscQueue<T>::Complete()
+	{
+		complete.store(true, std::memory_order_release);
+		WakeConsumer();
+	}
+}
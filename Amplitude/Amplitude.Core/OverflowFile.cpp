@@ -0,0 +1,142 @@
+#include "pch.h"
+#include "OverflowFile.h"
+#include "Utf8.h"
+
+#include <cwchar>
+
+using namespace Amplitude;
+
+static FILE* OpenFile(const std::wstring &path, const wchar_t *mode)
+{
+#ifdef _WIN32
+	FILE *file = nullptr;
+	return _wfopen_s(&file, path.c_str(), mode) == 0 ? file : nullptr;
+#else
+	return fopen(ToUtf8(path).c_str(), ToUtf8(mode, wcslen(mode)).c_str());
+#endif
+}
+
+static void RemoveFile(const std::wstring &path)
+{
+#ifdef _WIN32
+	_wremove(path.c_str());
+#else
+	remove(ToUtf8(path).c_str());
+#endif
+}
+
+OverflowFile::OverflowFile(const std::wstring &path) :
+	path(path),
+	file(nullptr),
+	torn(false),
+	hasRecords(false)
+{
+	auto existing = OpenFile(path, L"rb");
+	if (existing != nullptr)
+	{
+		hasRecords.store(fgetc(existing) != EOF);
+		torn = hasRecords.load() && fseek(existing, -1, SEEK_END) == 0 && fgetc(existing) != '\n';
+		fclose(existing);
+	}
+}
+
+OverflowFile::~OverflowFile()
+{
+	std::lock_guard<std::mutex> lock(fileMutex);
+	Close();
+}
+
+void
+OverflowFile::Close()
+{
+	if (file != nullptr)
+	{
+		fclose(file);
+		file = nullptr;
+	}
+}
+
+bool
+OverflowFile::Append(const std::wstring &record)
+{
+	auto line = ToUtf8(record);
+	line.push_back('\n');
+
+	std::lock_guard<std::mutex> lock(fileMutex);
+
+	if (torn)
+	{
+		line.insert(line.begin(), '\n');
+	}
+
+	// Overflow comes in bursts; keep the file open until it's drained.
+	if (file == nullptr && (file = OpenFile(path, L"ab")) == nullptr)
+	{
+		return false;
+	}
+
+	if (fwrite(line.data(), 1, line.size(), file) != line.size() || fflush(file) != 0)
+	{
+		// Some of it may have made it to the file regardless.
+		torn = true;
+		hasRecords.store(true);
+		Close();
+		return false;
+	}
+
+	torn = false;
+	hasRecords.store(true);
+	return true;
+}
+
+bool
+OverflowFile::HasRecords() const
+{
+	return hasRecords.load();
+}
+
+void
+OverflowFile::TakeAll(std::vector<std::wstring> &records)
+{
+	std::string contents;
+	{
+		std::lock_guard<std::mutex> lock(fileMutex);
+		Close();
+
+		auto input = OpenFile(path, L"rb");
+		if (input == nullptr)
+		{
+			hasRecords.store(false);
+			return;
+		}
+
+		char buffer[4096];
+		size_t read;
+		while ((read = fread(buffer, 1, sizeof(buffer), input)) > 0)
+		{
+			contents.append(buffer, read);
+		}
+
+		fclose(input);
+		RemoveFile(path);
+		torn = false;
+		hasRecords.store(false);
+	}
+
+	size_t start = 0;
+	while (start < contents.size())
+	{
+		auto end = contents.find('\n', start);
+		if (end == std::string::npos)
+		{
+			// A torn write from a crash; there's nothing to salvage.
+			break;
+		}
+
+		if (end > start)
+		{
+			records.push_back(FromUtf8(contents.data() + start, end - start));
+		}
+		start = end + 1;
+	}
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Amplitude
+{
+	// An append-only file of records, one per line, for work that didn't fit
+	// in the worker's queue.  Records must not contain newlines; JSON text
+	// never does.
+	//
+	// Any number of threads may append; whoever drains it takes everything
+	// written so far and leaves an empty file behind.  Records left over
+	// from a previous run are picked up too.
+	class OverflowFile
+	{
+	public:
+		OverflowFile(const std::wstring &path);
+		~OverflowFile();
+
+		OverflowFile(OverflowFile const&) = delete;
+		OverflowFile& operator=(OverflowFile const&) = delete;
+
+		bool Append(const std::wstring &record);
+
+		bool HasRecords() const;
+
+		// Moves every record onto the back of 'records', oldest first.
+		void TakeAll(std::vector<std::wstring> &records);
+
+	private:
+		void Close();
+
+		const std::wstring path;
+
+		std::mutex fileMutex;
+		FILE *file;
+
+		// The file may end partway through a record, after a failed write
+		// or a crash; the next record starts on a new line, so that only
+		// the torn one is lost.
+		bool torn;
+
+		std::atomic<bool> hasRecords;
+	};
+}
@@ -0,0 +1,103 @@
+#include "pch.h"
+#include "RetryScheduler.h"
+
+#include <algorithm>
+#include <chrono>
+
+using namespace Amplitude;
+
+static const int64 kSecond = 1000;
+static const int64 kMinute = 60 * kSecond;
+static const int64 kHour = 60 * kMinute;
+
+// Doubling more than this many times overflows any sane cap anyhow.
+static const int kMaxBackoffExponent = 20;
+
+RetryScheduler::RetryScheduler() :
+	suspended(false),
+	consecutiveFailures(0),
+	nextAttemptTime(0),
+	rng(static_cast<unsigned int>(std::chrono::high_resolution_clock::now().time_since_epoch().count()))
+{
+}
+
+const RetryScheduler::Policy&
+RetryScheduler::GetPolicy(UploadResult result)
+{
+	// Policies, in UploadResult order.
+	static const Policy kPolicies[] = {
+		// Success: never consulted, as success resets the backoff.
+		{ 0, 0, false },
+
+		// InvalidApiKey: the key is fixed at Initialize(), so no retry will ever succeed.
+		{ 0, 0, true },
+
+		// BadChecksum: the request was mangled in transit; a prompt retry usually works.
+		{ 5 * kSecond, 5 * kMinute, false },
+
+		// RequestDbWriteFailed: the server is struggling; give it room to recover.
+		{ 30 * kSecond, 30 * kMinute, false },
+
+		// NetworkError: likely offline, so there's no point in hammering the radio.
+		{ 30 * kSecond, kHour, false },
+
+		// UnknownResponse
+		{ kMinute, kHour, false },
+	};
+
+	return kPolicies[static_cast<int>(result)];
+}
+
+int64
+RetryScheduler::GetDelayUntilNextAttempt(int64 now) const
+{
+	if (suspended)
+	{
+		return -1;
+	}
+
+	return std::max(0LL, nextAttemptTime - now);
+}
+
+bool
+RetryScheduler::IsSuspended() const
+{
+	return suspended;
+}
+
+int64
+RetryScheduler::RecordResult(UploadResult result, int64 now)
+{
+	if (result == UploadResult::Success)
+	{
+		consecutiveFailures = 0;
+		nextAttemptTime = 0;
+		return 0;
+	}
+
+	const auto &policy = GetPolicy(result);
+	if (policy.isPermanent)
+	{
+		suspended = true;
+		return -1;
+	}
+
+	++consecutiveFailures;
+
+	auto delay = ComputeBackoff(policy, consecutiveFailures);
+	nextAttemptTime = now + delay;
+	return delay;
+}
+
+int64
+RetryScheduler::ComputeBackoff(const Policy &policy, int failures)
+{
+	auto exponent = std::min(failures - 1, kMaxBackoffExponent);
+	auto ceiling = std::min(policy.maxDelayMillis, policy.baseDelayMillis << exponent);
+
+	// "Equal jitter" - wait at least half of the exponential delay, so that
+	// backoff still grows, but spread the remainder out randomly.
+	auto half = ceiling / 2;
+	std::uniform_int_distribution<int64> jitter(0, half);
+	return (ceiling - half) + jitter(rng);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <random>
+
+namespace Amplitude
+{
+	// The outcome of a single attempt to post a batch of events.
+	enum class UploadResult
+	{
+		Success,
+		InvalidApiKey,
+		BadChecksum,
+		RequestDbWriteFailed,
+		NetworkError,
+		UnknownResponse
+	};
+
+	// Decides when a failed upload may be attempted again.
+	//
+	// Each class of failure has its own policy.  Transient failures back off
+	// exponentially, with jitter so that a fleet of devices doesn't retry in
+	// lockstep, up to a per-policy cap.  Permanent failures (e.g. a bad API key)
+	// trip a breaker, after which no further uploads are attempted.
+	//
+	// Not thread-safe; it is only meant to be used from the worker thread.
+	class RetryScheduler
+	{
+	public:
+		RetryScheduler();
+
+		// Returns the number of milliseconds to wait before the next upload
+		// may be attempted; zero if it may happen now, or -1 if the breaker
+		// has tripped and uploads should not be attempted at all.
+		int64 GetDelayUntilNextAttempt(int64 now) const;
+
+		bool IsSuspended() const;
+
+		// Records the result of an attempt that completed at the given time,
+		// and returns the delay before the next attempt as above.
+		int64 RecordResult(UploadResult result, int64 now);
+
+	private:
+		struct Policy
+		{
+			int64 baseDelayMillis;
+			int64 maxDelayMillis;
+			bool isPermanent;
+		};
+
+		static const Policy& GetPolicy(UploadResult result);
+
+		int64 ComputeBackoff(const Policy &policy, int failures);
+
+		bool suspended;
+		int consecutiveFailures;
+		int64 nextAttemptTime;
+
+		std::minstd_rand rng;
+	};
+}
@@ -0,0 +1,89 @@
+#include "pch.h"
+#include "RuntimeStats.h"
+
+#include <algorithm>
+
+using namespace Amplitude;
+
+// The first bucket is anything under 16us; each one after doubles that.
+static const int kFirstBucketBits = 4;
+
+LatencyHistogram::LatencyHistogram() :
+	count(0),
+	totalMicros(0),
+	maxMicros(0)
+{
+	for (auto &bucket : buckets)
+	{
+		bucket.store(0, std::memory_order_relaxed);
+	}
+}
+
+int64
+LatencyHistogram::GetBucketBound(int bucket)
+{
+	return 1LL << (bucket + kFirstBucketBits);
+}
+
+void
+LatencyHistogram::Record(int64 micros)
+{
+	micros = std::max(0LL, micros);
+
+	auto bucket = 0;
+	while (bucket < kBuckets - 1 && micros >= GetBucketBound(bucket))
+	{
+		++bucket;
+	}
+
+	buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+	count.fetch_add(1, std::memory_order_relaxed);
+	totalMicros.fetch_add(micros, std::memory_order_relaxed);
+
+	// Only contended while the maximum is still climbing.
+	auto max = maxMicros.load(std::memory_order_relaxed);
+	while (micros > max && !maxMicros.compare_exchange_weak(max, micros, std::memory_order_relaxed))
+	{
+	}
+}
+
+LatencyHistogram::Snapshot
+LatencyHistogram::GetSnapshot() const
+{
+	Snapshot snapshot;
+	snapshot.count = count.load(std::memory_order_relaxed);
+	snapshot.totalMicros = totalMicros.load(std::memory_order_relaxed);
+	snapshot.maxMicros = maxMicros.load(std::memory_order_relaxed);
+
+	snapshot.buckets.reserve(kBuckets);
+	for (const auto &bucket : buckets)
+	{
+		snapshot.buckets.push_back(bucket.load(std::memory_order_relaxed));
+	}
+	return snapshot;
+}
+
+ScopedLatency::ScopedLatency(LatencyHistogram &histogram) :
+	histogram(histogram),
+	start(std::chrono::steady_clock::now())
+{
+}
+
+ScopedLatency::~ScopedLatency()
+{
+	auto elapsed = std::chrono::steady_clock::now() - start;
+	histogram.Record(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+}
+
+RuntimeStats::RuntimeStats() :
+	storedEvents(0),
+	storedBytes(0),
+	uploadAttempts(0),
+	uploadBytes(0),
+	lastUploadSuccessTime(0)
+{
+	for (auto &result : uploadResults)
+	{
+		result.store(0, std::memory_order_relaxed);
+	}
+}
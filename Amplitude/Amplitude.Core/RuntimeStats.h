@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+#include "RetryScheduler.h"
+
+namespace Amplitude
+{
+	// A histogram of durations, in microseconds, with fixed power-of-two
+	// buckets.  Recording is a handful of relaxed atomic adds, so it's cheap
+	// enough to leave on everywhere, from any thread.
+	class LatencyHistogram
+	{
+	public:
+		// Bucket i counts durations below GetBucketBound(i); the last one
+		// catches everything larger.
+		static const int kBuckets = 20;
+
+		struct Snapshot
+		{
+			int64 count;
+			int64 totalMicros;
+			int64 maxMicros;
+			std::vector<int64> buckets;
+		};
+
+		LatencyHistogram();
+
+		LatencyHistogram(LatencyHistogram const&) = delete;
+		LatencyHistogram& operator=(LatencyHistogram const&) = delete;
+
+		void Record(int64 micros);
+
+		// Not an atomic snapshot; counts recorded meanwhile may show up in
+		// some fields and not others.
+		Snapshot GetSnapshot() const;
+
+		static int64 GetBucketBound(int bucket);
+
+	private:
+		std::atomic<int64> buckets[kBuckets];
+		std::atomic<int64> count;
+		std::atomic<int64> totalMicros;
+		std::atomic<int64> maxMicros;
+	};
+
+	// Records the time from construction to destruction into a histogram.
+	class ScopedLatency
+	{
+	public:
+		ScopedLatency(LatencyHistogram &histogram);
+		~ScopedLatency();
+
+		ScopedLatency(ScopedLatency const&) = delete;
+		ScopedLatency& operator=(ScopedLatency const&) = delete;
+
+	private:
+		LatencyHistogram &histogram;
+		std::chrono::steady_clock::time_point start;
+	};
+
+	// Counters for the store and for uploads, shared by whoever does the
+	// storing and uploading and read by EventReporter::GetStats().  Every
+	// field may be updated and read from any thread.
+	struct RuntimeStats
+	{
+		static const int kUploadResults = static_cast<int>(UploadResult::UnknownResponse) + 1;
+
+		RuntimeStats();
+
+		RuntimeStats(RuntimeStats const&) = delete;
+		RuntimeStats& operator=(RuntimeStats const&) = delete;
+
+		// As of the last time the worker looked.
+		std::atomic<int64> storedEvents;
+		std::atomic<int64> storedBytes;
+
+		LatencyHistogram insertLatency;
+		LatencyHistogram readLatency;
+		LatencyHistogram deleteLatency;
+
+		std::atomic<int64> uploadAttempts;
+
+		// Indexed by UploadResult; Success is the number that succeeded.
+		std::atomic<int64> uploadResults[kUploadResults];
+
+		// The size of the events sent, before form encoding.
+		std::atomic<int64> uploadBytes;
+
+		// When the last upload to be accepted was sent, in milliseconds since
+		// the epoch; zero if none has been.
+		std::atomic<int64> lastUploadSuccessTime;
+	};
+}
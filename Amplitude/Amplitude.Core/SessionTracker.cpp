@@ -0,0 +1,165 @@
+#include "pch.h"
+#include "SessionTracker.h"
+
+using namespace Amplitude;
+
+SessionTracker::SessionTracker(ISessionStore &store, int64 minTimeBetweenSessions, int64 sessionTimeout) :
+	store(store),
+	minTimeBetweenSessions(minTimeBetweenSessions),
+	sessionTimeout(sessionTimeout),
+	sessionId(0),
+	state(SessionState::Closed),
+	endTime(-1),
+	startMonotonic(kUnknown),
+	lastEventMonotonic(kUnknown),
+	endMonotonic(kUnknown)
+{
+	pendingEnd = store.GetPendingSessionEnd();
+	if (!pendingEnd.empty())
+	{
+		state = SessionState::Ending;
+		sessionId = store.GetLastSessionId();
+		endTime = store.GetLastEndSessionTime();
+	}
+}
+
+int64
+SessionTracker::Elapsed(int64 now, int64 monotonic, int64 then, int64 thenMonotonic)
+{
+	return thenMonotonic != kUnknown ? monotonic - thenMonotonic : now - then;
+}
+
+int64
+SessionTracker::GetSessionId() const
+{
+	return sessionId;
+}
+
+SessionState
+SessionTracker::GetState() const
+{
+	return state;
+}
+
+bool
+SessionTracker::TakeExpiredSessionEnd(int64 now, int64 monotonic, std::wstring &event, int64 &timestamp)
+{
+	if (state != SessionState::Ending || Elapsed(now, monotonic, endTime, endMonotonic) < minTimeBetweenSessions)
+	{
+		return false;
+	}
+
+	event.swap(pendingEnd);
+	timestamp = endTime;
+	ForgetSessionEnd();
+	state = SessionState::Closed;
+
+	// Nothing was held if building the session_end failed.
+	return !event.empty();
+}
+
+void
+SessionTracker::Resume(int64 now, int64 monotonic)
+{
+	if (state == SessionState::Ending && Elapsed(now, monotonic, endTime, endMonotonic) < minTimeBetweenSessions)
+	{
+		ForgetSessionEnd();
+		state = SessionState::Open;
+	}
+}
+
+bool
+SessionTracker::CheckSession(int64 timestamp, int64 monotonic)
+{
+	switch (state)
+	{
+	case SessionState::Ending:
+		// Still resumable; the caller has seen to it otherwise.
+		return false;
+
+	case SessionState::Open:
+		{
+			auto lastEventTime = store.GetLastEventTime();
+			if (Elapsed(timestamp, monotonic, lastEventTime, lastEventMonotonic) <= sessionTimeout && sessionId != -1)
+			{
+				return false;
+			}
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	StartNewSession(timestamp, monotonic);
+	return true;
+}
+
+void
+SessionTracker::StartNewSession(int64 timestamp, int64 monotonic)
+{
+	state = SessionState::Open;
+
+	sessionId = timestamp;
+	startMonotonic = monotonic;
+	store.SetLastSessionId(timestamp);
+}
+
+void
+SessionTracker::OnEvent(int64 timestamp, int64 monotonic)
+{
+	// Events can be logged out of order, e.g. a batch with timestamps of
+	// its own; moving the last activity back would make the next event
+	// look like it came after a long gap.
+	if (lastEventMonotonic != kUnknown && monotonic < lastEventMonotonic)
+	{
+		return;
+	}
+
+	store.SetLastEventTime(timestamp);
+	lastEventMonotonic = monotonic;
+}
+
+bool
+SessionTracker::PrecedesSession(int64 timestamp, int64 monotonic) const
+{
+	if (state == SessionState::Closed)
+	{
+		return false;
+	}
+
+	return startMonotonic != kUnknown ? monotonic < startMonotonic : timestamp < sessionId;
+}
+
+bool
+SessionTracker::Close(int64 timestamp, int64 monotonic)
+{
+	if (state != SessionState::Open)
+	{
+		return false;
+	}
+
+	state = SessionState::Ending;
+	endTime = timestamp;
+	endMonotonic = monotonic;
+	return true;
+}
+
+void
+SessionTracker::HoldSessionEnd(const std::wstring &event)
+{
+	// Journaled, so that a session_end outlives the process being
+	// terminated while suspended.
+	pendingEnd = event;
+	store.SetPendingSessionEnd(event);
+	store.SetLastEndSessionTime(endTime);
+}
+
+void
+SessionTracker::ForgetSessionEnd()
+{
+	pendingEnd.clear();
+	endTime = -1;
+	endMonotonic = kUnknown;
+	store.ClearEndSession();
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <climits>
+#include <string>
+
+namespace Amplitude
+{
+	// Where SessionTracker keeps what has to outlive the process, so that a
+	// session can be resumed after the app is suspended or restarted.
+	// Settings is the one the app uses.
+	class ISessionStore
+	{
+	public:
+		virtual ~ISessionStore() {}
+
+		virtual int64 GetLastEventTime() = 0;
+		virtual void SetLastEventTime(int64 timestamp) = 0;
+
+		virtual int64 GetLastSessionId() = 0;
+		virtual void SetLastSessionId(int64 sessionId) = 0;
+
+		// The journal of an ending session: its session_end event, not yet
+		// stored, and when the session ended.  Empty and -1 when no session
+		// is ending.
+		virtual std::wstring GetPendingSessionEnd() = 0;
+		virtual int64 GetLastEndSessionTime() = 0;
+		virtual void SetPendingSessionEnd(const std::wstring &event) = 0;
+		virtual void SetLastEndSessionTime(int64 timestamp) = 0;
+		virtual void ClearEndSession() = 0;
+	};
+
+	enum class SessionState
+	{
+		// No session; the next event starts one.
+		Closed,
+
+		Open,
+
+		// Ended, but resumable for minTimeBetweenSessions.  Its session_end
+		// is held here rather than stored, so that resuming it undoes
+		// nothing in the event store.
+		Ending
+	};
+
+	// Decides when sessions start and end.  A session that ends is resumed,
+	// rather than a new one started, if the app comes back within
+	// minTimeBetweenSessions; an open session that sees no events for
+	// sessionTimeout is replaced by a new one.  A session's ID is the time
+	// it started.
+	//
+	// Each call takes the wall-clock time of what happened, which is what
+	// the store keeps and what sessions are named by, and the monotonic
+	// time (see Clock), which is what elapsed time is measured with as long
+	// as the process lives; setting the device's clock doesn't split or
+	// merge sessions.  Across a restart only the wall-clock times survive,
+	// and the tracker goes by those.
+	//
+	// The tracker only decides; logging the session_start and session_end
+	// events that go with its decisions is up to the caller.  Not
+	// thread-safe; EventReporter only uses it from the worker.
+	class SessionTracker
+	{
+	public:
+		// Picks up a session that was ending when the process last went
+		// away.
+		SessionTracker(ISessionStore &store, int64 minTimeBetweenSessions, int64 sessionTimeout);
+
+		SessionTracker(SessionTracker const&) = delete;
+		SessionTracker& operator=(SessionTracker const&) = delete;
+
+		int64 GetSessionId() const;
+		SessionState GetState() const;
+
+		// If the ending session can no longer be resumed as of 'now', hands
+		// over its session_end, and when the session ended, for the caller
+		// to store, and closes it; otherwise returns false.  Call it before
+		// anything else that takes the time, so that the session_end is
+		// stored ahead of whatever follows it.
+		bool TakeExpiredSessionEnd(int64 now, int64 monotonic, std::wstring &event, int64 &timestamp);
+
+		// The app has come to the foreground.  An ending session is opened
+		// again, and its session_end dropped.  Follow it with
+		// CheckSession().
+		void Resume(int64 now, int64 monotonic);
+
+		// Works out which session an event at 'timestamp' belongs to.
+		// Returns true if it starts a new one, whose session_start the
+		// caller should log.  Events while a session is ending belong to
+		// it, but don't reopen it.
+		bool CheckSession(int64 timestamp, int64 monotonic);
+
+		// Every event counts as activity, in a session or not.  Only the
+		// latest activity counts; an event from before it leaves it be.
+		void OnEvent(int64 timestamp, int64 monotonic);
+
+		// Whether an event happened before the current session started,
+		// e.g. one from an offline session, logged late with its own
+		// timestamp.  It belongs to no session the tracker knows of, and
+		// shouldn't be passed to CheckSession() or OnEvent().
+		bool PrecedesSession(int64 timestamp, int64 monotonic) const;
+
+		// Ends the session.  Returns whether one was open, in which case the
+		// caller should build its session_end and pass it to
+		// HoldSessionEnd().
+		bool Close(int64 timestamp, int64 monotonic);
+		void HoldSessionEnd(const std::wstring &event);
+
+	private:
+		void StartNewSession(int64 timestamp, int64 monotonic);
+		void ForgetSessionEnd();
+
+		// From 'then' to 'now', on the monotonic clock if 'then' happened in
+		// this process.
+		static int64 Elapsed(int64 now, int64 monotonic, int64 then, int64 thenMonotonic);
+
+		ISessionStore &store;
+		const int64 minTimeBetweenSessions;
+		const int64 sessionTimeout;
+
+		int64 sessionId;
+		SessionState state;
+
+		// While ending: the held session_end, and when the session ended.
+		std::wstring pendingEnd;
+		int64 endTime;
+
+		// When the session started, and the stored last event and the end
+		// happened, on the monotonic clock; kUnknown if not in this
+		// process.  Monotonic times can be negative, for events stamped
+		// before the device started.
+		static const int64 kUnknown = LLONG_MIN;
+
+		int64 startMonotonic;
+		int64 lastEventMonotonic;
+		int64 endMonotonic;
+	};
+}
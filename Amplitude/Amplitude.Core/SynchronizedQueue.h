@@ -0,0 +1,304 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <vector>
+
+namespace Amplitude
+{
+	using std::condition_variable;
+	using std::deque;
+	using std::function;
+	using std::mutex;
+	using std::unique_lock;
+	using std::vector;
+
+	// A simple blocking queue.  It is intended for multi-producer,
+	// single-consumer scenarios, e.g. a thread event-loop.
+	//
+	// Items may be split across several lanes, lane 0 being the most urgent.
+	// The consumer is always handed an item from the most urgent non-empty
+	// lane, unless a less urgent lane has been passed over 'starvationLimit'
+	// times in a row, in which case it gets a turn.  Each lane has its own
+	// capacity, so a flood of low-priority items can't crowd out urgent ones.
+	//
+	// Items are only ever moved through the queue, so T may be move-only;
+	// the copying overload of TryEnqueue is there for convenience.
+	template <typename T>
+	class SynchronizedQueue
+	{
+	public:
+		SynchronizedQueue(unsigned int size = 1024);
+
+		// A lane size of zero means that the lane is unbounded.
+		SynchronizedQueue(const vector<unsigned int> &laneSizes, unsigned int starvationLimit);
+
+		~SynchronizedQueue();
+
+		SynchronizedQueue(SynchronizedQueue const&) = delete;
+		SynchronizedQueue& operator=(SynchronizedQueue const&) = delete;
+
+		//void Enqueue(const T &item);
+		//void Enqueue(T&& item);
+
+		bool TryEnqueue(const T &item, unsigned int lane = 0);
+
+		// If the item can't be enqueued, it is left untouched.
+		bool TryEnqueue(T&& item, unsigned int lane = 0);
+
+		bool TryDequeue(T &item);
+
+		// Blocks like TryDequeue, then moves up to 'max' items, in the order
+		// that TryDequeue would have returned them, onto the back of
+		// 'container', all under a single acquisition of the lock.  Returns
+		// the number of items taken; zero means that the queue has been
+		// completed and is empty.
+		template <typename Container>
+		size_t DrainTo(Container &container, size_t max);
+
+		// As DrainTo, but gives up waiting at 'deadline', returning zero.
+		template <typename Container>
+		size_t DrainUntil(Container &container, size_t max, std::chrono::steady_clock::time_point deadline);
+
+		// Takes the oldest item out of the given lane, without waiting, to
+		// make room for a newer one.
+		bool TryEvictOldest(unsigned int lane, T &item);
+
+		void Complete();
+
+	private:
+		struct Lane
+		{
+			unsigned int size;
+			unsigned int skipped;
+			deque<T> items;
+		};
+
+		// All of these must be called with the lock held.
+		bool HasItems() const;
+		bool CanAccept(unsigned int lane) const;
+
+		// Only if an item is available.
+		unsigned int NextLane();
+
+		template <typename Container>
+		size_t TakeItems(Container &container, size_t max);
+
+		const unsigned int starvationLimit;
+
+		bool is_complete;
+		vector<Lane> lanes;
+		mutex queue_mutex;
+		condition_variable empty;
+	};
+
+	template <typename T>
+	SynchronizedQueue<T>::SynchronizedQueue(unsigned int size)
+		: starvationLimit(0), is_complete(false), lanes(1)
+	{
+		lanes[0].size = size;
+		lanes[0].skipped = 0;
+	}
+
+	template <typename T>
+	SynchronizedQueue<T>::SynchronizedQueue(const vector<unsigned int> &laneSizes, unsigned int starvationLimit)
+		: starvationLimit(starvationLimit), is_complete(false), lanes(laneSizes.size())
+	{
+		for (size_t i = 0; i < laneSizes.size(); ++i)
+		{
+			lanes[i].size = laneSizes[i];
+			lanes[i].skipped = 0;
+		}
+	}
+
+	template <typename T>
+	SynchronizedQueue<T>::~SynchronizedQueue()
+	{
+		unique_lock<mutex> lock(queue_mutex);
+		lanes.clear();
+		lock.unlock();
+
+		Complete();
+	}
+
+	template <typename T>
+	bool SynchronizedQueue<T>::CanAccept(unsigned int lane) const
+	{
+		if (is_complete || lane >= lanes.size())
+		{
+			return false;
+		}
+
+		const auto &target = lanes[lane];
+		return target.size == 0 || target.items.size() < target.size;
+	}
+
+	template <typename T>
+	bool SynchronizedQueue<T>::HasItems() const
+	{
+		for (const auto &lane : lanes)
+		{
+			if (!lane.items.empty())
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	template <typename T>
+	bool SynchronizedQueue<T>::TryEnqueue(const T &item, unsigned int lane)
+	{
+		T copy(item);
+		return TryEnqueue(std::move(copy), lane);
+	}
+
+	template <typename T>
+	bool SynchronizedQueue<T>::TryEnqueue(T&& item, unsigned int lane)
+	{
+		auto didEnqueue = false;
+
+		unique_lock<mutex> lock(queue_mutex);
+		if (CanAccept(lane))
+		{
+			lanes[lane].items.push_back(std::move(item));
+			didEnqueue = true;
+		}
+		lock.unlock();
+
+		if (didEnqueue)
+		{
+			empty.notify_one();
+		}
+
+		return didEnqueue;
+	}
+
+	template <typename T>
+	bool SynchronizedQueue<T>::TryDequeue(T &item)
+	{
+		auto result = false;
+
+		unique_lock<mutex> lock(queue_mutex);
+		while (!HasItems() && !is_complete)
+		{
+			empty.wait(lock);
+		}
+
+		if (HasItems())
+		{
+			auto &lane = lanes[NextLane()];
+			item = std::move(lane.items.front());
+			lane.items.pop_front();
+			result = true;
+		}
+
+		return result;
+	}
+
+	template <typename T>
+	template <typename Container>
+	size_t SynchronizedQueue<T>::DrainTo(Container &container, size_t max)
+	{
+		unique_lock<mutex> lock(queue_mutex);
+		while (!HasItems() && !is_complete)
+		{
+			empty.wait(lock);
+		}
+
+		return TakeItems(container, max);
+	}
+
+	template <typename T>
+	template <typename Container>
+	size_t SynchronizedQueue<T>::DrainUntil(Container &container, size_t max, std::chrono::steady_clock::time_point deadline)
+	{
+		unique_lock<mutex> lock(queue_mutex);
+		while (!HasItems() && !is_complete)
+		{
+			if (empty.wait_until(lock, deadline) == std::cv_status::timeout)
+			{
+				break;
+			}
+		}
+
+		return TakeItems(container, max);
+	}
+
+	template <typename T>
+	template <typename Container>
+	size_t SynchronizedQueue<T>::TakeItems(Container &container, size_t max)
+	{
+		size_t count = 0;
+		while (count < max && HasItems())
+		{
+			auto &lane = lanes[NextLane()];
+			container.push_back(std::move(lane.items.front()));
+			lane.items.pop_front();
+			++count;
+		}
+
+		return count;
+	}
+
+	template <typename T>
+	unsigned int SynchronizedQueue<T>::NextLane()
+	{
+		auto chosen = lanes.size();
+		for (size_t i = 0; i < lanes.size(); ++i)
+		{
+			if (lanes[i].items.empty())
+			{
+				lanes[i].skipped = 0;
+			}
+			else if (chosen == lanes.size())
+			{
+				chosen = i;
+			}
+			else if (starvationLimit > 0 && lanes[i].skipped >= starvationLimit && lanes[chosen].skipped < starvationLimit)
+			{
+				// The most urgent starving lane wins.
+				chosen = i;
+			}
+		}
+
+		for (size_t i = 0; i < lanes.size(); ++i)
+		{
+			if (i != chosen && !lanes[i].items.empty())
+			{
+				lanes[i].skipped++;
+			}
+		}
+
+		lanes[chosen].skipped = 0;
+		return static_cast<unsigned int>(chosen);
+	}
+
+	template <typename T>
+	bool SynchronizedQueue<T>::TryEvictOldest(unsigned int lane, T &item)
+	{
+		unique_lock<mutex> lock(queue_mutex);
+		if (lane >= lanes.size() || lanes[lane].items.empty())
+		{
+			return false;
+		}
+
+		item = std::move(lanes[lane].items.front());
+		lanes[lane].items.pop_front();
+		return true;
+	}
+
+	template <typename T>
+	void SynchronizedQueue<T>::Complete()
+	{
+		unique_lock<mutex> lock(queue_mutex);
+		is_complete = true;
+		lock.unlock();
+
+		// Nothing more is coming; don't leave the consumer waiting for it.
+		empty.notify_all();
+	}
+}
@@ -0,0 +1,101 @@
+#include "pch.h"
+#include "ThreadExit.h"
+
+#include <mutex>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+using namespace Amplitude;
+
+namespace
+{
+	struct ExitEntry
+	{
+		ThreadExitCallback callback;
+		void *value;
+		ExitEntry *next;
+	};
+}
+
+static void RunExitEntries(void *head)
+{
+	auto entry = static_cast<ExitEntry*>(head);
+	while (entry != nullptr)
+	{
+		auto next = entry->next;
+		entry->callback(entry->value);
+		delete entry;
+		entry = next;
+	}
+}
+
+#ifdef _WIN32
+
+// Fiber-local storage, rather than thread-local, because it's the one that
+// calls back on exit.
+static DWORD gSlot = FLS_OUT_OF_INDEXES;
+
+static void NTAPI OnFlsExit(void *head)
+{
+	RunExitEntries(head);
+}
+
+static void CreateSlot()
+{
+	gSlot = FlsAlloc(OnFlsExit);
+	if (gSlot == FLS_OUT_OF_INDEXES)
+	{
+		throw std::runtime_error("Couldn't allocate a fiber-local storage slot");
+	}
+}
+
+static void* GetHead()
+{
+	return FlsGetValue(gSlot);
+}
+
+static void SetHead(void *head)
+{
+	FlsSetValue(gSlot, head);
+}
+
+#else
+
+static pthread_key_t gSlot;
+
+static void CreateSlot()
+{
+	if (pthread_key_create(&gSlot, RunExitEntries) != 0)
+	{
+		throw std::runtime_error("Couldn't create a thread-specific data key");
+	}
+}
+
+static void* GetHead()
+{
+	return pthread_getspecific(gSlot);
+}
+
+static void SetHead(void *head)
+{
+	pthread_setspecific(gSlot, head);
+}
+
+#endif
+
+static std::once_flag gSlotCreated;
+
+void
+Amplitude::AtThreadExit(ThreadExitCallback callback, void *value)
+{
+	std::call_once(gSlotCreated, CreateSlot);
+
+	auto entry = new ExitEntry();
+	entry->callback = callback;
+	entry->value = value;
+	entry->next = static_cast<ExitEntry*>(GetHead());
+	SetHead(entry);
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+namespace Amplitude
+{
+	typedef void (*ThreadExitCallback)(void *value);
+
+	// Calls 'callback' with 'value' on the calling thread as it exits, for
+	// per-thread state kept behind a __declspec(thread) pointer, which
+	// nothing else would clean up: VS2013 has no thread_local.  Callbacks
+	// run in the reverse of the order they were registered in.
+	void AtThreadExit(ThreadExitCallback callback, void *value);
+}
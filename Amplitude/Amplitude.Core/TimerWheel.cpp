@@ -0,0 +1,193 @@
+#include "pch.h"
+#include "TimerWheel.h"
+
+#include <algorithm>
+
+using namespace Amplitude;
+
+TimerWheel::TimerWheel(int64 now) :
+	current(now)
+{
+	std::fill(counts, counts + kLevels, 0);
+}
+
+int64
+TimerWheel::LevelSpan(int level)
+{
+	// How many ticks one slot of the given level covers.
+	return 1LL << (kSlotBits * level);
+}
+
+void
+TimerWheel::Add(TimerId id, int64 deadline, Callback callback)
+{
+	Cancel(id);
+
+	Slot pending;
+	Timer timer = { id, deadline, std::move(callback) };
+	pending.push_back(std::move(timer));
+
+	// The slot for the current tick has been dealt with; anything due by
+	// now goes in the next one.
+	Place(pending, pending.begin(), current + 1);
+}
+
+void
+TimerWheel::Place(Slot &from, Slot::iterator timer, int64 earliest)
+{
+	auto when = std::max(timer->deadline, earliest);
+
+	auto level = 0;
+	while (level < kLevels - 1 && when - current >= LevelSpan(level + 1))
+	{
+		++level;
+	}
+
+	// Too far out for the wheel; park it as far along the top level as
+	// possible, and it'll be placed again when that slot comes around.
+	auto limit = current + LevelSpan(kLevels) - LevelSpan(kLevels - 1);
+	when = std::min(when, limit);
+
+	auto slot = static_cast<int>((when >> (kSlotBits * level)) & (kSlots - 1));
+
+	auto &target = slots[level][slot];
+	target.splice(target.end(), from, timer);
+	counts[level]++;
+
+	Location location = { level, slot, timer };
+	locations[timer->id] = location;
+}
+
+bool
+TimerWheel::Cancel(TimerId id)
+{
+	auto found = locations.find(id);
+	if (found == locations.end())
+	{
+		return false;
+	}
+
+	auto &location = found->second;
+	slots[location.level][location.slot].erase(location.timer);
+	counts[location.level]--;
+	locations.erase(found);
+	return true;
+}
+
+void
+TimerWheel::Cascade(int level)
+{
+	auto index = static_cast<int>((current >> (kSlotBits * level)) & (kSlots - 1));
+	auto &slot = slots[level][index];
+	while (!slot.empty())
+	{
+		// Cascades happen before the current tick's timers fire, so a
+		// timer can still make it into this tick.
+		counts[level]--;
+		Place(slot, slot.begin(), current);
+	}
+}
+
+void
+TimerWheel::Advance(int64 now, std::vector<Callback> &expired)
+{
+	std::vector<Timer> due;
+	while (current < now)
+	{
+		// Skip ahead to the next tick where a non-empty level has work to
+		// do: the lowest such level either fires or cascades at the start
+		// of each of its slots.
+		auto lowest = 0;
+		while (lowest < kLevels && counts[lowest] == 0)
+		{
+			++lowest;
+		}
+
+		if (lowest == kLevels)
+		{
+			current = now;
+			break;
+		}
+
+		if (lowest > 0)
+		{
+			auto span = LevelSpan(lowest);
+			auto next = (current / span + 1) * span;
+			if (next > now)
+			{
+				current = now;
+				break;
+			}
+			current = next - 1;
+		}
+
+		++current;
+
+		// From the top down, so that a timer cascading from high up can
+		// land in a lower slot that is due right now.
+		for (auto level = kLevels - 1; level > 0; --level)
+		{
+			if (current % LevelSpan(level) == 0)
+			{
+				Cascade(level);
+			}
+		}
+
+		auto &slot = slots[0][current & (kSlots - 1)];
+		while (!slot.empty())
+		{
+			locations.erase(slot.front().id);
+			due.push_back(std::move(slot.front()));
+			slot.pop_front();
+			counts[0]--;
+		}
+	}
+
+	std::stable_sort(due.begin(), due.end(), [](const Timer &lhs, const Timer &rhs)
+	{
+		return lhs.deadline < rhs.deadline;
+	});
+
+	for (auto &timer : due)
+	{
+		expired.push_back(std::move(timer.callback));
+	}
+}
+
+int64
+TimerWheel::GetNextDeadline() const
+{
+	auto next = -1LL;
+	for (auto level = 0; level < kLevels; ++level)
+	{
+		if (counts[level] == 0)
+		{
+			continue;
+		}
+
+		// The first non-empty slot after the current one, at this level,
+		// begins at the returned tick.
+		auto span = LevelSpan(level);
+		auto base = current / span;
+		for (auto step = 1; step <= kSlots; ++step)
+		{
+			auto index = static_cast<int>((base + step) & (kSlots - 1));
+			if (!slots[level][index].empty())
+			{
+				auto when = (base + step) * span;
+				if (next == -1 || when < next)
+				{
+					next = when;
+				}
+				break;
+			}
+		}
+	}
+	return next;
+}
+
+size_t
+TimerWheel::GetCount() const
+{
+	return locations.size();
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include "UniqueFunction.h"
+
+namespace Amplitude
+{
+	// A hierarchical timing wheel with millisecond ticks: four levels of 64
+	// slots, each slot of a level spanning a whole turn of the level below,
+	// so the wheel covers about four and a half hours; anything further out
+	// waits in the top level and is placed again as it comes around.
+	//
+	// Adding and cancelling a timer are constant time.  Advancing is
+	// constant time per tick that has something to do, and skips over
+	// stretches where nothing does, so a long idle spell costs nothing.
+	//
+	// Not thread-safe; WorkerThread only touches it from the worker.
+	class TimerWheel
+	{
+	public:
+		typedef uint64_t TimerId;
+		typedef UniqueFunction<void()> Callback;
+
+		TimerWheel(int64 now);
+
+		TimerWheel(TimerWheel const&) = delete;
+		TimerWheel& operator=(TimerWheel const&) = delete;
+
+		// A deadline that has already passed fires on the next Advance.
+		void Add(TimerId id, int64 deadline, Callback callback);
+
+		// Returns false if there is no such timer, e.g. because it has
+		// already fired.
+		bool Cancel(TimerId id);
+
+		// Moves the callback of every timer due by 'now' onto the back of
+		// 'expired', earliest first.
+		void Advance(int64 now, std::vector<Callback> &expired);
+
+		// The earliest time at which Advance would have anything to do, or
+		// -1 if there are no timers.  This may be a little before the next
+		// deadline, when timers need to move down a level.
+		int64 GetNextDeadline() const;
+
+		size_t GetCount() const;
+
+	private:
+		static const int kLevels = 4;
+		static const int kSlotBits = 6;
+		static const int kSlots = 1 << kSlotBits;
+
+		struct Timer
+		{
+			TimerId id;
+			int64 deadline;
+			Callback callback;
+		};
+
+		typedef std::list<Timer> Slot;
+
+		struct Location
+		{
+			int level;
+			int slot;
+			Slot::iterator timer;
+		};
+
+		static int64 LevelSpan(int level);
+
+		// Files a timer that is already in 'from' into the slot it belongs
+		// in now, firing no earlier than 'earliest'.
+		void Place(Slot &from, Slot::iterator timer, int64 earliest);
+		void Cascade(int level);
+
+		int64 current;
+		Slot slots[kLevels][kSlots];
+		size_t counts[kLevels];
+		std::unordered_map<TimerId, Location> locations;
+	};
+}
@@ -0,0 +1,247 @@
+#include "pch.h"
+#include "Trace.h"
+#include "ThreadExit.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+using namespace Amplitude;
+
+#ifdef _MSC_VER
+#define AMPLITUDE_THREAD_LOCAL __declspec(thread)
+#else
+#define AMPLITUDE_THREAD_LOCAL __thread
+#endif
+
+// Spans kept per thread; at 32 bytes each, 64KB a thread.
+static const uint64_t kBufferSize = 2048;
+
+// Buffers of threads that have exited, kept so that their spans are still
+// exported; beyond this many, the oldest is freed.
+static const size_t kExitedBuffers = 4;
+
+namespace
+{
+	struct TraceEvent
+	{
+		const char *name;
+		int64 start;
+		int64 end;
+	};
+
+	// One thread's spans.  Only that thread writes to it; anyone may read
+	// it, so each slot is a little seqlock: its sequence number is odd
+	// while it's being written, and a reader that sees it change while
+	// copying the slot throws the copy away.
+	class TraceBuffer
+	{
+	public:
+		TraceBuffer(int threadId) :
+			threadId(threadId),
+			threadName(nullptr),
+			next(0)
+		{
+			for (auto &slot : slots)
+			{
+				slot.sequence.store(0, std::memory_order_relaxed);
+			}
+		}
+
+		void Append(const char *name, int64 start, int64 end)
+		{
+			auto index = next.load(std::memory_order_relaxed);
+			auto &slot = slots[index % kBufferSize];
+
+			slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+
+			slot.name.store(name, std::memory_order_relaxed);
+			slot.start.store(start, std::memory_order_relaxed);
+			slot.end.store(end, std::memory_order_relaxed);
+
+			slot.sequence.store(2 * index + 2, std::memory_order_release);
+			next.store(index + 1, std::memory_order_release);
+		}
+
+		void CopyTo(std::vector<TraceEvent> &events) const
+		{
+			auto end = next.load(std::memory_order_acquire);
+			auto begin = end > kBufferSize ? end - kBufferSize : 0;
+
+			for (auto index = begin; index < end; ++index)
+			{
+				const auto &slot = slots[index % kBufferSize];
+
+				auto before = slot.sequence.load(std::memory_order_acquire);
+				if (before != 2 * index + 2)
+				{
+					// Overwritten since we looked, or still being written.
+					continue;
+				}
+
+				TraceEvent event;
+				event.name = slot.name.load(std::memory_order_relaxed);
+				event.start = slot.start.load(std::memory_order_relaxed);
+				event.end = slot.end.load(std::memory_order_relaxed);
+
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (slot.sequence.load(std::memory_order_relaxed) == before)
+				{
+					events.push_back(event);
+				}
+			}
+		}
+
+		const int threadId;
+		std::atomic<const char*> threadName;
+
+	private:
+		struct Slot
+		{
+			std::atomic<uint64_t> sequence;
+			std::atomic<const char*> name;
+			std::atomic<int64> start;
+			std::atomic<int64> end;
+		};
+
+		Slot slots[kBufferSize];
+		std::atomic<uint64_t> next;
+	};
+}
+
+// Every live thread's buffer, and the last few exited threads', for
+// exporting.  Exporting holds the lock throughout, so a buffer can't be
+// freed while it's being read.
+static std::mutex gBuffersMutex;
+static std::vector<TraceBuffer*> gBuffers;
+static std::deque<TraceBuffer*> gExitedBuffers;
+static int gLastThreadId;
+
+static AMPLITUDE_THREAD_LOCAL TraceBuffer *tBuffer;
+
+static void OnThreadExit(void *value)
+{
+	auto buffer = static_cast<TraceBuffer*>(value);
+	if (tBuffer == buffer)
+	{
+		tBuffer = nullptr;
+	}
+
+	TraceBuffer *expired = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(gBuffersMutex);
+		gBuffers.erase(std::remove(gBuffers.begin(), gBuffers.end(), buffer), gBuffers.end());
+		gExitedBuffers.push_back(buffer);
+
+		if (gExitedBuffers.size() > kExitedBuffers)
+		{
+			expired = gExitedBuffers.front();
+			gExitedBuffers.pop_front();
+		}
+	}
+	delete expired;
+}
+
+static TraceBuffer* GetThreadBuffer()
+{
+	if (tBuffer == nullptr)
+	{
+		std::lock_guard<std::mutex> lock(gBuffersMutex);
+		tBuffer = new TraceBuffer(++gLastThreadId);
+		gBuffers.push_back(tBuffer);
+		AtThreadExit(OnThreadExit, tBuffer);
+	}
+	return tBuffer;
+}
+
+static void AppendJsonString(std::wostringstream &out, const char *str)
+{
+	out << L'"';
+	for (auto c = str; *c != '\0'; ++c)
+	{
+		if (*c == '"' || *c == '\\')
+		{
+			out << L'\\';
+		}
+		out << static_cast<wchar_t>(static_cast<unsigned char>(*c));
+	}
+	out << L'"';
+}
+
+int64
+Trace::Now()
+{
+	auto now = std::chrono::steady_clock::now().time_since_epoch();
+	return std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+}
+
+void
+Trace::Record(const char *name, int64 start, int64 end)
+{
+	GetThreadBuffer()->Append(name, start, end);
+}
+
+void
+Trace::SetThreadName(const char *name)
+{
+	GetThreadBuffer()->threadName.store(name, std::memory_order_relaxed);
+}
+
+std::wstring
+Trace::ExportChromeJson()
+{
+	std::lock_guard<std::mutex> lock(gBuffersMutex);
+
+	std::vector<TraceBuffer*> buffers(gExitedBuffers.begin(), gExitedBuffers.end());
+	buffers.insert(buffers.end(), gBuffers.begin(), gBuffers.end());
+
+	std::wostringstream out;
+	out << L"{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+	auto first = true;
+	std::vector<TraceEvent> events;
+	for (auto buffer : buffers)
+	{
+		auto threadName = buffer->threadName.load(std::memory_order_relaxed);
+		if (threadName != nullptr)
+		{
+			out << (first ? L"" : L",") << L"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->threadId << L",\"args\":{\"name\":";
+			AppendJsonString(out, threadName);
+			out << L"}}";
+			first = false;
+		}
+
+		events.clear();
+		buffer->CopyTo(events);
+		for (const auto &event : events)
+		{
+			// Complete events: a start and a duration, in microseconds.
+			out << (first ? L"" : L",") << L"{\"name\":";
+			AppendJsonString(out, event.name);
+			out << L",\"cat\":\"amplitude\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadId
+				<< L",\"ts\":" << event.start
+				<< L",\"dur\":" << (event.end - event.start) << L"}";
+			first = false;
+		}
+	}
+
+	out << L"]}";
+	return out.str();
+}
+
+TraceSpan::TraceSpan(const char *name) :
+	name(name),
+	start(Trace::Now())
+{
+}
+
+TraceSpan::~TraceSpan()
+{
+	Trace::Record(name, start, Trace::Now());
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <string>
+
+namespace Amplitude
+{
+	// Records spans of time on each thread into a small ring buffer, to be
+	// exported in Chrome's trace-event format and opened in chrome://tracing
+	// or Perfetto, where they show up on a timeline, thread by thread.
+	//
+	// The AMPLITUDE_TRACE_* macros below compile to nothing unless
+	// AMPLITUDE_TRACING is defined, so tracing costs nothing in a normal
+	// build.  When it is on, recording a span is two clock reads and a few
+	// relaxed stores into the thread's own buffer; no locks, and nothing is
+	// shared with other threads except when exporting.  Each buffer keeps
+	// the most recent spans and overwrites the oldest.
+	class Trace
+	{
+	public:
+		// Microseconds on a monotonic clock.
+		static int64 Now();
+
+		// 'name' must outlive the trace, e.g. a string literal.
+		static void Record(const char *name, int64 start, int64 end);
+
+		// Labels the calling thread in the exported trace.  'name' must
+		// outlive the trace, as above.
+		static void SetThreadName(const char *name);
+
+		// All spans currently buffered, from every thread, as a JSON trace
+		// document.  Spans being written while this runs may be left out.
+		static std::wstring ExportChromeJson();
+
+	private:
+		Trace();
+	};
+
+	// Records the time from construction to destruction as a span.
+	class TraceSpan
+	{
+	public:
+		TraceSpan(const char *name);
+		~TraceSpan();
+
+		TraceSpan(TraceSpan const&) = delete;
+		TraceSpan& operator=(TraceSpan const&) = delete;
+
+	private:
+		const char *name;
+		int64 start;
+	};
+}
+
+#ifdef AMPLITUDE_TRACING
+
+#define AMPLITUDE_TRACE_CONCAT_(a, b) a##b
+#define AMPLITUDE_TRACE_CONCAT(a, b) AMPLITUDE_TRACE_CONCAT_(a, b)
+
+// Traces the rest of the enclosing scope.
+#define AMPLITUDE_TRACE_SPAN(name) ::Amplitude::TraceSpan AMPLITUDE_TRACE_CONCAT(traceSpan, __LINE__)(name)
+
+// For spans that don't fit a scope, e.g. waiting for a response: mark the
+// start in an int64, and record the span once it's over.
+#define AMPLITUDE_TRACE_MARK(start) ((start) = ::Amplitude::Trace::Now())
+#define AMPLITUDE_TRACE_SINCE(name, start) ::Amplitude::Trace::Record((name), (start), ::Amplitude::Trace::Now())
+
+#define AMPLITUDE_TRACE_THREAD_NAME(name) ::Amplitude::Trace::SetThreadName(name)
+
+#else
+
+#define AMPLITUDE_TRACE_SPAN(name) ((void) 0)
+#define AMPLITUDE_TRACE_MARK(start) ((void) 0)
+#define AMPLITUDE_TRACE_SINCE(name, start) ((void) 0)
+#define AMPLITUDE_TRACE_THREAD_NAME(name) ((void) 0)
+
+#endif
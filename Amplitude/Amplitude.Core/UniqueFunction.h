@@ -0,0 +1,273 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace Amplitude
+{
+	template <typename Signature>
+	class UniqueFunction;
+
+	// A move-only std::function.  Callables that fit in the inline buffer are
+	// stored there rather than on the heap; the buffer is sized so that the
+	// lambdas EventReporter queues (a handful of handles, a timestamp and a
+	// flag) fit, and the whole object is one cache line.
+	//
+	// Being move-only, it can hold callables that can't be copied, and it is
+	// never copied on its way through a queue.
+	template <typename R, typename... Args>
+	class UniqueFunction<R(Args...)>
+	{
+	public:
+		static const size_t kInlineSize = 56;
+
+		UniqueFunction();
+		UniqueFunction(std::nullptr_t);
+		UniqueFunction(UniqueFunction &&other);
+		~UniqueFunction();
+
+		template <typename F>
+		UniqueFunction(F fn, typename std::enable_if<!std::is_same<F, UniqueFunction>::value>::type* = nullptr);
+
+		UniqueFunction(UniqueFunction const&) = delete;
+		UniqueFunction& operator=(UniqueFunction const&) = delete;
+
+		UniqueFunction& operator=(UniqueFunction &&other);
+		UniqueFunction& operator=(std::nullptr_t);
+
+		R operator()(Args... args);
+
+		explicit operator bool() const;
+
+		// Whether the callable was too big to be stored inline.
+		bool IsOnHeap() const;
+
+	private:
+		// Aligned for anything our lambdas capture, and no more, so that the
+		// buffer isn't padded out.
+		typedef typename std::aligned_storage<kInlineSize, std::alignment_of<double>::value>::type Storage;
+
+		struct Ops
+		{
+			R (*invoke)(Storage &storage, Args... args);
+
+			// Move-constructs into 'to', and destroys what's left in 'from'.
+			void (*relocate)(Storage &from, Storage &to);
+			void (*destroy)(Storage &storage);
+			bool onHeap;
+		};
+
+		template <typename F>
+		struct InlineOps
+		{
+			static R Invoke(Storage &storage, Args... args);
+			static void Relocate(Storage &from, Storage &to);
+			static void Destroy(Storage &storage);
+			static const Ops table;
+		};
+
+		template <typename F>
+		struct HeapOps
+		{
+			static R Invoke(Storage &storage, Args... args);
+			static void Relocate(Storage &from, Storage &to);
+			static void Destroy(Storage &storage);
+			static const Ops table;
+		};
+
+		template <typename F>
+		struct FitsInline
+		{
+			static const bool value =
+				sizeof(F) <= kInlineSize &&
+				std::alignment_of<Storage>::value % std::alignment_of<F>::value == 0;
+		};
+
+		template <typename F>
+		void Store(F &&fn, std::true_type);
+
+		template <typename F>
+		void Store(F &&fn, std::false_type);
+
+		void Reset();
+
+		const Ops *ops;
+		Storage storage;
+	};
+
+	template <typename R, typename... Args>
+	template <typename F>
+	R UniqueFunction<R(Args...)>::InlineOps<F>::Invoke(Storage &storage, Args... args)
+	{
+		return (*reinterpret_cast<F*>(&storage))(std::forward<Args>(args)...);
+	}
+
+	template <typename R, typename... Args>
+	template <typename F>
+	void UniqueFunction<R(Args...)>::InlineOps<F>::Relocate(Storage &from, Storage &to)
+	{
+		auto source = reinterpret_cast<F*>(&from);
+		new (&to) F(std::move(*source));
+		source->~F();
+	}
+
+	template <typename R, typename... Args>
+	template <typename F>
+	void UniqueFunction<R(Args...)>::InlineOps<F>::Destroy(Storage &storage)
+	{
+		reinterpret_cast<F*>(&storage)->~F();
+	}
+
+	template <typename R, typename... Args>
+	template <typename F>
+	const typename UniqueFunction<R(Args...)>::Ops UniqueFunction<R(Args...)>::InlineOps<F>::table =
+	{
+		&UniqueFunction<R(Args...)>::InlineOps<F>::Invoke,
+		&UniqueFunction<R(Args...)>::InlineOps<F>::Relocate,
+		&UniqueFunction<R(Args...)>::InlineOps<F>::Destroy,
+		false
+	};
+
+	template <typename R, typename... Args>
+	template <typename F>
+	R UniqueFunction<R(Args...)>::HeapOps<F>::Invoke(Storage &storage, Args... args)
+	{
+		return (**reinterpret_cast<F**>(&storage))(std::forward<Args>(args)...);
+	}
+
+	template <typename R, typename... Args>
+	template <typename F>
+	void UniqueFunction<R(Args...)>::HeapOps<F>::Relocate(Storage &from, Storage &to)
+	{
+		// Only the pointer moves.
+		*reinterpret_cast<F**>(&to) = *reinterpret_cast<F**>(&from);
+	}
+
+	template <typename R, typename... Args>
+	template <typename F>
+	void UniqueFunction<R(Args...)>::HeapOps<F>::Destroy(Storage &storage)
+	{
+		delete *reinterpret_cast<F**>(&storage);
+	}
+
+	template <typename R, typename... Args>
+	template <typename F>
+	const typename UniqueFunction<R(Args...)>::Ops UniqueFunction<R(Args...)>::HeapOps<F>::table =
+	{
+		&UniqueFunction<R(Args...)>::HeapOps<F>::Invoke,
+		&UniqueFunction<R(Args...)>::HeapOps<F>::Relocate,
+		&UniqueFunction<R(Args...)>::HeapOps<F>::Destroy,
+		true
+	};
+
+	template <typename R, typename... Args>
+	UniqueFunction<R(Args...)>::UniqueFunction() :
+		ops(nullptr)
+	{
+	}
+
+	template <typename R, typename... Args>
+	UniqueFunction<R(Args...)>::UniqueFunction(std::nullptr_t) :
+		ops(nullptr)
+	{
+	}
+
+	template <typename R, typename... Args>
+	UniqueFunction<R(Args...)>::UniqueFunction(UniqueFunction &&other) :
+		ops(other.ops)
+	{
+		if (ops != nullptr)
+		{
+			ops->relocate(other.storage, storage);
+			other.ops = nullptr;
+		}
+	}
+
+	template <typename R, typename... Args>
+	template <typename F>
+	UniqueFunction<R(Args...)>::UniqueFunction(F fn, typename std::enable_if<!std::is_same<F, UniqueFunction>::value>::type*) :
+		ops(nullptr)
+	{
+		Store(std::move(fn), std::integral_constant<bool, FitsInline<F>::value>());
+	}
+
+	template <typename R, typename... Args>
+	UniqueFunction<R(Args...)>::~UniqueFunction()
+	{
+		Reset();
+	}
+
+	template <typename R, typename... Args>
+	template <typename F>
+	void UniqueFunction<R(Args...)>::Store(F &&fn, std::true_type)
+	{
+		new (&storage) F(std::move(fn));
+		ops = &InlineOps<F>::table;
+	}
+
+	template <typename R, typename... Args>
+	template <typename F>
+	void UniqueFunction<R(Args...)>::Store(F &&fn, std::false_type)
+	{
+		*reinterpret_cast<F**>(&storage) = new F(std::move(fn));
+		ops = &HeapOps<F>::table;
+	}
+
+	template <typename R, typename... Args>
+	void UniqueFunction<R(Args...)>::Reset()
+	{
+		if (ops != nullptr)
+		{
+			ops->destroy(storage);
+			ops = nullptr;
+		}
+	}
+
+	template <typename R, typename... Args>
+	UniqueFunction<R(Args...)>& UniqueFunction<R(Args...)>::operator=(UniqueFunction &&other)
+	{
+		if (this != &other)
+		{
+			Reset();
+			if (other.ops != nullptr)
+			{
+				other.ops->relocate(other.storage, storage);
+				ops = other.ops;
+				other.ops = nullptr;
+			}
+		}
+		return *this;
+	}
+
+	template <typename R, typename... Args>
+	UniqueFunction<R(Args...)>& UniqueFunction<R(Args...)>::operator=(std::nullptr_t)
+	{
+		Reset();
+		return *this;
+	}
+
+	template <typename R, typename... Args>
+	R UniqueFunction<R(Args...)>::operator()(Args... args)
+	{
+		if (ops == nullptr)
+		{
+			throw std::bad_function_call();
+		}
+		return ops->invoke(storage, std::forward<Args>(args)...);
+	}
+
+	template <typename R, typename... Args>
+	UniqueFunction<R(Args...)>::operator bool() const
+	{
+		return ops != nullptr;
+	}
+
+	template <typename R, typename... Args>
+	bool UniqueFunction<R(Args...)>::IsOnHeap() const
+	{
+		return ops != nullptr && ops->onHeap;
+	}
+}
@@ -0,0 +1,223 @@
+#include "pch.h"
+#include "UploadPipeline.h"
+#include "Logger.h"
+#include "Md5.h"
+#include "Trace.h"
+#include "Utf8.h"
+
+using namespace Amplitude;
+
+std::wstring
+Amplitude::ComputeUploadChecksum(const UploadRequest &request)
+{
+	AMPLITUDE_TRACE_SPAN("ComputeUploadChecksum");
+
+	// Hashed a field at a time, rather than concatenating a copy of the
+	// whole batch first.
+	Md5 md5;
+	md5.Update(ToUtf8(request.apiVersion));
+	md5.Update(ToUtf8(request.apiKey));
+	md5.Update(ToUtf8(request.events));
+	md5.Update(ToUtf8(request.uploadTime));
+	return md5.FinishHex();
+}
+
+static const char* StageName(UploadPipeline::Stage stage)
+{
+	static const char *kStageNames[] = { "Idle", "ReadBatch", "Encode", "Checksum", "Send", "AwaitResponse", "Acknowledge", "Delete", "Complete" };
+	return kStageNames[static_cast<int>(stage)];
+}
+
+UploadPipeline::UploadPipeline(IExecutor &executor, IUploadSource &source, IUploadSender &sender, ChecksumFunction checksum, int apiVersion, RuntimeStats &stats) :
+	executor(executor),
+	source(source),
+	sender(sender),
+	checksum(checksum),
+	apiVersion(apiVersion),
+	stats(stats),
+	stage(Stage::Idle),
+	maxCount(-1),
+	uploadTime(0),
+	result(UploadResult::Success),
+	remaining(-1),
+	sendTime(0)
+{
+}
+
+void
+UploadPipeline::SetApiKey(const std::wstring &apiKey)
+{
+	this->apiKey = apiKey;
+}
+
+bool
+UploadPipeline::Start(int64 maxCount, int64 uploadTime, CompletionHandler done)
+{
+	if (IsRunning())
+	{
+		return false;
+	}
+
+	this->maxCount = maxCount;
+	this->uploadTime = uploadTime;
+	this->done = std::move(done);
+	stage = Stage::ReadBatch;
+
+	Resume();
+
+	// An empty batch goes straight back to idle, without completing.
+	if (stage == Stage::Idle && this->done)
+	{
+		this->done = nullptr;
+		return false;
+	}
+
+	return true;
+}
+
+bool
+UploadPipeline::IsRunning() const
+{
+	return stage != Stage::Idle;
+}
+
+UploadPipeline::Stage
+UploadPipeline::GetStage() const
+{
+	return stage;
+}
+
+void
+UploadPipeline::Resume()
+{
+	try
+	{
+		for (;;)
+		{
+			switch (stage)
+			{
+			case Stage::ReadBatch:
+				{
+					AMPLITUDE_TRACE_SPAN("UploadPipeline::ReadBatch");
+					ScopedLatency latency(stats.readLatency);
+					batch = source.ReadBatch(maxCount);
+				}
+				if (batch.maxId == -1)
+				{
+					// Nothing to send; not an attempt, so nobody to tell.
+					stage = Stage::Idle;
+					return;
+				}
+				stage = Stage::Encode;
+				break;
+
+			case Stage::Encode:
+				request.apiVersion = std::to_wstring(apiVersion);
+				request.apiKey = apiKey;
+				request.events = std::move(batch.events);
+				request.uploadTime = std::to_wstring(uploadTime);
+				stage = Stage::Checksum;
+				break;
+
+			case Stage::Checksum:
+				{
+					AMPLITUDE_TRACE_SPAN("UploadPipeline::Checksum");
+					request.checksum = checksum(request);
+				}
+				stage = Stage::Send;
+				break;
+
+			case Stage::Send:
+				// Set before sending, in case the response comes back on
+				// this thread before Send returns.
+				stage = Stage::AwaitResponse;
+				AMPLITUDE_TRACE_MARK(sendTime);
+				stats.uploadAttempts.fetch_add(1, std::memory_order_relaxed);
+				stats.uploadBytes.fetch_add(static_cast<int64>(request.events.size()), std::memory_order_relaxed);
+				sender.Send(request, [this](UploadResult response)
+				{
+					executor.Post([this, response]
+					{
+						result = response;
+						stage = Stage::Acknowledge;
+						Resume();
+					});
+				});
+				return;
+
+			case Stage::AwaitResponse:
+				return;
+
+			case Stage::Acknowledge:
+				AMPLITUDE_TRACE_SINCE("UploadPipeline::AwaitResponse", sendTime);
+				stats.uploadResults[static_cast<int>(result)].fetch_add(1, std::memory_order_relaxed);
+				if (result == UploadResult::Success)
+				{
+					stats.lastUploadSuccessTime.store(uploadTime, std::memory_order_relaxed);
+				}
+				remaining = -1;
+				stage = result == UploadResult::Success ? Stage::Delete : Stage::Complete;
+				break;
+
+			case Stage::Delete:
+				{
+					AMPLITUDE_TRACE_SPAN("UploadPipeline::Delete");
+					ScopedLatency latency(stats.deleteLatency);
+					remaining = source.Delete(batch.maxId);
+				}
+				stage = Stage::Complete;
+				break;
+
+			case Stage::Complete:
+				Finish();
+				return;
+
+			default:
+				return;
+			}
+		}
+	}
+	catch (...)
+	{
+		// Something local went wrong, e.g. reading the batch.  Report it
+		// like an unrecognized response, so that it's retried with backoff
+		// instead of wedging the pipeline.  Whether the retry sends the
+		// batch again depends on how far it got.
+		switch (stage)
+		{
+		case Stage::ReadBatch:
+		case Stage::Encode:
+		case Stage::Checksum:
+			AMPLITUDE_LOG_WARNING((std::string("[Amplitude] Upload failed at ") + StageName(stage) + ", before it could be sent; will retry").c_str());
+			break;
+
+		case Stage::Delete:
+			AMPLITUDE_LOG_WARNING("[Amplitude] Upload was accepted, but deleting the batch failed; its events may be sent again");
+			break;
+
+		default:
+			AMPLITUDE_LOG_WARNING((std::string("[Amplitude] Upload failed at ") + StageName(stage) + ", after it may have been sent; will retry, possibly sending it twice").c_str());
+			break;
+		}
+
+		result = UploadResult::UnknownResponse;
+		remaining = -1;
+		Finish();
+	}
+}
+
+void
+UploadPipeline::Finish()
+{
+	auto handler = std::move(done);
+	done = nullptr;
+
+	batch = UploadBatch();
+	request = UploadRequest();
+	stage = Stage::Idle;
+
+	if (handler)
+	{
+		handler(result, remaining);
+	}
+}
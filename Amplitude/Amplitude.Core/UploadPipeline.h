@@ -0,0 +1,140 @@
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include "Executor.h"
+#include "RetryScheduler.h"
+#include "RuntimeStats.h"
+#include "UniqueFunction.h"
+
+namespace Amplitude
+{
+	// A batch of stored events, read for upload.
+	struct UploadBatch
+	{
+		// The ID of the last event in the batch; -1 if there were none.
+		int64 maxId;
+
+		// The events, as a JSON array.
+		std::wstring events;
+	};
+
+	// The form fields of an upload request.
+	struct UploadRequest
+	{
+		std::wstring apiVersion;
+		std::wstring apiKey;
+		std::wstring events;
+		std::wstring uploadTime;
+		std::wstring checksum;
+	};
+
+	// Where uploaded events come from, and are deleted from once accepted.
+	class IUploadSource
+	{
+	public:
+		virtual ~IUploadSource() {}
+
+		// A negative maxCount means no limit.
+		virtual UploadBatch ReadBatch(int64 maxCount) = 0;
+
+		// Deletes every event up to and including maxId, and returns how many
+		// are left.
+		virtual int64 Delete(int64 maxId) = 0;
+	};
+
+	// Sends an upload request.  'done' may be called on any thread, but must
+	// be called exactly once, whatever happens.
+	class IUploadSender
+	{
+	public:
+		virtual ~IUploadSender() {}
+
+		virtual void Send(const UploadRequest &request, UniqueFunction<void(UploadResult)> done) = 0;
+	};
+
+	typedef std::function<std::wstring(const UploadRequest &request)> ChecksumFunction;
+
+	// The checksum Amplitude expects alongside an upload: the hex MD5 of the
+	// API version, API key, event JSON and upload time, concatenated, in
+	// UTF-8.
+	std::wstring ComputeUploadChecksum(const UploadRequest &request);
+
+	// Uploads one batch of events at a time: read the batch, encode it,
+	// checksum it, send it, acknowledge the response, and delete the batch
+	// if it was accepted.
+	//
+	// Each step runs on the executor.  The only wait is for the response,
+	// after which the sender's callback posts the pipeline back onto the
+	// executor, once, to carry on from where it left off; no thread is tied
+	// up in between, and there are no other hand-offs.  Which step is next
+	// is explicit state, so it's easy to see in a debugger or a trace where
+	// an upload has got to.
+	//
+	// Reading and deleting batches, and what's sent and how it went, are
+	// recorded in 'stats'.
+	//
+	// Not thread-safe; Start must be called on the executor.
+	class UploadPipeline
+	{
+	public:
+		// The result of the attempt, and how many events are still stored
+		// afterwards (-1 if that isn't known, e.g. the attempt failed).
+		typedef UniqueFunction<void(UploadResult result, int64 remaining)> CompletionHandler;
+
+		enum class Stage
+		{
+			Idle,
+			ReadBatch,
+			Encode,
+			Checksum,
+			Send,
+			AwaitResponse,
+			Acknowledge,
+			Delete,
+			Complete
+		};
+
+		UploadPipeline(IExecutor &executor, IUploadSource &source, IUploadSender &sender, ChecksumFunction checksum, int apiVersion, RuntimeStats &stats);
+
+		UploadPipeline(UploadPipeline const&) = delete;
+		UploadPipeline& operator=(UploadPipeline const&) = delete;
+
+		void SetApiKey(const std::wstring &apiKey);
+
+		// Starts uploading up to maxCount events, unless an upload is already
+		// under way.  Returns false, without calling 'done', if there was
+		// nothing to upload or an upload was already running.
+		bool Start(int64 maxCount, int64 uploadTime, CompletionHandler done);
+
+		bool IsRunning() const;
+		Stage GetStage() const;
+
+	private:
+		// Runs steps until the pipeline has to wait or is finished.
+		void Resume();
+		void Finish();
+
+		IExecutor &executor;
+		IUploadSource &source;
+		IUploadSender &sender;
+		const ChecksumFunction checksum;
+		const int apiVersion;
+		RuntimeStats &stats;
+		std::wstring apiKey;
+
+		Stage stage;
+		int64 maxCount;
+		int64 uploadTime;
+		CompletionHandler done;
+
+		UploadBatch batch;
+		UploadRequest request;
+		UploadResult result;
+		int64 remaining;
+
+		// When the request was sent, for tracing.
+		int64 sendTime;
+	};
+}
@@ -0,0 +1,59 @@
+#include "pch.h"
+#include "Utf8.h"
+
+#ifndef _WIN32
+#include <codecvt>
+#include <locale>
+#endif
+
+std::string
+Amplitude::ToUtf8(const wchar_t *str, size_t length)
+{
+	if (length == 0)
+	{
+		return std::string();
+	}
+
+#ifdef _WIN32
+	auto size = WideCharToMultiByte(CP_UTF8, 0, str, static_cast<int>(length), nullptr, 0, nullptr, nullptr);
+	std::string result(size, '\0');
+	WideCharToMultiByte(CP_UTF8, 0, str, static_cast<int>(length), &result[0], size, nullptr, nullptr);
+	return result;
+#else
+	// Rather than throwing on invalid input, gives back a lone replacement
+	// character.
+	std::wstring_convert<std::codecvt_utf8<wchar_t>, wchar_t> converter("\xEF\xBF\xBD", L"\xFFFD");
+	return converter.to_bytes(str, str + length);
+#endif
+}
+
+std::string
+Amplitude::ToUtf8(const std::wstring &str)
+{
+	return ToUtf8(str.data(), str.length());
+}
+
+std::wstring
+Amplitude::FromUtf8(const char *data, size_t size)
+{
+	if (size == 0)
+	{
+		return std::wstring();
+	}
+
+#ifdef _WIN32
+	auto length = MultiByteToWideChar(CP_UTF8, 0, data, static_cast<int>(size), nullptr, 0);
+	std::wstring result(length, L'\0');
+	MultiByteToWideChar(CP_UTF8, 0, data, static_cast<int>(size), &result[0], length);
+	return result;
+#else
+	std::wstring_convert<std::codecvt_utf8<wchar_t>, wchar_t> converter("\xEF\xBF\xBD", L"\xFFFD");
+	return converter.from_bytes(data, data + size);
+#endif
+}
+
+std::wstring
+Amplitude::FromUtf8(const std::string &str)
+{
+	return FromUtf8(str.data(), str.size());
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <string>
+
+namespace Amplitude
+{
+	// Conversions between the wide strings the app hands us and the UTF-8
+	// that SQLite, files and checksums want.  wchar_t is UTF-16 on Windows
+	// and UTF-32 elsewhere; both are handled, surrogate pairs included.
+	std::string ToUtf8(const wchar_t *str, size_t length);
+	std::string ToUtf8(const std::wstring &str);
+
+	std::wstring FromUtf8(const char *data, size_t size);
+	std::wstring FromUtf8(const std::string &str);
+}
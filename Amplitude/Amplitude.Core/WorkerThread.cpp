@@ -0,0 +1,663 @@
+#include "pch.h"
+#include "Logger.h"
+#include "MpscQueue.h"
+#include "OverflowFile.h"
+#include "SynchronizedQueue.h"
+#include "TimerWheel.h"
+#include "Trace.h"
+#include "WorkerThread.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace Amplitude;
+
+// Producers (usually the UI thread) shouldn't have to contend with the
+// worker for a lock on every event, so the lock-free queue is the default.
+// Define AMPLITUDE_LOCKED_WORK_QUEUE to use the mutex-based one instead.
+#ifdef AMPLITUDE_LOCKED_WORK_QUEUE
+typedef SynchronizedQueue<WorkItem> WorkQueue;
+#else
+typedef MpscQueue<WorkItem> WorkQueue;
+#endif
+
+// Capacity of each lane, in WorkPriority order; zero means unbounded.
+static const vector<unsigned int> kLaneSizes = { 0, 1024, 256 };
+
+// How many times in a row a lane may be passed over for a more urgent one.
+static const unsigned int kStarvationLimit = 16;
+
+// The most work items taken off the queue at once.
+static const size_t kMaxBatchSize = 64;
+
+// How hard a producer tries to make room under OverflowPolicy::DropOldest.
+static const int kMaxEvictionAttempts = 64;
+
+class WorkerThread::Impl
+{
+public:
+	Impl(const WorkerThreadOptions &options);
+	~Impl();
+
+	Impl(Impl const&) = delete;
+	Impl(Impl&&) = delete;
+	Impl& operator=(Impl const&) = delete;
+
+	void Start();
+	bool TryAddWorkItem(WorkItem item, WorkPriority priority, SpillFunction spill);
+
+	OverflowStats GetOverflowStats() const;
+	QueueStats GetQueueStats() const;
+
+	TimerId Schedule(WorkItem item, int64 delayMillis);
+	void Cancel(TimerId id);
+
+	bool RunPending(int64 timeoutMillis);
+
+private:
+	const WorkerThreadOptions options;
+
+	std::atomic<bool> running;
+	std::thread thread;
+
+	// A queue of work items; they will be processed in
+	// FIFO order within each priority.
+	WorkQueue queue;
+
+	// Only under OverflowPolicy::Spill.
+	std::unique_ptr<OverflowFile> overflow;
+
+	// Producers waiting for room under OverflowPolicy::Block.
+	std::atomic<int> blockedProducers;
+	std::mutex spaceMutex;
+	std::condition_variable spaceAvailable;
+
+	std::atomic<int64> dropped;
+	std::atomic<int64> evicted;
+	std::atomic<int64> blocked;
+	std::atomic<int64> timedOut;
+	std::atomic<int64> spilled;
+	std::atomic<int64> replayed;
+
+	// The queue's depth is what went in, less what came out; both are
+	// counted here rather than by the queue, so that it stays lean.
+	std::atomic<int64> enqueued;
+	std::atomic<int64> dequeued;
+	std::atomic<int64> peakDepth;
+
+	// Only touched from the worker.
+	TimerWheel timers;
+	std::atomic<TimerId> nextTimerId;
+
+	// The batch being run, and where the worker has got to in it; only
+	// touched from the worker.
+	std::vector<WorkItem> batch;
+	size_t batchPosition;
+
+	static int64 NowMillis();
+	bool IsWorkerThread() const;
+
+	void OnEnqueued();
+	void OnDequeued(size_t count);
+
+	bool TryEvictAndEnqueue(WorkItem &item, unsigned int lane);
+	bool TryEnqueueWithin(WorkItem &item, unsigned int lane, int64 timeoutMillis);
+	bool TrySpill(SpillFunction &spill);
+
+	void ProcessQueue();
+	void RunBatch();
+	void RunWorkItem(WorkItem &fn);
+	void ReplaySpilledItems();
+	void NotifySpaceAvailable();
+	void RunExpiredTimers();
+};
+
+WorkerThreadOptions::WorkerThreadOptions() :
+	policy(OverflowPolicy::DropNewest),
+	blockTimeoutMillis(0)
+{
+}
+
+WorkerThread::Impl::Impl(const WorkerThreadOptions &options) :
+	options(options),
+	thread(),
+	queue(kLaneSizes, kStarvationLimit),
+	blockedProducers(0),
+	dropped(0),
+	evicted(0),
+	blocked(0),
+	timedOut(0),
+	spilled(0),
+	replayed(0),
+	enqueued(0),
+	dequeued(0),
+	peakDepth(0),
+	timers(NowMillis()),
+	nextTimerId(1),
+	batchPosition(0)
+{
+	if (options.policy == OverflowPolicy::Spill)
+	{
+		overflow = std::make_unique<OverflowFile>(options.spillPath);
+	}
+}
+
+WorkerThread::Impl::~Impl()
+{
+	running.store(false);
+	queue.Complete();
+	{
+		// Don't leave anyone waiting for room that will never come.
+		std::lock_guard<std::mutex> lock(spaceMutex);
+		spaceAvailable.notify_all();
+	}
+
+	try
+	{
+		if (thread.joinable())
+		{
+			thread.join();
+		}
+	}
+	catch (const std::exception& ex)
+	{
+		AMPLITUDE_LOG_ERROR(ex.what());
+	}
+#ifdef __cplusplus_winrt
+	catch (Platform::Exception ^ex)
+	{
+		AMPLITUDE_LOG_ERROR(ex->ToString()->Data());
+	}
+#endif
+	catch (...)
+	{
+		AMPLITUDE_LOG_ERROR("CRITICAL ERROR: Something was thrown from a work queue, but was not an exception!!!");
+	}
+}
+
+void
+WorkerThread::Impl::Start()
+{
+	running.store(true);
+	thread = std::thread(&Impl::ProcessQueue, this);
+}
+
+bool
+WorkerThread::Impl::TryAddWorkItem(WorkItem item, WorkPriority priority, SpillFunction spill)
+{
+	if (!running.load())
+	{
+		return false;
+	}
+
+	auto lane = static_cast<unsigned int>(priority);
+	if (queue.TryEnqueue(std::move(item), lane))
+	{
+		OnEnqueued();
+		return true;
+	}
+
+	// The queue only leaves the item alone when it refuses it, so we
+	// still have it here.
+	auto accepted = false;
+	switch (options.policy)
+	{
+	case OverflowPolicy::DropOldest:
+		accepted = TryEvictAndEnqueue(item, lane);
+		break;
+
+	case OverflowPolicy::Block:
+		// The worker can't wait for itself to make room.
+		if (!IsWorkerThread())
+		{
+			accepted = TryEnqueueWithin(item, lane, options.blockTimeoutMillis);
+		}
+		break;
+
+	case OverflowPolicy::Spill:
+		accepted = TrySpill(spill);
+		break;
+
+	default:
+		break;
+	}
+
+	if (!accepted)
+	{
+		dropped++;
+	}
+
+	return accepted;
+}
+
+void
+WorkerThread::Impl::OnEnqueued()
+{
+	auto depth = enqueued.fetch_add(1, std::memory_order_relaxed) + 1
+		- dequeued.load(std::memory_order_relaxed)
+		- evicted.load(std::memory_order_relaxed);
+
+	// Only contended while the peak is still climbing.
+	auto peak = peakDepth.load(std::memory_order_relaxed);
+	while (depth > peak && !peakDepth.compare_exchange_weak(peak, depth, std::memory_order_relaxed))
+	{
+	}
+}
+
+void
+WorkerThread::Impl::OnDequeued(size_t count)
+{
+	dequeued.fetch_add(static_cast<int64>(count), std::memory_order_relaxed);
+}
+
+bool
+WorkerThread::Impl::TryEvictAndEnqueue(WorkItem &item, unsigned int lane)
+{
+	// Other producers are after the same room, so this can take a few goes;
+	// each one makes some room, though, so it won't take many.
+	for (int attempt = 0; attempt < kMaxEvictionAttempts; ++attempt)
+	{
+		WorkItem oldest;
+		if (queue.TryEvictOldest(lane, oldest))
+		{
+			evicted++;
+		}
+
+		if (queue.TryEnqueue(std::move(item), lane))
+		{
+			OnEnqueued();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool
+WorkerThread::Impl::TryEnqueueWithin(WorkItem &item, unsigned int lane, int64 timeoutMillis)
+{
+	blocked++;
+
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMillis);
+	std::unique_lock<std::mutex> lock(spaceMutex);
+
+	// Announce ourselves before trying again; pairs with the fence in
+	// NotifySpaceAvailable, so either the worker sees us or we see the
+	// room it made.
+	blockedProducers++;
+
+	auto accepted = false;
+	while (running.load())
+	{
+		if (queue.TryEnqueue(std::move(item), lane))
+		{
+			accepted = true;
+			break;
+		}
+
+		if (spaceAvailable.wait_until(lock, deadline) == std::cv_status::timeout)
+		{
+			accepted = queue.TryEnqueue(std::move(item), lane);
+			break;
+		}
+	}
+
+	blockedProducers--;
+
+	if (accepted)
+	{
+		OnEnqueued();
+	}
+	else
+	{
+		timedOut++;
+	}
+
+	return accepted;
+}
+
+bool
+WorkerThread::Impl::TrySpill(SpillFunction &spill)
+{
+	if (overflow == nullptr || !spill)
+	{
+		return false;
+	}
+
+	if (!overflow->Append(spill()))
+	{
+		return false;
+	}
+
+	spilled++;
+	return true;
+}
+
+void
+WorkerThread::Impl::NotifySpaceAvailable()
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (blockedProducers.load() > 0)
+	{
+		std::lock_guard<std::mutex> lock(spaceMutex);
+		spaceAvailable.notify_all();
+	}
+}
+
+OverflowStats
+WorkerThread::Impl::GetOverflowStats() const
+{
+	OverflowStats stats;
+	stats.dropped = dropped.load();
+	stats.evicted = evicted.load();
+	stats.blocked = blocked.load();
+	stats.timedOut = timedOut.load();
+	stats.spilled = spilled.load();
+	stats.replayed = replayed.load();
+	return stats;
+}
+
+QueueStats
+WorkerThread::Impl::GetQueueStats() const
+{
+	QueueStats stats;
+	stats.enqueued = enqueued.load(std::memory_order_relaxed);
+
+	// The counters are read one after another, so this can be off by an
+	// item or two while producers are busy; never below zero, though.
+	stats.depth = std::max(0LL, stats.enqueued - dequeued.load(std::memory_order_relaxed) - evicted.load(std::memory_order_relaxed));
+	stats.peakDepth = peakDepth.load(std::memory_order_relaxed);
+	return stats;
+}
+
+void
+WorkerThread::Impl::ProcessQueue()
+{
+	AMPLITUDE_TRACE_THREAD_NAME("Amplitude worker");
+
+	// Take whatever has piled up in one go, rather than paying for a trip
+	// through the queue per item.
+	batch.reserve(kMaxBatchSize);
+
+	for (;;)
+	{
+		// Wait for work, or for the next timer, whichever comes first.
+		auto nextDeadline = timers.GetNextDeadline();
+		auto count = nextDeadline < 0
+			? queue.DrainTo(batch, kMaxBatchSize)
+			: queue.DrainUntil(batch, kMaxBatchSize, std::chrono::steady_clock::time_point(std::chrono::milliseconds(nextDeadline)));
+
+		if (count == 0 && !running.load())
+		{
+			break;
+		}
+
+		if (count > 0)
+		{
+			OnDequeued(count);
+			NotifySpaceAvailable();
+		}
+
+		RunBatch();
+
+		RunExpiredTimers();
+
+		// A short batch means we've caught up; bring back anything that
+		// overflowed in the meantime.
+		if (count < kMaxBatchSize && overflow != nullptr && overflow->HasRecords())
+		{
+			ReplaySpilledItems();
+		}
+	}
+}
+
+int64
+WorkerThread::Impl::NowMillis()
+{
+	auto now = std::chrono::steady_clock::now().time_since_epoch();
+	return std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
+}
+
+bool
+WorkerThread::Impl::IsWorkerThread() const
+{
+	return std::this_thread::get_id() == thread.get_id();
+}
+
+TimerId
+WorkerThread::Impl::Schedule(WorkItem item, int64 delayMillis)
+{
+	if (!running.load())
+	{
+		return 0;
+	}
+
+	// The delay counts from now, not from when the worker gets to it.  The
+	// clock is truncated to whole milliseconds, so round up, or the item
+	// could run up to a millisecond early.
+	auto id = nextTimerId++;
+	auto deadline = NowMillis() + std::max(0LL, delayMillis) + 1;
+
+	if (IsWorkerThread())
+	{
+		timers.Add(id, deadline, std::move(item));
+		return id;
+	}
+
+	// Lambdas can't capture by move here, so share it instead.
+	auto shared = std::make_shared<WorkItem>(std::move(item));
+	auto posted = TryAddWorkItem([this, id, deadline, shared]
+	{
+		timers.Add(id, deadline, std::move(*shared));
+	}, WorkPriority::Critical, nullptr);
+
+	return posted ? id : 0;
+}
+
+void
+WorkerThread::Impl::Cancel(TimerId id)
+{
+	if (id == 0)
+	{
+		return;
+	}
+
+	if (IsWorkerThread())
+	{
+		timers.Cancel(id);
+		return;
+	}
+
+	TryAddWorkItem([this, id]
+	{
+		timers.Cancel(id);
+	}, WorkPriority::Critical, nullptr);
+}
+
+bool
+WorkerThread::Impl::RunPending(int64 timeoutMillis)
+{
+	if (!IsWorkerThread())
+	{
+		return false;
+	}
+
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(std::max(0LL, timeoutMillis));
+
+	for (;;)
+	{
+		// First the rest of the batch we're in the middle of, which was
+		// queued before us; the worker finds it done when we return.
+		while (batchPosition < batch.size())
+		{
+			if (std::chrono::steady_clock::now() >= deadline)
+			{
+				return false;
+			}
+			auto fn = std::move(batch[batchPosition++]);
+			RunWorkItem(fn);
+		}
+		batch.clear();
+		batchPosition = 0;
+
+		auto now = std::chrono::steady_clock::now();
+		if (now >= deadline)
+		{
+			return false;
+		}
+
+		// Don't wait for more; only take what is already there.
+		auto count = queue.DrainUntil(batch, kMaxBatchSize, now);
+		if (count == 0)
+		{
+			break;
+		}
+
+		OnDequeued(count);
+		NotifySpaceAvailable();
+	}
+
+	if (overflow != nullptr && overflow->HasRecords())
+	{
+		ReplaySpilledItems();
+	}
+
+	return true;
+}
+
+void
+WorkerThread::Impl::RunExpiredTimers()
+{
+	std::vector<WorkItem> expired;
+	timers.Advance(NowMillis(), expired);
+
+	for (auto &fn : expired)
+	{
+		RunWorkItem(fn);
+	}
+}
+
+void
+WorkerThread::Impl::ReplaySpilledItems()
+{
+	std::vector<std::wstring> records;
+	overflow->TakeAll(records);
+	if (records.empty() || !options.replaySpilled)
+	{
+		return;
+	}
+
+	replayed += static_cast<int64>(records.size());
+
+	WorkItem replay = [this, &records]
+	{
+		options.replaySpilled(std::move(records));
+	};
+	RunWorkItem(replay);
+}
+
+void
+WorkerThread::Impl::RunBatch()
+{
+	AMPLITUDE_TRACE_SPAN("WorkerThread::RunBatch");
+
+	// RunPending may run some of the batch itself, further down, and
+	// refill it; so each item is taken out of the batch before it runs.
+	batchPosition = 0;
+	while (batchPosition < batch.size())
+	{
+		auto fn = std::move(batch[batchPosition++]);
+		RunWorkItem(fn);
+	}
+	batch.clear();
+	batchPosition = 0;
+}
+
+void
+WorkerThread::Impl::RunWorkItem(WorkItem &fn)
+{
+	try
+	{
+		fn();
+	}
+#ifdef __cplusplus_winrt
+	catch (Platform::Exception ^ex)
+	{
+		AMPLITUDE_LOG_ERROR(ex->Message->Data());
+	}
+#endif
+	catch (const std::exception &ex)
+	{
+		AMPLITUDE_LOG_ERROR(ex.what());
+	}
+	catch (...)
+	{
+		AMPLITUDE_LOG_ERROR("neither fish nor fowl.");
+	}
+}
+
+WorkerThread::WorkerThread() : impl(std::make_unique<Impl>(WorkerThreadOptions()))
+{
+	impl->Start();
+}
+
+WorkerThread::WorkerThread(const WorkerThreadOptions &options) : impl(std::make_unique<Impl>(options))
+{
+	impl->Start();
+}
+
+WorkerThread::~WorkerThread()
+{
+}
+
+bool
+WorkerThread::TryAddWorkItem(WorkItem item, WorkPriority priority)
+{
+	return impl->TryAddWorkItem(std::move(item), priority, nullptr);
+}
+
+bool
+WorkerThread::TryAddWorkItem(WorkItem item, WorkPriority priority, SpillFunction spill)
+{
+	return impl->TryAddWorkItem(std::move(item), priority, std::move(spill));
+}
+
+OverflowStats
+WorkerThread::GetOverflowStats() const
+{
+	return impl->GetOverflowStats();
+}
+
+QueueStats
+WorkerThread::GetQueueStats() const
+{
+	return impl->GetQueueStats();
+}
+
+TimerId
+WorkerThread::Schedule(WorkItem item, int64 delayMillis)
+{
+	return impl->Schedule(std::move(item), delayMillis);
+}
+
+void
+WorkerThread::Cancel(TimerId id)
+{
+	impl->Cancel(id);
+}
+
+bool
+WorkerThread::RunPending(int64 timeoutMillis)
+{
+	return impl->RunPending(timeoutMillis);
+}
+
+bool
+WorkerThread::Post(WorkItem item)
+{
+	return impl->TryAddWorkItem(std::move(item), WorkPriority::Critical, nullptr);
+}
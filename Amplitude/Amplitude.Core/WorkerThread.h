@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Executor.h"
+#include "UniqueFunction.h"
+
+namespace Amplitude
+{
+	// Work items are processed most-urgent first, except that less urgent
+	// items are guaranteed a turn every so often, so they can't starve.
+	enum class WorkPriority
+	{
+		// Never dropped for lack of space, e.g. session bookkeeping.
+		Critical = 0,
+
+		// Ordinary events.
+		Normal = 1,
+
+		// Housekeeping that can be retried or coalesced, e.g. upload kicks.
+		Background = 2
+	};
+
+	// Describes a work item, in one line, if it has to spill to disk.
+	typedef UniqueFunction<std::wstring()> SpillFunction;
+
+	// Identifies a scheduled work item; zero is never used.
+	typedef uint64_t TimerId;
+
+	// What to do with a work item when its lane is full.  Critical items
+	// have an unbounded lane, so this only applies to the others.
+	enum class OverflowPolicy
+	{
+		// Refuse the new item.
+		DropNewest,
+
+		// Discard the oldest item in the lane to make room.
+		DropOldest,
+
+		// Wait up to a timeout for the worker to make room, then refuse.
+		// The worker itself never waits.
+		Block,
+
+		// Write the item to an overflow file, which the worker replays once
+		// it has caught up.  Items that can't be written out are refused.
+		Spill
+	};
+
+	struct WorkerThreadOptions
+	{
+		WorkerThreadOptions();
+
+		OverflowPolicy policy;
+
+		// For OverflowPolicy::Block.
+		int64 blockTimeoutMillis;
+
+		// For OverflowPolicy::Spill: where spilled items go, and what to do
+		// with them when they come back.  The handler runs on the worker.
+		std::wstring spillPath;
+		std::function<void(std::vector<std::wstring>&&)> replaySpilled;
+	};
+
+	// Counts of work items affected by the overflow policy.
+	struct OverflowStats
+	{
+		// Refused, whatever the policy.
+		int64 dropped;
+
+		// Discarded under DropOldest.
+		int64 evicted;
+
+		// Had to wait under Block, and how many of those then gave up.
+		int64 blocked;
+		int64 timedOut;
+
+		// Written to and read back from the overflow file under Spill.
+		int64 spilled;
+		int64 replayed;
+	};
+
+	// How busy the queue is.
+	struct QueueStats
+	{
+		// Work items accepted into the queue, ever.
+		int64 enqueued;
+
+		// Waiting in the queue now, and the most there have ever been.
+		int64 depth;
+		int64 peakDepth;
+	};
+
+	class WorkerThread : public IExecutor
+	{		
+	public:
+		WorkerThread();
+		WorkerThread(const WorkerThreadOptions &options);
+		~WorkerThread();
+
+		WorkerThread(WorkerThread const&) = delete;
+		WorkerThread(WorkerThread&&) = delete;
+		WorkerThread& operator=(WorkerThread const&) = delete;
+
+		bool TryAddWorkItem(WorkItem item, WorkPriority priority = WorkPriority::Normal);
+
+		// Under OverflowPolicy::Spill, 'spill' is asked for a one-line
+		// record of the item if it doesn't fit in the queue; it's never
+		// called otherwise.  Returns true if the item was queued or spilled.
+		bool TryAddWorkItem(WorkItem item, WorkPriority priority, SpillFunction spill);
+
+		OverflowStats GetOverflowStats() const;
+		QueueStats GetQueueStats() const;
+
+		// As an executor, queues at WorkPriority::Critical; whatever is
+		// posted is usually the rest of something already under way.
+		bool Post(WorkItem item) override;
+
+		// Runs 'item' on the worker once 'delayMillis' have passed.  The
+		// worker keeps its own timers and wakes up for them, so this is cheap
+		// and the item runs alongside everything else the worker does.  May
+		// be called from any thread; returns zero if the worker has stopped.
+		TimerId Schedule(WorkItem item, int64 delayMillis);
+
+		// Does nothing if the timer has already fired.  From any thread but
+		// the worker, this takes effect once the worker gets to it, after
+		// anything that thread queued (or scheduled) before.
+		void Cancel(TimerId id);
+
+		// From a work item, runs everything queued behind it (and anything
+		// that spilled) there and then, until the queue is empty or
+		// 'timeoutMillis' have passed.  Timers are left alone.  Returns false
+		// if it ran out of time, or isn't on the worker.
+		bool RunPending(int64 timeoutMillis);
+
+	private:
+		class Impl;
+		std::unique_ptr<Impl> impl;
+	};
+}
\ No newline at end of file
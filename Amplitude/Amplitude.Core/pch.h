@@ -0,0 +1,17 @@
+#pragma once
+
+// The core's prefix header, for building it on its own, e.g. with CMake on
+// Linux.  The Windows projects precompile Amplitude.Shared's pch.h instead,
+// which provides the same and more.
+#ifndef __cplusplus_winrt
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+#include <sqlite3.h>
+
+typedef long long int64;
+
+#endif
@@ -1,20 +1,41 @@
 ﻿#include "pch.h"
 
+#include "Aggregator.h"
+#include "Clock.h"
 #include "constants.h"
 #include "Database.h"
+#include "EventCoalescer.h"
+#include "FlushReport.h"
+#include "GlobalProperties.h"
 #include "Settings.h"
+#include "Trace.h"
 #include "EventReporter.h"
+#include "IngestionFilter.h"
+#include "Logger.h"
+#include "RetryScheduler.h"
+#include "RuntimeStats.h"
+#include "SessionTracker.h"
+#include "UploadPipeline.h"
+#include "UploadTransport.h"
 #include "WorkerThread.h"
 
 #include <ppltasks.h>
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <condition_variable>
 #include <cstdio>
+#include <deque>
 #include <iostream>
 #include <mutex>
+#include <random>
 #include <sstream>
 #include <string>
 #include <unordered_set>
+#include <vector>
 
 #if WINAPI_FAMILY == WINAPI_FAMILY_PHONE_APP
 #define CLIENT_NAME L"Windows Phone"
@@ -36,75 +57,275 @@ using namespace concurrency;
 
 using Windows::Data::Json::IJsonValue;
 using Windows::Data::Json::JsonValue;
+using Windows::Data::Json::JsonValueType;
 using Windows::Foundation::PropertyValue;
-using Windows::Foundation::TimeSpan;
-using Windows::Security::Cryptography::BinaryStringEncoding;
-using Windows::Security::Cryptography::CryptographicBuffer;
-using Windows::Security::Cryptography::Core::HashAlgorithmNames;
-using Windows::Security::Cryptography::Core::HashAlgorithmProvider;
 using Windows::Storage::ApplicationData;
 using Windows::Storage::ApplicationDataCreateDisposition;
-using Windows::System::Threading::ThreadPoolTimer;
-using Windows::System::Threading::TimerElapsedHandler;
-using Windows::Web::Http::HttpClient;
-using Windows::Web::Http::HttpFormUrlEncodedContent;
-using Windows::Web::Http::HttpResponseMessage;
 
 static JsonObject ^ const EMPTY = ref new JsonObject();
 
 // Runtime-configurable values
 
-static int64 gSessionId;
 static int64 gSessionTimeoutMillis;
 
-static bool gSessionOpen;
 
-static std::atomic<bool> gUpdateScheduled;
-static std::atomic<bool> gUploadingCurrently;
+// Only touched from logThread.
+static RetryScheduler gRetryScheduler;
+
+static IngestionFilter gIngestionFilter;
+
+static GlobalProperties gGlobalProperties;
+
+static Aggregator gAggregator;
+
+static RuntimeStats gStats;
+
+// Only touched from logThread.
+static EventCoalescer gCoalescer;
+static bool gCoalesceFlushScheduled;
 
 static Settings *gSettings;
 
+// The device ID, once it has been resolved; null until then.  Only touched
+// from logThread.
+static String ^gDeviceId;
+
+// Events of sampled types that were logged before the device ID was known,
+// as what logs each of them; OnDeviceIdResolved decides.  A flush leaves
+// them be.  No more than DEFERRED_EVENT_MAX_COUNT are kept, the oldest
+// going first, as in the store.  Only touched from logThread.
+static std::deque<std::function<void()>> gDeferredEvents;
+static std::atomic<int64> gDeferredDroppedCount;
+
+// Runs 'log' if this device's sample keeps the event, once that's known.
+static void LogSampledEvent(String ^eventName, std::function<void()> log)
+{
+	if (gDeviceId == nullptr)
+	{
+		if (gDeferredEvents.size() >= static_cast<size_t>(DEFERRED_EVENT_MAX_COUNT))
+		{
+			gDeferredEvents.pop_front();
+			gDeferredDroppedCount.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		gDeferredEvents.push_back([eventName, log]
+		{
+			LogSampledEvent(eventName, log);
+		});
+		return;
+	}
+
+	if (gIngestionFilter.AdmitDeferred(eventName->Data(), eventName->Length()))
+	{
+		log();
+	}
+}
+
+// Stands in for the device ID in events built before it's resolved, until
+// OnDeviceIdResolved patches the real one in.
+static String ^ const PENDING_DEVICE_ID = L"$pending_device_id$";
+
+// Resolves the device ID on the worker, after a first attempt has failed.
+// If it fails again, the ID from an earlier run is used, or failing that,
+// one is made up for this run, marked as random as Settings marks its own;
+// without one, nothing would ever be uploaded.
+static String^ ResolveDeviceIdOrFallBack()
+{
+	try
+	{
+		return gSettings->GetDeviceId();
+	}
+	catch (Exception ^ex)
+	{
+		AMPLITUDE_LOG_WARNING(ex->ToString()->Data());
+	}
+
+	try
+	{
+		auto stored = gSettings->GetStoredDeviceId();
+		if (stored != nullptr)
+		{
+			return stored;
+		}
+	}
+	catch (Exception ^ex)
+	{
+		AMPLITUDE_LOG_WARNING(ex->ToString()->Data());
+	}
+
+	GUID guid;
+	if (FAILED(CoCreateGuid(&guid)))
+	{
+		std::random_device random;
+		guid.Data1 = random();
+		guid.Data2 = static_cast<unsigned short>(random());
+		guid.Data3 = static_cast<unsigned short>(random());
+		for (auto &byte : guid.Data4)
+		{
+			byte = static_cast<unsigned char>(random());
+		}
+	}
+
+	AMPLITUDE_LOG_WARNING("[Amplitude] Could not resolve a device ID; using a random one for this run");
+	return String::Concat(Guid(guid).ToString(), "R");
+}
+
+// Only touched from logThread.
+static std::unique_ptr<SessionTracker> gSession;
+
 static String ^gDatabasePath;
 static String ^gApiKey;
 
 static unique_ptr<WorkerThread> logThread;
 
-static ThreadPoolTimer ^sessionEndTimer = nullptr;
+// Only touched from logThread.
+static std::unique_ptr<DatabaseUploadSource> gUploadSource;
+static std::unique_ptr<TransportUploadSender> gUploadSender;
+static std::unique_ptr<UploadPipeline> gUploadPipeline;
 
-int64
-GetCurrentDateAsJavaMillis()
+// While a session_end is held, the ID of the last event stored before it;
+// it's stored there once it's committed, and uploads stop short of the
+// events after it until then.  -1 if it isn't known, e.g. for a session
+// ending when the app last went away.  Only touched from logThread.
+static int64 gSessionEndAfterId = -1;
+
+// Timers on logThread; only touched from there.
+static TimerId gSessionEndTimer;
+static TimerId gUploadTimer;
+static int64 gUploadTimerDeadline;
+static TimerId gPurgeTimer;
+
+// Zero when events don't expire.  Only touched from logThread.
+static int64 gEventTimeToLiveMillis;
+
+// While a flush is under way, everything is written through its connection,
+// in its one transaction.  Only touched from logThread.
+static std::shared_ptr<Database> gFlushDatabase;
+static int64 gFlushedEventCount;
+
+struct Amplitude::FlushProgress
 {
-	SYSTEMTIME systime;
-	GetSystemTime(&systime);
+	FlushProgress() :
+		finished(false),
+		eventsPersisted(0),
+		eventsStored(-1),
+		completed(false),
+		uploading(false)
+	{
+	}
 
-	FILETIME filetime;
-	SystemTimeToFileTime(&systime, &filetime);
+	std::mutex mutex;
+	std::condition_variable done;
 
-	LARGE_INTEGER date, adjust;
-	date.HighPart = filetime.dwHighDateTime;
-	date.LowPart = filetime.dwLowDateTime;
+	bool finished;
+	int64 eventsPersisted;
+	int64 eventsStored;
+	bool completed;
+	bool uploading;
+};
+
+struct Amplitude::BatchedEvent
+{
+	String ^name;
+	JsonObject ^properties;
+	int64 timestamp;
 
-	// 100-nanoseconds = milliseconds * 10000
-	adjust.QuadPart = 11644473600000 * 10000;
+	// When it was stamped, on Clock::MonotonicMillis().
+	int64 monotonic;
 
-	// removes the diff between UNIX epoch and MS epoch (1970 - 1601, in 100-nanoseconds)
-	date.QuadPart -= adjust.QuadPart;
+	// Sampled, but logged before the device ID was known.
+	bool deferred;
 
-	// converts from 100-nanoseconds to millis
-	return date.QuadPart / 10000;
+	// Stamped with a timestamp of its own rather than when it was logged,
+	// e.g. replayed from an offline session.
+	bool backdated;
+};
+
+static std::shared_ptr<Database> OpenDatabase()
+{
+	if (gFlushDatabase != nullptr)
+	{
+		return gFlushDatabase;
+	}
+	return std::make_shared<Database>(gDatabasePath->Data());
+}
+
+static String^ ToPlatformString(const std::wstring &str)
+{
+	return ref new String(str.data(), static_cast<unsigned int>(str.length()));
+}
+
+static IJsonValue^ ToJsonNumber(int64 value)
+{
+	return JsonValue::CreateNumberValue(static_cast<double>(value));
 }
 
-static ThreadPoolTimer^ RunDelayed(std::function<void()> fn, int64 delayInMillis)
+static JsonObject^ ToJson(const LatencyHistogram &histogram)
 {
-	TimeSpan delay;
-	delay.Duration = delayInMillis * 10000;
+	auto snapshot = histogram.GetSnapshot();
 
-	auto handler = ref new TimerElapsedHandler([=](ThreadPoolTimer ^ignored)
+	auto bounds = ref new JsonArray();
+	auto buckets = ref new JsonArray();
+	for (int i = 0; i < LatencyHistogram::kBuckets; ++i)
 	{
-		fn();
-	});
+		// The last bucket has no upper bound.
+		if (i < LatencyHistogram::kBuckets - 1)
+		{
+			bounds->Append(ToJsonNumber(LatencyHistogram::GetBucketBound(i)));
+		}
+		buckets->Append(ToJsonNumber(snapshot.buckets[i]));
+	}
+
+	auto obj = ref new JsonObject();
+	obj->Insert("count", ToJsonNumber(snapshot.count));
+	obj->Insert("total_us", ToJsonNumber(snapshot.totalMicros));
+	obj->Insert("max_us", ToJsonNumber(snapshot.maxMicros));
+	obj->Insert("bucket_bounds_us", bounds);
+	obj->Insert("buckets", buckets);
+	return obj;
+}
+
+static std::wstring SerializeProperties(JsonObject ^properties)
+{
+	return properties == nullptr ? std::wstring(L"{}") : std::wstring(properties->Stringify()->Data());
+}
 
-	return ThreadPoolTimer::CreateTimer(handler, delay);
+// Adds a member that's JSON already to the end of a serialized, non-empty
+// object, without parsing either of them again.
+static std::wstring AppendMember(String ^object, const wchar_t *name, const std::wstring &json)
+{
+	std::wstring result(object->Data(), object->Length() - 1);
+	result.append(L",\"");
+	result.append(name);
+	result.append(L"\":");
+	result.append(json);
+	result.push_back(L'}');
+	return result;
+}
+
+// Events that don't fit in the work queue are written out as records of the
+// form {"events": [...], "global_properties": {...}}, to be replayed later.
+static JsonObject^ MakeSpilledEvent(String ^eventName, JsonObject ^eventProperties, JsonObject ^apiProperties, int64 timestamp, int64 monotonic, bool checkSession, bool deferred)
+{
+	auto obj = ref new JsonObject();
+	obj->Insert("event_type", JsonValue::CreateStringValue(eventName));
+	obj->Insert("properties", eventProperties == nullptr ? EMPTY : eventProperties);
+	obj->Insert("api_properties", apiProperties == nullptr ? EMPTY : apiProperties);
+	obj->Insert("timestamp", JsonValue::CreateStringValue(timestamp.ToString()));
+	obj->Insert("monotonic", JsonValue::CreateStringValue(monotonic.ToString()));
+	obj->Insert("check_session", JsonValue::CreateBooleanValue(checkSession));
+	if (deferred)
+	{
+		obj->Insert("deferred", JsonValue::CreateBooleanValue(true));
+	}
+	return obj;
+}
+
+static std::wstring MakeSpillRecord(JsonArray ^events, const std::wstring &globalProperties)
+{
+	auto record = ref new JsonObject();
+	record->Insert("events", events);
+	return AppendMember(record->Stringify(), L"global_properties", globalProperties);
 }
 
 void
@@ -113,47 +334,144 @@ EventReporter::Initialize(String ^apiKey)
 	static std::once_flag init;
 	std::call_once(init, [apiKey]
 	{
-		gUpdateScheduled.store(false);
-		gUploadingCurrently.store(false);
-
 		auto currentApp = ApplicationData::Current;
 		auto localSettings = currentApp->LocalSettings;
 		auto container = localSettings->CreateContainer(PREF_CONTAINER_NAME, ApplicationDataCreateDisposition::Always);
 		gSettings = new Settings(container);
-		gDatabasePath = ApplicationData::Current->LocalFolder->Path + L"\\amplitude.db";
+
+		// Sample by the ID from an earlier run, if there was one, while this
+		// run's is resolved; only the very first run has to defer.
+		auto storedDeviceId = gSettings->GetStoredDeviceId();
+		if (storedDeviceId != nullptr)
+		{
+			gIngestionFilter.SetDeviceId(storedDeviceId->Data());
+		}
+		gSession = std::make_unique<SessionTracker>(*gSettings, MIN_TIME_BETWEEN_SESSIONS_MILLIS, SESSION_TIMEOUT_MILLIS);
+
+		Database::SetTempDirectory(currentApp->TemporaryFolder->Path->Data());
+		gDatabasePath = currentApp->LocalFolder->Path + L"\\amplitude.db";
 
 		gApiKey = apiKey;
 
-		logThread = std::make_unique<WorkerThread>();
+		// Rather than lose events in a burst, park the excess on disk.
+		WorkerThreadOptions options;
+		options.policy = OverflowPolicy::Spill;
+		options.spillPath = std::wstring(ApplicationData::Current->LocalFolder->Path->Data()) + L"\\amplitude_overflow.txt";
+		options.replaySpilled = ReplaySpilledEvents;
+
+		logThread = std::make_unique<WorkerThread>(options);
+
+		// Uploads hold everything back until the events stored without a
+		// device ID have been patched, and leave expired events out.
+		gUploadSource = std::make_unique<DatabaseUploadSource>(OpenDatabase, []
+		{
+			if (gDeviceId == nullptr)
+			{
+				return 0LL;
+			}
+			return gSessionEndAfterId >= 0 ? gSessionEndAfterId + 1 : -1LL;
+		}, []
+		{
+			return gEventTimeToLiveMillis > 0 ? Clock::NowMillis() - gEventTimeToLiveMillis : LLONG_MIN;
+		});
+		gUploadSender = std::make_unique<TransportUploadSender>(std::make_shared<HttpUploadTransport>());
+		gUploadPipeline = std::make_unique<UploadPipeline>(
+			*logThread,
+			*gUploadSource,
+			*gUploadSender,
+			[](const UploadRequest &request) { return ComputeUploadChecksum(request); },
+			API_VERSION,
+			gStats);
+		gUploadPipeline->SetApiKey(apiKey->Data());
+
+		// The app may have gone away while a session was ending.
+		if (gSession->GetState() == SessionState::Ending)
+		{
+			logThread->TryAddWorkItem([]
+			{
+				ScheduleSessionEndExpiry();
+			}, WorkPriority::Critical);
+		}
+
+		// The first time, resolving the device ID can take several platform
+		// calls; don't make the caller, or the first events, wait for it.
+		create_task([]
+		{
+			return gSettings->GetDeviceId();
+		}).then([](task<String^> resolved)
+		{
+			try
+			{
+				auto deviceId = resolved.get();
+				logThread->TryAddWorkItem([deviceId]
+				{
+					OnDeviceIdResolved(deviceId);
+				}, WorkPriority::Critical);
+			}
+			catch (Exception ^ex)
+			{
+				// Let the worker have another go, and fall back if that
+				// fails too.
+				AMPLITUDE_LOG_WARNING(ex->ToString()->Data());
+				logThread->TryAddWorkItem([]
+				{
+					OnDeviceIdResolved(ResolveDeviceIdOrFallBack());
+				}, WorkPriority::Critical);
+			}
+		});
 	});
 }
 
+task<std::shared_ptr<IUploadTransport>>
+EventReporter::SetUploadTransport(std::shared_ptr<IUploadTransport> transport)
+{
+	REQUIRE_API_KEY("SetUploadTransport()");
+
+	if (transport == nullptr)
+	{
+		throw ref new InvalidArgumentException("Transport can not be null");
+	}
+
+	task_completion_event<std::shared_ptr<IUploadTransport>> replaced;
+	auto posted = logThread->TryAddWorkItem([transport, replaced]
+	{
+		replaced.set(gUploadSender->SetTransport(transport));
+	}, WorkPriority::Critical);
+
+	if (!posted)
+	{
+		throw ref new FailureException("Upload transport could not be replaced");
+	}
+
+	return create_task(replaced);
+}
+
 void
 EventReporter::StartSession()
 {
 	REQUIRE_API_KEY("StartSession()");
 
-	auto now = GetCurrentDateAsJavaMillis();
-	logThread->TryAddWorkItem([now]
+	// The app may have been suspended for a while; don't wait for the
+	// clock to notice if it was set meanwhile.
+	Clock::Recalibrate();
+
+	auto now = Clock::NowMillis();
+	auto monotonic = Clock::MonotonicMillis();
+	logThread->TryAddWorkItem([now, monotonic]
 	{
-		auto timer = sessionEndTimer;
-		if (timer != nullptr)
-		{
-			timer->Cancel();
-			timer = nullptr;
-		}
+		logThread->Cancel(gSessionEndTimer);
+		gSessionEndTimer = 0;
 
-		Database db(gDatabasePath);
-		auto lastEndSessionId = gSettings->GetLastEndSessionId();
-		auto lastEndSessionTime = gSettings->GetLastEndSessionTime();
+		FlushCoalescedEvents(monotonic, true);
 
-		if (lastEndSessionId != -1 && now - lastEndSessionTime < MIN_TIME_BETWEEN_SESSIONS_MILLIS)
-		{
-			db.RemoveSingleEvent(lastEndSessionId);
-		}
+		// A session that ended recently enough is resumed; its session_end
+		// was only ever held in memory, so there's nothing to undo.
+		CommitExpiredSessionEnd(now, monotonic);
+		gSession->Resume(now, monotonic);
+		gSessionEndAfterId = -1;
 
-		StartNewSessionIfNeeded(now);
-	});
+		StartNewSessionIfNeeded(now, monotonic);
+	}, WorkPriority::Critical);
 }
 
 void
@@ -161,140 +479,656 @@ EventReporter::EndSession()
 {
 	REQUIRE_API_KEY("EndSession()");
 
-	auto timestamp = GetCurrentDateAsJavaMillis();
-	logThread->TryAddWorkItem([timestamp]
+	auto timestamp = Clock::NowMillis();
+	auto monotonic = Clock::MonotonicMillis();
+	logThread->TryAddWorkItem([timestamp, monotonic]
 	{
-		if (gSessionOpen)
+		FlushCoalescedEvents(monotonic, true);
+		FlushAggregates(timestamp, monotonic);
+
+		if (gSession->Close(timestamp, monotonic))
 		{
 			auto apiProperties = ref new JsonObject();
 			apiProperties->Insert("special", JsonValue::CreateStringValue(EventNames::SESSION_END));
 
-			auto eventId = LogEvent(EventNames::SESSION_END, nullptr, apiProperties, timestamp, false);
-			gSettings->SetLastEndSessionId(eventId);
-			gSettings->SetLastEndSessionTime(timestamp);
+			// Built now, with the properties as they are now, but only stored
+			// if the session isn't resumed.
+			gSession->HoldSessionEnd(BuildEvent(EventNames::SESSION_END, nullptr, apiProperties, timestamp, monotonic, false, std::wstring()));
+			gSessionEndAfterId = OpenDatabase()->GetLastEventId();
 		}
-		CloseSession();
-	});
 
-	auto oldTimer = sessionEndTimer;
-	if (oldTimer != nullptr)
+		ScheduleSessionEndExpiry();
+	}, WorkPriority::Critical);
+}
+
+void
+EventReporter::ScheduleSessionEndExpiry()
+{
+	// Once the session can no longer be resumed, store its session_end and
+	// send what it logged.
+	logThread->Cancel(gSessionEndTimer);
+	gSessionEndTimer = logThread->Schedule([]
 	{
-		oldTimer->Cancel();
+		gSessionEndTimer = 0;
+		CommitExpiredSessionEnd(Clock::NowMillis(), Clock::MonotonicMillis());
+		UpdateServer();
+	}, MIN_TIME_BETWEEN_SESSIONS_MILLIS + 1000);
+}
+
+void
+EventReporter::CommitExpiredSessionEnd(int64 now, int64 monotonic)
+{
+	std::wstring event;
+	int64 timestamp;
+	if (!gSession->TakeExpiredSessionEnd(now, monotonic, event, timestamp))
+	{
+		return;
 	}
 
-	sessionEndTimer = RunDelayed([]() -> void
+	// It may have been built before the device ID was resolved, and held
+	// past OnDeviceIdResolved's patching.
+	if (gDeviceId != nullptr)
 	{
-		gSettings->ClearEndSession();
-		UploadEvents();
-	}, MIN_TIME_BETWEEN_SESSIONS_MILLIS + 1000);
+		std::wstring placeholder(JsonValue::CreateStringValue(PENDING_DEVICE_ID)->Stringify()->Data());
+		auto position = event.find(placeholder);
+		if (position != std::wstring::npos)
+		{
+			event.replace(position, placeholder.length(), JsonValue::CreateStringValue(gDeviceId)->Stringify()->Data());
+		}
+	}
+
+	// Ahead of anything stored while it was held, which uploads have been
+	// holding back.
+	auto afterId = gSessionEndAfterId;
+	gSessionEndAfterId = -1;
+
+	auto db = OpenDatabase();
+	{
+		ScopedLatency latency(gStats.insertLatency);
+		if (afterId >= 0)
+		{
+			db->AddEventAfter(event, timestamp, afterId);
+		}
+		else
+		{
+			db->AddEvent(event, timestamp);
+		}
+	}
+
+	OnEventsStored(*db, 1);
+}
+
+void
+EventReporter::StartNewSessionIfNeeded(int64 timestamp, int64 monotonic)
+{
+	// The last session's session_end goes ahead of anything that follows
+	// it.
+	CommitExpiredSessionEnd(timestamp, monotonic);
+
+	if (gSession->CheckSession(timestamp, monotonic))
+	{
+		auto obj = ref new JsonObject();
+		obj->Insert("special", JsonValue::CreateStringValue(EventNames::SESSION_START));
+
+		LogEvent(EventNames::SESSION_START, nullptr, obj, timestamp, monotonic, false);
+	}
+}
+
+void
+EventReporter::LogEvent(String ^eventName)
+{
+	LogEvent(eventName, EMPTY);
 }
 
 void
-EventReporter::StartNewSessionIfNeeded(int64 timestamp)
+EventReporter::LogEvent(String ^eventName, JsonObject ^properties)
 {
-	if (!gSessionOpen)
+	AMPLITUDE_TRACE_SPAN("EventReporter::LogEvent");
+
+	auto monotonic = Clock::MonotonicMillis();
+	auto admission = eventName != nullptr ? gIngestionFilter.Admit(eventName->Data(), eventName->Length(), monotonic) : Admission::Admit;
+	if (admission == Admission::Drop)
+	{
+		return;
+	}
+
+	auto now = Clock::NowMillis();
+	CheckedLogEvent(eventName, properties, nullptr, now, monotonic, true, WorkPriority::Normal, admission == Admission::Defer);
+}
+
+void
+EventReporter::LogEvents(JsonArray ^events)
+{
+	AMPLITUDE_TRACE_SPAN("EventReporter::LogEvents");
+
+	REQUIRE_API_KEY("LogEvents()");
+
+	if (events == nullptr)
+	{
+		throw ref new InvalidArgumentException("Events can not be null");
+	}
+
+	auto now = Clock::NowMillis();
+	auto monotonic = Clock::MonotonicMillis();
+
+	// Validate everything up front, so that a bad entry rejects the whole
+	// batch rather than leaving half of it logged.
+	auto batch = std::make_shared<std::vector<BatchedEvent>>();
+	batch->reserve(events->Size);
+
+	for (unsigned int i = 0; i < events->Size; ++i)
+	{
+		auto value = events->GetAt(i);
+		if (value->ValueType != JsonValueType::Object)
+		{
+			throw ref new InvalidArgumentException("Each event must be a JSON object");
+		}
+
+		auto obj = value->GetObject();
+
+		BatchedEvent event;
+		event.name = obj->HasKey("event_type") ? obj->GetNamedString("event_type") : nullptr;
+		if (event.name == nullptr || event.name->Length() == 0)
+		{
+			throw ref new InvalidArgumentException("Event name can not be null or empty");
+		}
+
+		event.properties = obj->HasKey("properties") ? obj->GetNamedObject("properties") : nullptr;
+
+		event.timestamp = now;
+		event.monotonic = monotonic;
+		event.backdated = obj->HasKey("timestamp");
+		if (event.backdated)
+		{
+			// Accept timestamps either way we might have written them.
+			auto timestamp = obj->GetNamedValue("timestamp");
+			event.timestamp = timestamp->ValueType == JsonValueType::String
+				? _wtoi64(timestamp->GetString()->Data())
+				: static_cast<int64>(timestamp->GetNumber());
+
+			// As far before now on the monotonic clock as it is on the
+			// wall clock.
+			event.monotonic = monotonic - (now - event.timestamp);
+		}
+
+		event.deferred = false;
+		batch->push_back(event);
+	}
+
+	// Only a batch that's good as a whole counts against the rate limits.
+	auto kept = batch->begin();
+	for (const auto &event : *batch)
 	{
-		auto lastSessionEnd = gSettings->GetLastEndSessionTime();
-		if (timestamp - lastSessionEnd < MIN_TIME_BETWEEN_SESSIONS_MILLIS)
+		auto admission = gIngestionFilter.Admit(event.name->Data(), event.name->Length(), monotonic);
+		if (admission != Admission::Drop)
 		{
-			// sessions are close enough, keep the previous session ID
-			// and undo the last session end
+			*kept = event;
+			kept->deferred = admission == Admission::Defer;
+			++kept;
+		}
+	}
+	batch->erase(kept, batch->end());
+
+	if (batch->empty())
+	{
+		return;
+	}
 
-			auto lastSessionId = gSettings->GetLastSessionId();
-			if (lastSessionId == -1)
+	auto globalProperties = gGlobalProperties.Current();
+	// One work item, however many events there are.
+	auto posted = logThread->TryAddWorkItem([batch, globalProperties]
+	{
+		LogEventBatch(*batch, globalProperties);
+	}, WorkPriority::Normal, [batch, globalProperties]
+	{
+		auto spilled = ref new JsonArray();
+		for (const auto &event : *batch)
+		{
+			auto obj = MakeSpilledEvent(event.name, event.properties, nullptr, event.timestamp, event.monotonic, true, event.deferred);
+			if (event.backdated)
 			{
-				StartNewSession(timestamp);
+				obj->Insert("backdated", JsonValue::CreateBooleanValue(true));
 			}
-			else
+			spilled->Append(obj);
+		}
+		return MakeSpillRecord(spilled, globalProperties->json);
+	});
+
+	if (!posted)
+	{
+		AMPLITUDE_LOG_WARNING("[Amplitude] Work queue is full, dropped a batch of events");
+	}
+}
+
+void
+EventReporter::LogCriticalEvent(String ^eventName, JsonObject ^properties)
+{
+	auto monotonic = Clock::MonotonicMillis();
+	auto admission = eventName != nullptr ? gIngestionFilter.Admit(eventName->Data(), eventName->Length(), monotonic) : Admission::Admit;
+	if (admission == Admission::Drop)
+	{
+		return;
+	}
+
+	auto now = Clock::NowMillis();
+	CheckedLogEvent(eventName, properties, nullptr, now, monotonic, true, WorkPriority::Critical, admission == Admission::Defer);
+}
+
+void
+EventReporter::SetRateLimit(String ^eventType, double eventsPerSecond, int burst)
+{
+	if (eventType == nullptr || eventType->Length() == 0)
+	{
+		throw ref new InvalidArgumentException("Event type can not be null or empty");
+	}
+
+	gIngestionFilter.SetRateLimit(eventType->Data(), eventsPerSecond, burst);
+}
+
+void
+EventReporter::SetSamplingRate(String ^eventType, double rate)
+{
+	if (eventType == nullptr || eventType->Length() == 0)
+	{
+		throw ref new InvalidArgumentException("Event type can not be null or empty");
+	}
+
+	gIngestionFilter.SetSamplingRate(eventType->Data(), rate);
+}
+
+int64
+EventReporter::GetDroppedEventCount()
+{
+	auto dropped = gIngestionFilter.GetRateLimitedCount() + gIngestionFilter.GetSampledOutCount() + gDeferredDroppedCount.load(std::memory_order_relaxed);
+	if (logThread != nullptr)
+	{
+		auto overflow = logThread->GetOverflowStats();
+		dropped += overflow.dropped + overflow.evicted;
+	}
+	return dropped;
+}
+
+JsonObject^
+EventReporter::GetStats()
+{
+	// {
+	//   "queue":   { "enqueued", "depth", "peak_depth" },
+	//   "dropped": { "rate_limited", "sampled_out", "deferred_overflow", "queue_full", "evicted", "spilled", "replayed" },
+	//   "store":   { "events", "bytes", "insert_latency", "read_latency", "delete_latency" },
+	//   "uploads": { "attempts", "bytes_sent", "results": { ... }, "last_success_time" }
+	// }
+	//
+	// Latencies are histograms of microseconds.  Store sizes are as of the
+	// last time the worker stored or uploaded anything.
+	QueueStats queueStats = {};
+	OverflowStats overflowStats = {};
+	if (logThread != nullptr)
+	{
+		queueStats = logThread->GetQueueStats();
+		overflowStats = logThread->GetOverflowStats();
+	}
+
+	auto queue = ref new JsonObject();
+	queue->Insert("enqueued", ToJsonNumber(queueStats.enqueued));
+	queue->Insert("depth", ToJsonNumber(queueStats.depth));
+	queue->Insert("peak_depth", ToJsonNumber(queueStats.peakDepth));
+
+	auto dropped = ref new JsonObject();
+	dropped->Insert("rate_limited", ToJsonNumber(gIngestionFilter.GetRateLimitedCount()));
+	dropped->Insert("sampled_out", ToJsonNumber(gIngestionFilter.GetSampledOutCount()));
+	dropped->Insert("deferred_overflow", ToJsonNumber(gDeferredDroppedCount.load(std::memory_order_relaxed)));
+	dropped->Insert("queue_full", ToJsonNumber(overflowStats.dropped));
+	dropped->Insert("evicted", ToJsonNumber(overflowStats.evicted));
+	dropped->Insert("spilled", ToJsonNumber(overflowStats.spilled));
+	dropped->Insert("replayed", ToJsonNumber(overflowStats.replayed));
+
+	auto store = ref new JsonObject();
+	store->Insert("events", ToJsonNumber(gStats.storedEvents.load(std::memory_order_relaxed)));
+	store->Insert("bytes", ToJsonNumber(gStats.storedBytes.load(std::memory_order_relaxed)));
+	store->Insert("insert_latency", ToJson(gStats.insertLatency));
+	store->Insert("read_latency", ToJson(gStats.readLatency));
+	store->Insert("delete_latency", ToJson(gStats.deleteLatency));
+
+	// Failures by the class of response; see UploadResult.
+	static const wchar_t * const kResultNames[RuntimeStats::kUploadResults] =
+	{
+		L"success",
+		L"invalid_api_key",
+		L"bad_checksum",
+		L"request_db_write_failed",
+		L"network_error",
+		L"unknown_response"
+	};
+
+	auto results = ref new JsonObject();
+	for (int i = 0; i < RuntimeStats::kUploadResults; ++i)
+	{
+		results->Insert(ref new String(kResultNames[i]), ToJsonNumber(gStats.uploadResults[i].load(std::memory_order_relaxed)));
+	}
+
+	auto lastSuccess = gStats.lastUploadSuccessTime.load(std::memory_order_relaxed);
+
+	auto uploads = ref new JsonObject();
+	uploads->Insert("attempts", ToJsonNumber(gStats.uploadAttempts.load(std::memory_order_relaxed)));
+	uploads->Insert("bytes_sent", ToJsonNumber(gStats.uploadBytes.load(std::memory_order_relaxed)));
+	uploads->Insert("results", results);
+	uploads->Insert("last_success_time", lastSuccess == 0 ? JsonValue::CreateNullValue() : JsonValue::CreateStringValue(lastSuccess.ToString()));
+
+	auto stats = ref new JsonObject();
+	stats->Insert("queue", queue);
+	stats->Insert("dropped", dropped);
+	stats->Insert("store", store);
+	stats->Insert("uploads", uploads);
+	return stats;
+}
+
+String^
+EventReporter::ExportTrace()
+{
+	return ToPlatformString(Trace::ExportChromeJson());
+}
+
+void
+EventReporter::Increment(String ^name)
+{
+	Increment(name, nullptr);
+}
+
+void
+EventReporter::Increment(String ^name, JsonObject ^properties)
+{
+	REQUIRE_API_KEY("Increment()");
+
+	if (name == nullptr || name->Length() == 0)
+	{
+		throw ref new InvalidArgumentException("Counter name can not be null or empty");
+	}
+
+	if (gAggregator.Increment(name->Data(), SerializeProperties(properties), 1, Clock::NowMillis()))
+	{
+		ScheduleAggregateFlush();
+	}
+}
+
+void
+EventReporter::Observe(String ^name, double value)
+{
+	Observe(name, value, nullptr);
+}
+
+void
+EventReporter::Observe(String ^name, double value, JsonObject ^properties)
+{
+	REQUIRE_API_KEY("Observe()");
+
+	if (name == nullptr || name->Length() == 0)
+	{
+		throw ref new InvalidArgumentException("Histogram name can not be null or empty");
+	}
+
+	// Infinities would poison the sum, and JSON has no way to write them.
+	if (!std::isfinite(value))
+	{
+		throw ref new InvalidArgumentException("Observed value must be finite");
+	}
+
+	if (gAggregator.Observe(name->Data(), SerializeProperties(properties), value, Clock::NowMillis()))
+	{
+		ScheduleAggregateFlush();
+	}
+}
+
+void
+EventReporter::ScheduleAggregateFlush()
+{
+	logThread->Schedule([]
+	{
+		FlushAggregates(Clock::NowMillis(), Clock::MonotonicMillis());
+	}, AGGREGATE_FLUSH_PERIOD_MILLIS);
+}
+
+void
+EventReporter::FlushAggregates(int64 timestamp, int64 monotonic)
+{
+	AMPLITUDE_TRACE_SPAN("EventReporter::FlushAggregates");
+
+	Aggregator::Snapshot snapshot;
+	if (!gAggregator.Drain(snapshot))
+	{
+		return;
+	}
+
+	auto counters = ref new JsonArray();
+	for (const auto &counter : snapshot.counters)
+	{
+		auto obj = ref new JsonObject();
+		obj->Insert("name", JsonValue::CreateStringValue(ToPlatformString(counter.name)));
+		obj->Insert("properties", JsonObject::Parse(ToPlatformString(counter.properties)));
+		obj->Insert("count", JsonValue::CreateNumberValue(static_cast<double>(counter.count)));
+		counters->Append(obj);
+	}
+
+	auto bounds = ref new JsonArray();
+	for (auto bound : Aggregator::GetBucketBounds())
+	{
+		bounds->Append(JsonValue::CreateNumberValue(bound));
+	}
+
+	auto histograms = ref new JsonArray();
+	for (const auto &histogram : snapshot.histograms)
+	{
+		auto buckets = ref new JsonArray();
+		for (auto count : histogram.buckets)
+		{
+			buckets->Append(JsonValue::CreateNumberValue(static_cast<double>(count)));
+		}
+
+		auto obj = ref new JsonObject();
+		obj->Insert("name", JsonValue::CreateStringValue(ToPlatformString(histogram.name)));
+		obj->Insert("properties", JsonObject::Parse(ToPlatformString(histogram.properties)));
+		obj->Insert("count", JsonValue::CreateNumberValue(static_cast<double>(histogram.count)));
+		obj->Insert("sum", JsonValue::CreateNumberValue(histogram.sum));
+		obj->Insert("min", JsonValue::CreateNumberValue(histogram.min));
+		obj->Insert("max", JsonValue::CreateNumberValue(histogram.max));
+		obj->Insert("buckets", buckets);
+		histograms->Append(obj);
+	}
+
+	auto properties = ref new JsonObject();
+	properties->Insert("interval_start", JsonValue::CreateStringValue(snapshot.startTime.ToString()));
+	properties->Insert("interval_end", JsonValue::CreateStringValue(timestamp.ToString()));
+	properties->Insert("counters", counters);
+	properties->Insert("bucket_bounds", bounds);
+	properties->Insert("histograms", histograms);
+
+	// A summary isn't user activity, so it mustn't start a new session.
+	LogEvent(EventNames::AGGREGATES, properties, nullptr, timestamp, monotonic, false);
+}
+
+void
+EventReporter::CheckedLogEvent(
+	String ^eventName,
+	JsonObject ^eventProperties,
+	JsonObject ^apiProperties,
+	int64 timestamp,
+	int64 monotonic,
+	bool checkSession,
+	WorkPriority priority,
+	bool deferred)
+{
+	REQUIRE_API_KEY("CheckedLogEvent()");
+
+	if (eventName == nullptr || eventName->Length() == 0)
+	{
+		throw ref new InvalidArgumentException("Event name can not be null or empty");
+	}
+
+	// Events carry the global properties as they were when they were logged.
+	auto globalProperties = gGlobalProperties.Current();
+
+	auto posted = logThread->TryAddWorkItem([=]
+	{
+		auto log = [=]
+		{
+			// Only events logged by the app are worth coalescing.
+			if (!checkSession || !TryCoalesceEvent(eventName, eventProperties, globalProperties->json, timestamp, monotonic))
 			{
-				gSessionId = lastSessionId;
+				LogEvent(eventName, eventProperties, apiProperties, timestamp, monotonic, checkSession, globalProperties->json);
 			}
+		};
+
+		if (deferred)
+		{
+			LogSampledEvent(eventName, log);
 		}
 		else
 		{
-			// sessions are far enough apart; start a new one
-			StartNewSession(timestamp);
+			log();
 		}
-	}
-	else
+	}, priority, [=]
 	{
-		auto lastEventTime = gSettings->GetLastEventTime();
-		if (timestamp - lastEventTime > SESSION_TIMEOUT_MILLIS || gSessionId == -1)
-		{
-			StartNewSession(timestamp);
-		}
+		auto spilled = ref new JsonArray();
+		spilled->Append(MakeSpilledEvent(eventName, eventProperties, apiProperties, timestamp, monotonic, checkSession, deferred));
+		return MakeSpillRecord(spilled, globalProperties->json);
+	});
+
+	if (!posted)
+	{
+		AMPLITUDE_LOG_WARNING("[Amplitude] Work queue is full, dropped an event");
 	}
 }
 
 void
-EventReporter::StartNewSession(int64 timestamp)
+EventReporter::SetGlobalProperty(String ^key, IJsonValue ^value)
 {
-	OpenSession();
-	gSessionId = timestamp;
-	gSettings->SetLastSessionId(timestamp);
+	if (key == nullptr || key->Length() == 0)
+	{
+		throw ref new InvalidArgumentException("Global property name can not be null or empty");
+	}
 
-	auto obj = ref new JsonObject();
-	obj->Insert("special", JsonValue::CreateStringValue(EventNames::SESSION_START));
+	if (value == nullptr)
+	{
+		value = JsonValue::CreateNullValue();
+	}
 
-	LogEvent(EventNames::SESSION_START, nullptr, obj, timestamp, false);
+	gGlobalProperties.Set(key->Data(), value);
 }
 
 void
-EventReporter::OpenSession()
+EventReporter::UnsetGlobalProperty(String ^key)
 {
-	gSettings->ClearEndSession();
-	gSessionOpen = true;
+	if (key == nullptr || key->Length() == 0)
+	{
+		throw ref new InvalidArgumentException("Global property name can not be null or empty");
+	}
+
+	gGlobalProperties.Unset(key->Data());
 }
 
 void
-EventReporter::CloseSession()
+EventReporter::SetCoalescingWindow(int64 windowMillis)
 {
-	gSessionOpen = false;
+	REQUIRE_API_KEY("SetCoalescingWindow()");
+
+	logThread->TryAddWorkItem([windowMillis]
+	{
+		// Pending events were held under the old window; don't let them
+		// linger under a longer one.
+		FlushCoalescedEvents(Clock::MonotonicMillis(), true);
+		gCoalescer.SetWindow(windowMillis);
+	}, WorkPriority::Critical);
 }
 
-void
-EventReporter::LogEvent(String ^eventName)
+bool
+EventReporter::TryCoalesceEvent(String ^eventName, JsonObject ^eventProperties, const std::wstring &globalProperties, int64 timestamp, int64 monotonic)
 {
-	LogEvent(eventName, EMPTY);
+	if (!gCoalescer.IsEnabled())
+	{
+		return false;
+	}
+
+	// The merged event reports its count and when the last of them
+	// happened in properties of its own; don't clobber ones that the app
+	// set itself.
+	if (eventProperties != nullptr && (eventProperties->HasKey("count") || eventProperties->HasKey("last_timestamp")))
+	{
+		return false;
+	}
+
+	// Events logged either side of a change to the global properties are
+	// kept apart, so that each carries the ones it was logged with.
+	auto result = gCoalescer.Add(eventName->Data(), SerializeProperties(eventProperties), globalProperties, timestamp, monotonic);
+	switch (result)
+	{
+	case EventCoalescer::Result::Merged:
+		gSession->OnEvent(timestamp, monotonic);
+		return true;
+
+	case EventCoalescer::Result::Held:
+		ScheduleCoalescedFlush();
+		return true;
+
+	default:
+		return false;
+	}
 }
 
 void
-EventReporter::LogEvent(String ^eventName, JsonObject ^properties)
+EventReporter::ScheduleCoalescedFlush()
 {
-	auto now = GetCurrentDateAsJavaMillis();
-	CheckedLogEvent(eventName, properties, nullptr, now, true);
+	auto deadline = gCoalescer.GetNextDeadline();
+	if (gCoalesceFlushScheduled || deadline == -1)
+	{
+		return;
+	}
+
+	gCoalesceFlushScheduled = true;
+	auto delay = std::max(0LL, deadline - Clock::MonotonicMillis());
+	logThread->Schedule([]
+	{
+		gCoalesceFlushScheduled = false;
+		FlushCoalescedEvents(Clock::MonotonicMillis(), false);
+		ScheduleCoalescedFlush();
+	}, delay);
 }
 
 void
-EventReporter::CheckedLogEvent(
-	String ^eventName,
-	JsonObject ^eventProperties,
-	JsonObject ^apiProperties,
-	int64 timestamp,
-	bool checkSession)
+EventReporter::FlushCoalescedEvents(int64 now, bool all)
 {
-	REQUIRE_API_KEY("CheckedLogEvent()");
-
-	if (eventName == nullptr || eventName->Length() == 0)
+	gCoalescer.Flush(now, all, [](const EventCoalescer::Entry &entry)
 	{
-		throw ref new InvalidArgumentException("Event name can not be null or empty");
-	}
+		auto properties = JsonObject::Parse(ToPlatformString(entry.properties));
+		properties->Insert("count", JsonValue::CreateNumberValue(static_cast<double>(entry.count)));
+		properties->Insert("last_timestamp", JsonValue::CreateStringValue(entry.lastTimestamp.ToString()));
 
-	logThread->TryAddWorkItem([=]
-	{
-		LogEvent(eventName, eventProperties, apiProperties, timestamp, checkSession);
+		LogEvent(ToPlatformString(entry.name), properties, nullptr, entry.firstTimestamp, entry.firstMonotonic, true, entry.globalProperties);
 	});
 }
 
 int64
-EventReporter::LogEvent(String ^eventName, JsonObject ^eventProperties, JsonObject ^apiProperties, int64 timestamp, bool checkSession)
+EventReporter::LogEvent(String ^eventName, JsonObject ^eventProperties, JsonObject ^apiProperties, int64 timestamp, int64 monotonic, bool checkSession, const std::wstring &globalProperties)
+{
+	return LogEvent(BuildEvent(eventName, eventProperties, apiProperties, timestamp, monotonic, checkSession, globalProperties), timestamp);
+}
+
+std::wstring
+EventReporter::BuildEvent(String ^eventName, JsonObject ^eventProperties, JsonObject ^apiProperties, int64 timestamp, int64 monotonic, bool checkSession, const std::wstring &globalProperties, bool backdated)
 {
-	if (checkSession)
+	AMPLITUDE_TRACE_SPAN("EventReporter::BuildEvent");
+
+	// An event from before the live session, e.g. from a cached offline
+	// one, mustn't be counted as its activity, or it would look idle.
+	int64 sessionId = -1;
+	if (!backdated || !gSession->PrecedesSession(timestamp, monotonic))
 	{
-		StartNewSessionIfNeeded(timestamp);
-	}
+		if (checkSession)
+		{
+			StartNewSessionIfNeeded(timestamp, monotonic);
+		}
 
-	gSettings->SetLastEventTime(timestamp);
+		gSession->OnEvent(timestamp, monotonic);
+		sessionId = gSession->GetSessionId();
+	}
 
 	auto eventObj = ref new JsonObject();
 	eventObj->SetNamedValue("event_type", JsonValue::CreateStringValue(eventName));
@@ -305,10 +1139,10 @@ EventReporter::LogEvent(String ^eventName, JsonObject ^eventProperties, JsonObje
 	// is happy with number-as-string, so we avoid any shenanigans from funky number
 	// representations.
 	eventObj->SetNamedValue("timestamp", JsonValue::CreateStringValue(timestamp.ToString()));
-	eventObj->SetNamedValue("session_id", JsonValue::CreateStringValue(gSessionId.ToString()));
+	eventObj->SetNamedValue("session_id", JsonValue::CreateStringValue(sessionId.ToString()));
 
 	//eventObj->SetNamedValue("user_id", nullptr);  // TODO(ben): implement
-	eventObj->SetNamedValue("device_id", JsonValue::CreateStringValue(gSettings->GetDeviceId()));
+	eventObj->SetNamedValue("device_id", JsonValue::CreateStringValue(gDeviceId != nullptr ? gDeviceId : PENDING_DEVICE_ID));
 	eventObj->SetNamedValue("version_code", JsonValue::CreateStringValue(gSettings->GetAppVersion()));
 	eventObj->SetNamedValue("version_name", JsonValue::CreateStringValue(gSettings->GetAppVersion()));
 	// eventObj->SetNamedValue("build_version_sdk", JsonValue::CreateStringValue(this->todo));
@@ -339,184 +1173,460 @@ EventReporter::LogEvent(String ^eventName, JsonObject ^eventProperties, JsonObje
 
 	eventObj->SetNamedValue("api_properties", apiProperties);
 	eventObj->SetNamedValue("custom_properties", eventProperties);
-	eventObj->SetNamedValue("global_properties", EMPTY);
-	// TODO(ben): add global properties
 
-	return LogEvent(eventObj);
+	// The snapshot was serialized once, when it was published; it's spliced
+	// in as it is, rather than serialized again with every event.
+	if (globalProperties.empty())
+	{
+		return AppendMember(eventObj->Stringify(), L"global_properties", gGlobalProperties.Current()->json);
+	}
+	return AppendMember(eventObj->Stringify(), L"global_properties", globalProperties);
 }
 
 int64
-EventReporter::LogEvent(JsonObject ^eventObj)
+EventReporter::LogEvent(const std::wstring &event, int64 timestamp)
 {
-	Database db(gDatabasePath);
-	auto eventId = db.AddEvent(eventObj);
+	auto db = OpenDatabase();
+	int64 eventId;
+	{
+		ScopedLatency latency(gStats.insertLatency);
+		eventId = db->AddEvent(event, timestamp);
+	}
+
+	OnEventsStored(*db, 1);
+
+	return eventId;
+}
+
+void
+EventReporter::LogEventBatch(const std::vector<BatchedEvent> &batch, std::shared_ptr<const GlobalPropertiesSnapshot> globalProperties)
+{
+	std::vector<EventRecord> eventJson;
+	eventJson.reserve(batch.size());
 
-	if (db.GetEventCount() > EVENT_MAX_COUNT)
+	for (const auto &event : batch)
 	{
-		db.RemoveEvents(db.GetNthEventId(EVENT_REMOVE_BATCH_SIZE));
+		if (event.deferred)
+		{
+			// Stored on its own, if at all, once the device ID is known.
+			LogSampledEvent(event.name, [event, globalProperties]
+			{
+				LogEvent(BuildEvent(event.name, event.properties, nullptr, event.timestamp, event.monotonic, true, globalProperties->json, event.backdated), event.timestamp);
+			});
+			continue;
+		}
+
+		eventJson.push_back(EventRecord(
+			BuildEvent(event.name, event.properties, nullptr, event.timestamp, event.monotonic, true, globalProperties->json, event.backdated),
+			event.timestamp));
 	}
 
-	if (db.GetEventCount() > EVENT_UPLOAD_THRESHOLD)
+	if (eventJson.empty())
 	{
-		UpdateServer();
+		return;
 	}
-	else
+
+	auto db = OpenDatabase();
 	{
-		UpdateServerLater(EVENT_UPLOAD_PERIOD_MILLIS);
+		ScopedLatency latency(gStats.insertLatency);
+		db->AddEvents(eventJson);
 	}
 
-	return eventId;
+	OnEventsStored(*db, static_cast<int64>(eventJson.size()));
 }
 
 void
-EventReporter::UploadEvents()
+EventReporter::ReplaySpilledEvents(std::vector<std::wstring> &&records)
 {
-	REQUIRE_API_KEY("UploadEvents()");
+	std::vector<EventRecord> eventJson;
+	for (const auto &record : records)
+	{
+		JsonObject ^obj;
+		if (!JsonObject::TryParse(ToPlatformString(record), &obj))
+		{
+			AMPLITUDE_LOG_WARNING("[Amplitude] Skipping a corrupt overflow record");
+			continue;
+		}
+
+		std::wstring globalProperties(obj->GetNamedObject("global_properties")->Stringify()->Data());
+		auto events = obj->GetNamedArray("events");
+		for (unsigned int i = 0; i < events->Size; ++i)
+		{
+			auto event = events->GetObjectAt(i);
+			auto eventName = event->GetNamedString("event_type");
+			auto eventProperties = event->GetNamedObject("properties");
+			auto apiProperties = event->GetNamedObject("api_properties");
+			auto timestamp = _wtoi64(event->GetNamedString("timestamp")->Data());
+			auto checkSession = event->GetNamedBoolean("check_session");
+			auto backdated = event->HasKey("backdated");
+
+			// Spilled by an earlier run, the monotonic stamp may be from
+			// before a reboot, and ahead of the clock now; older records
+			// don't have one at all.
+			auto monotonic = event->HasKey("monotonic")
+				? std::min(_wtoi64(event->GetNamedString("monotonic")->Data()), Clock::MonotonicMillis())
+				: Clock::ToMonotonicMillis(timestamp);
+
+			if (event->HasKey("deferred"))
+			{
+				LogSampledEvent(eventName, [=]
+				{
+					LogEvent(BuildEvent(eventName, eventProperties, apiProperties, timestamp, monotonic, checkSession, globalProperties, backdated), timestamp);
+				});
+				continue;
+			}
+
+			eventJson.push_back(EventRecord(BuildEvent(
+				eventName,
+				eventProperties,
+				apiProperties,
+				timestamp,
+				monotonic,
+				checkSession,
+				globalProperties,
+				backdated), timestamp));
+		}
+	}
+
+	if (eventJson.empty())
+	{
+		return;
+	}
+
+	auto db = OpenDatabase();
+	{
+		ScopedLatency latency(gStats.insertLatency);
+		db->AddEvents(eventJson);
+	}
 
-	logThread->TryAddWorkItem(std::bind(EventReporter::UpdateServer, true));
+	OnEventsStored(*db, static_cast<int64>(eventJson.size()));
 }
 
 void
-EventReporter::UpdateServer(bool limit)
+EventReporter::OnDeviceIdResolved(String ^deviceId)
+{
+	AMPLITUDE_TRACE_SPAN("EventReporter::OnDeviceIdResolved");
+
+	gDeviceId = deviceId;
+
+	// Sampling is keyed on the device ID.
+	gIngestionFilter.SetDeviceId(deviceId->Data());
+
+	// Events stored before now, in this run or in one that ended before
+	// resolving the ID, carry the placeholder instead.  Patched as JSON
+	// strings, so that an ID that needs escaping gets it.
+	auto placeholder = JsonValue::CreateStringValue(PENDING_DEVICE_ID)->Stringify();
+	auto replacement = JsonValue::CreateStringValue(deviceId)->Stringify();
+
+	auto db = OpenDatabase();
+	db->ReplaceInEvents(placeholder->Data(), replacement->Data());
+
+	// Now that the sample is known, so is which of the events held for it
+	// to log.
+	std::deque<std::function<void()>> deferred;
+	deferred.swap(gDeferredEvents);
+	for (const auto &log : deferred)
+	{
+		log();
+	}
+
+	// Uploads were held back until now.
+	OnEventsStored(*db, 0);
+}
+
+void
+EventReporter::OnEventsStored(Database &db, int64 count)
 {
-	if (!gUploadingCurrently.exchange(true))
+	if (gFlushDatabase != nullptr)
 	{
-		// If we weren't already uploading, we are now.
-		Database db(gDatabasePath);
-		auto lastSessionEnd = gSettings->GetLastEndSessionId();
-		auto eventCount = limit ? EVENT_UPLOAD_MAX_BATCH_SIZE : -1;
-		auto maxIdAndEvents = db.GetEventsSince(lastSessionEnd, eventCount);
-		auto maxId = maxIdAndEvents.first;
-		auto events = maxIdAndEvents.second;
+		// The flush sees to the limit and uploads once it has committed.
+		gFlushedEventCount += count;
+		return;
+	}
 
-		if (maxId != -1)
+	auto eventCount = db.GetEventCount();
+	if (eventCount > EVENT_MAX_COUNT)
+	{
+		// A batch may overshoot the limit by more than one removal's worth.
+		auto excess = static_cast<int>(eventCount - EVENT_MAX_COUNT);
 		{
-			// Only send a request if we actually have events to submit
-			MakeEventUploadPostRequest(events, maxId);
+			ScopedLatency latency(gStats.deleteLatency);
+			db.RemoveEvents(db.GetNthEventId(std::max(EVENT_REMOVE_BATCH_SIZE, excess)));
 		}
-		else
+		eventCount = db.GetEventCount();
+	}
+
+	gStats.storedEvents.store(eventCount, std::memory_order_relaxed);
+	gStats.storedBytes.store(db.GetSizeInBytes(), std::memory_order_relaxed);
+
+	if (eventCount > EVENT_UPLOAD_THRESHOLD)
+	{
+		UpdateServer();
+	}
+	else
+	{
+		UpdateServerLater(EVENT_UPLOAD_PERIOD_MILLIS);
+	}
+}
+
+void
+EventReporter::SetEventTimeToLive(int64 ttlMillis)
+{
+	REQUIRE_API_KEY("SetEventTimeToLive()");
+
+	if (ttlMillis < 0)
+	{
+		throw ref new InvalidArgumentException("Time to live can not be negative");
+	}
+
+	logThread->TryAddWorkItem([ttlMillis]
+	{
+		gEventTimeToLiveMillis = ttlMillis;
+
+		// Start over, right away, under the new TTL.
+		SchedulePurge(0);
+	}, WorkPriority::Critical);
+}
+
+void
+EventReporter::SchedulePurge(int64 delayMillis)
+{
+	logThread->Cancel(gPurgeTimer);
+	gPurgeTimer = 0;
+
+	if (gEventTimeToLiveMillis == 0)
+	{
+		return;
+	}
+
+	gPurgeTimer = logThread->Schedule([]
+	{
+		gPurgeTimer = 0;
+		if (!logThread->TryAddWorkItem([] { PurgeExpiredEvents(); }, WorkPriority::Background))
 		{
-			LogDebug("maxId == 1, *not* uploading");
+			// Too busy to be idle; try again next time.
+			SchedulePurge(EXPIRED_EVENT_PURGE_PERIOD_MILLIS);
 		}
+	}, delayMillis);
+}
+
+void
+EventReporter::PurgeExpiredEvents()
+{
+	AMPLITUDE_TRACE_SPAN("EventReporter::PurgeExpiredEvents");
+
+	// The TTL may have been turned off since this was queued.
+	if (gEventTimeToLiveMillis == 0)
+	{
+		return;
+	}
+
+	auto db = OpenDatabase();
+	int removed;
+	{
+		ScopedLatency latency(gStats.deleteLatency);
+		removed = db->RemoveExpiredEvents(Clock::NowMillis() - gEventTimeToLiveMillis, EVENT_REMOVE_BATCH_SIZE);
+	}
+
+	if (removed > 0)
+	{
+		gStats.storedEvents.store(db->GetEventCount(), std::memory_order_relaxed);
+		gStats.storedBytes.store(db->GetSizeInBytes(), std::memory_order_relaxed);
+	}
+
+	// A full chunk means there may be more; take it once whatever was
+	// logged in the meantime has been stored.
+	if (removed < EVENT_REMOVE_BATCH_SIZE || !logThread->TryAddWorkItem([] { PurgeExpiredEvents(); }, WorkPriority::Background))
+	{
+		SchedulePurge(EXPIRED_EVENT_PURGE_PERIOD_MILLIS);
 	}
 }
 
 void
-EventReporter::UpdateServerLater(int64 delayInMillis)
+EventReporter::UploadEvents()
+{
+	REQUIRE_API_KEY("UploadEvents()");
+
+	logThread->TryAddWorkItem(std::bind(EventReporter::UpdateServer, true), WorkPriority::Background);
+}
+
+FlushReport^
+EventReporter::Flush(int64 timeoutMillis, bool upload)
 {
-	if (!gUpdateScheduled.exchange(true))
+	REQUIRE_API_KEY("Flush()");
+
+	if (timeoutMillis < 0)
 	{
-		RunDelayed([]
-		{
-			logThread->TryAddWorkItem([]
-			{
-				gUpdateScheduled.store(false);
-				UpdateServer();
-			});
-		}, delayInMillis);
+		throw ref new InvalidArgumentException("Timeout can not be negative");
+	}
+
+	auto deadline = Clock::MonotonicMillis() + timeoutMillis;
+	auto progress = std::make_shared<FlushProgress>();
+
+	// Critical, so it isn't stuck behind a backlog of events; it runs that
+	// backlog itself.
+	auto posted = logThread->TryAddWorkItem([progress, deadline, upload]
+	{
+		FlushOnWorker(*progress, deadline, upload);
+	}, WorkPriority::Critical);
+
+	if (!posted)
+	{
+		return ref new FlushReport(0, -1, false, false, false);
 	}
+
+	std::unique_lock<std::mutex> lock(progress->mutex);
+	auto finished = progress->done.wait_for(lock, std::chrono::milliseconds(timeoutMillis), [&progress]
+	{
+		return progress->finished;
+	});
+
+	return ref new FlushReport(progress->eventsPersisted, progress->eventsStored, progress->completed, progress->uploading, !finished);
 }
 
 void
-EventReporter::MakeEventUploadPostRequest(JsonArray ^events, int64 maxId)
+EventReporter::FlushOnWorker(FlushProgress &progress, int64 deadline, bool upload)
 {
-	std::wostringstream apiStr, timestampStr;
-	apiStr << API_VERSION;
-	timestampStr << GetCurrentDateAsJavaMillis();
+	AMPLITUDE_TRACE_SPAN("EventReporter::Flush");
+
+	auto finish = [&progress](int64 eventsStored, bool uploading)
+	{
+		std::lock_guard<std::mutex> lock(progress.mutex);
+		progress.eventsStored = eventsStored;
+		progress.uploading = uploading;
+		progress.finished = true;
+		progress.done.notify_all();
+	};
+
+	if (gFlushDatabase != nullptr)
+	{
+		// An earlier flush has run into this one while catching up; what
+		// this one would have stored, that one will.
+		finish(-1, false);
+		return;
+	}
 
-	auto apiVersion = ref new String(apiStr.str().c_str());
-	auto timestamp = ref new String(timestampStr.str().c_str());
-	auto json = events->Stringify();
+	// Leave a quarter of the time for committing, and for the upload.
+	auto remaining = deadline - Clock::MonotonicMillis();
+	auto drainMillis = std::max(0LL, remaining - remaining / 4);
 
-	String^ checksum;
+	auto db = std::make_shared<Database>(gDatabasePath->Data());
+	auto completed = false;
 	try
 	{
-		auto preimage = apiVersion + gApiKey + json + timestamp;
-		auto buf = CryptographicBuffer::ConvertStringToBinary(preimage, BinaryStringEncoding::Utf8);
-		auto alg = HashAlgorithmProvider::OpenAlgorithm(HashAlgorithmNames::Md5);
-		auto hash = alg->HashData(buf);
-		checksum = CryptographicBuffer::EncodeToHexString(hash);
+		db->BeginTransaction();
+		gFlushDatabase = db;
+		gFlushedEventCount = 0;
+
+		completed = logThread->RunPending(drainMillis);
+
+		// Nothing is held back now; the app may not be back for it.
+		auto monotonic = Clock::MonotonicMillis();
+		FlushCoalescedEvents(monotonic, true);
+		FlushAggregates(Clock::NowMillis(), monotonic);
+
+		db->CommitTransaction();
+		gFlushDatabase = nullptr;
+	}
+	catch (...)
+	{
+		// Everything since BeginTransaction is rolled back with the
+		// connection.
+		gFlushDatabase = nullptr;
+		finish(-1, false);
+		throw;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(progress.mutex);
+		progress.eventsPersisted = gFlushedEventCount;
+		progress.completed = completed;
+	}
+
+	OnEventsStored(*db, gFlushedEventCount);
+	if (upload)
+	{
+		UpdateServer();
+	}
+
+	finish(db->GetEventCount(), gUploadPipeline->IsRunning());
+}
+
+void
+EventReporter::UpdateServer(bool limit)
+{
+	AMPLITUDE_TRACE_SPAN("EventReporter::UpdateServer");
+
+	auto delay = gRetryScheduler.GetDelayUntilNextAttempt(Clock::MonotonicMillis());
+	if (delay < 0)
+	{
+		// A permanent error was reported; there's no point in trying again.
+		return;
 	}
-	catch (Exception^ e)
+
+	if (delay > 0)
 	{
-		Log("Error checksumming: " + e->Message);
-		gUploadingCurrently.store(false);
+		// We're backing off after a failure; try again once that's over.
+		UpdateServerLater(delay);
 		return;
 	}
 
-	auto params = ref new Platform::Collections::Map<String^, String^>();
-	params->Insert("v", apiVersion);
-	params->Insert("e", json);
-	params->Insert("client", gApiKey);
-	params->Insert("upload_time", timestamp);
-	params->Insert("checksum", checksum);
+	// Does nothing if an upload is already under way, or there's nothing
+	// to upload.
+	auto eventCount = limit ? EVENT_UPLOAD_MAX_BATCH_SIZE : -1;
+	gUploadPipeline->Start(eventCount, Clock::NowMillis(), [](UploadResult result, int64 remaining)
+	{
+		OnUploadCompleted(result, remaining);
+	});
+}
 
-	auto client = ref new HttpClient();
-	auto content = ref new HttpFormUrlEncodedContent(params);
+void
+EventReporter::UpdateServerLater(int64 delayInMillis)
+{
+	// One pending upload answers any number of requests for one, as long
+	// as it comes soon enough for all of them.
+	auto deadline = Clock::MonotonicMillis() + delayInMillis;
+	if (gUploadTimer != 0 && gUploadTimerDeadline <= deadline)
+	{
+		return;
+	}
 
-	create_task(client->PostAsync(EVENT_UPLOAD_URI, content)).then([](HttpResponseMessage^ response)
+	logThread->Cancel(gUploadTimer);
+	gUploadTimerDeadline = deadline;
+	gUploadTimer = logThread->Schedule([]
 	{
-		return create_task(response->Content->ReadAsStringAsync());
-	}).then([maxId](String ^response)
+		gUploadTimer = 0;
+		UpdateServer();
+	}, delayInMillis);
+}
+
+void
+EventReporter::OnUploadCompleted(UploadResult result, int64 remaining)
+{
+	if (remaining >= 0)
 	{
-		if (response == "success")
-		{
-			logThread->TryAddWorkItem([maxId]
-			{
-				auto shouldUpdate = false;
-				{
-					Database db(gDatabasePath);
-					db.RemoveEvents(maxId);
-					shouldUpdate = db.GetEventCount() > EVENT_UPLOAD_THRESHOLD;
-				}
+		gStats.storedEvents.store(remaining, std::memory_order_relaxed);
+	}
 
-				gUploadingCurrently.store(false);
-				if (shouldUpdate)
-				{
-					UpdateServer(false);
-				}
-			});
-			return true;
-		}
-		else if (response == "invalid_api_key")
-		{
-			LogDebug("[Amplitude] Invalid API key, make sure your API key is correct in initialize()");
-		}
-		else if (response == "bad_checksum")
-		{
-			LogDebug("[Amplitude] Bad checksum, post request was mangled in transit, will attempt to reupload later");
-		}
-		else if (response == "request_db_write_failed")
-		{
-			LogDebug(L"[Amplitude] Couldn't write to request database on server, will attempt to reupload later");
-		}
-		else
-		{
-			auto message = "Upload failed, " + response + ", will attempt to re-upload later";
-			LogDebug(message->Data());
-		}
+	auto delay = gRetryScheduler.RecordResult(result, Clock::MonotonicMillis());
 
-		return false;
-	}).then([](task<bool> t)
+	if (result != UploadResult::Success)
 	{
-		// task-based continuations always run; this
-		// is where we ensure that we always reset
-		// the uploading flag.
-		try
+		if (delay < 0)
 		{
-			t.get();
+			AMPLITUDE_LOG_ERROR("[Amplitude] Uploads are suspended until the app is restarted");
 		}
-		catch (Platform::Exception ^ex)
-		{
-			Log(ex->ToString());
-		}
-		catch (const std::exception &ex)
+		else
 		{
-			LogDebug(ex.what());
+			UpdateServerLater(delay);
 		}
+		return;
+	}
 
-		gUploadingCurrently.store(false);
-	});
+	if (remaining > EVENT_UPLOAD_THRESHOLD)
+	{
+		UpdateServer(false);
+	}
 }
 
 EventReporter::EventReporter()
@@ -3,11 +3,25 @@
 namespace Amplitude
 {
 	using Platform::String;
+	using Windows::Data::Json::IJsonValue;
 	using Windows::Data::Json::JsonArray;
 	using Windows::Data::Json::JsonObject;
 	using Windows::Foundation::IAsyncAction;
 	using Windows::Storage::ApplicationDataContainer;
 
+	class Database;
+	class IUploadTransport;
+	struct GlobalPropertiesSnapshot;
+	ref class FlushReport;
+	enum class UploadResult;
+	enum class WorkPriority;
+
+	// How far a Flush() has got; shared by the caller and the worker.
+	struct FlushProgress;
+
+	// An event from LogEvents(), validated but not yet built.
+	struct BatchedEvent;
+
 	// TODO(ben): Move from JsonObject in the interface to IMap<String, Object> so JavaScript can use this
 	[Windows::Foundation::Metadata::WebHostHidden]
 	public ref class EventReporter sealed
@@ -21,24 +35,152 @@ namespace Amplitude
 		static void LogEvent(String ^eventName);
 		static void LogEvent(String ^eventName, JsonObject ^properties);
 
+		// Logs a batch of events at once, in a single database transaction.
+		// Each entry is an object of the form
+		//
+		//   { "event_type": "...", "properties": { ... }, "timestamp": 1234 }
+		//
+		// where "properties" is optional and "timestamp", also optional, is
+		// in milliseconds since the epoch; e.g. when replaying events that
+		// were recorded offline.
+		static void LogEvents(JsonArray ^events);
+
+		// Logs an event that must not be lost when the app is logging faster
+		// than events can be stored; it jumps ahead of ordinary events, and
+		// is never dropped for lack of queue space.
+		static void LogCriticalEvent(String ^eventName, JsonObject ^properties);
+
+		// Throttles events of the given type to an average of eventsPerSecond,
+		// allowing bursts of up to 'burst' events.  Excess events are dropped
+		// before they are queued.  A non-positive rate removes the limit.
+		static void SetRateLimit(String ^eventType, double eventsPerSecond, int burst);
+
+		// Only reports events of the given type from this fraction of devices.
+		// Whether a device is in the sample depends only on its device ID, so
+		// it is stable across sessions.
+		static void SetSamplingRate(String ^eventType, double rate);
+
+		// Global properties are attached to every event logged after they
+		// are set.  Changing them never blocks logging.
+		static void SetGlobalProperty(String ^key, IJsonValue ^value);
+		static void UnsetGlobalProperty(String ^key);
+
+		// Merges events with the same name and properties, logged within
+		// windowMillis of the first, into one event with a "count" property,
+		// and a "last_timestamp" property for when the last of them was
+		// logged.  Matching events are held back for up to the window before
+		// being stored.  Zero (the default) turns coalescing off.
+		static void SetCoalescingWindow(int64 windowMillis);
+
+		// Events older than ttlMillis, by when they happened, are never
+		// uploaded; they're skipped when a batch is put together, and
+		// removed from the store a little at a time while the worker is
+		// idle.  Zero (the default) keeps events until they're uploaded.
+		static void SetEventTimeToLive(int64 ttlMillis);
+
+		// The number of events dropped so far, by rate limits and sampling,
+		// or because they arrived faster than they could be stored, or too
+		// many were waiting for the device ID to decide their sample.
+		static int64 GetDroppedEventCount();
+
+		// Counters for diagnostics: the work queue, what was dropped and
+		// why, the size of the store and how long it takes to use, and how
+		// uploads have gone.  Reading them never waits for the worker, so
+		// it's fine to call often; see the implementation for the layout.
+		static JsonObject^ GetStats();
+
+		// The most recent trace spans, from every thread, in Chrome's
+		// trace-event JSON format; save it to a file and open it in
+		// chrome://tracing or Perfetto.  Spans are only recorded in builds
+		// with AMPLITUDE_TRACING defined; otherwise the trace is empty.
+		static String^ ExportTrace();
+
+		// Counts occurrences in memory rather than logging an event for each;
+		// the counts are reported together, in one "aggregates" event, every
+		// minute and when the session ends.
+		static void Increment(String ^name);
+		static void Increment(String ^name, JsonObject ^properties);
+
+		// Like Increment, but records a value into a histogram with fixed,
+		// roughly logarithmic buckets.  The value must be finite.
+		static void Observe(String ^name, double value);
+		static void Observe(String ^name, double value, JsonObject ^properties);
+
 		static void UploadEvents();
 
+		// Stores everything logged so far, e.g. when the app is suspended:
+		// runs whatever is queued, writes it all in one transaction, and
+		// optionally sends a final upload.  Blocks for no more than
+		// timeoutMillis, and reports what it got done in that time.
+		static FlushReport^ Flush(int64 timeoutMillis, bool upload);
+
+	internal:
+		// Replaces the transport that uploads are sent through; the default
+		// posts to the Amplitude servers.  Takes effect for the next upload.
+		// The task completes with the transport it replaced, once it has.
+		static concurrency::task<std::shared_ptr<IUploadTransport>> SetUploadTransport(std::shared_ptr<IUploadTransport> transport);
+
 	private:
 		EventReporter();
 
-		static void CheckedLogEvent(String ^eventName, JsonObject ^eventProperties, JsonObject ^apiProperties, int64 timestamp, bool checkSession);
-		static int64 LogEvent(String ^eventName, JsonObject ^eventProperties, JsonObject ^apiProperties, int64 timestamp, bool checkSession);
-		static int64 LogEvent(JsonObject ^eventObj);
+		// 'deferred' events are held, once on the worker, until the device ID
+		// says whether they're in the sample.
+		//
+		// Events are stamped twice, when they're logged: 'timestamp' by the
+		// wall clock, to send, and 'monotonic' by Clock::MonotonicMillis(),
+		// to time the session by.
+		static void CheckedLogEvent(String ^eventName, JsonObject ^eventProperties, JsonObject ^apiProperties, int64 timestamp, int64 monotonic, bool checkSession, WorkPriority priority, bool deferred);
+		// 'globalProperties' is a snapshot's JSON; empty means "the current
+		// ones".
+		static int64 LogEvent(String ^eventName, JsonObject ^eventProperties, JsonObject ^apiProperties, int64 timestamp, int64 monotonic, bool checkSession, const std::wstring &globalProperties = std::wstring());
+		static int64 LogEvent(const std::wstring &event, int64 timestamp);
+
+		// Returns the event as it's stored.  A 'backdated' event from before
+		// the current session started is left out of it, and of the
+		// session's bookkeeping; see SessionTracker::PrecedesSession.
+		static std::wstring BuildEvent(String ^eventName, JsonObject ^eventProperties, JsonObject ^apiProperties, int64 timestamp, int64 monotonic, bool checkSession, const std::wstring &globalProperties, bool backdated = false);
+
+		static void LogEventBatch(const std::vector<BatchedEvent> &batch, std::shared_ptr<const GlobalPropertiesSnapshot> globalProperties);
+
+		// Stores events that overflowed the work queue and were written to
+		// disk instead; runs on the worker once it has caught up.
+		static void ReplaySpilledEvents(std::vector<std::wstring> &&records);
+
+		// Patches the device ID into events stored without it, and lets
+		// uploads go ahead.
+		static void OnDeviceIdResolved(String ^deviceId);
+
+		// Enforces the event limit and schedules an upload, as appropriate.
+		// During a flush, it only counts the events.
+		static void OnEventsStored(Database &db, int64 count);
+
+		// Removes expired events a chunk at a time, each at background
+		// priority, so that logging goes first.
+		static void SchedulePurge(int64 delayMillis);
+		static void PurgeExpiredEvents();
+
+		// 'deadline' is by Clock::MonotonicMillis().
+		static void FlushOnWorker(FlushProgress &progress, int64 deadline, bool upload);
 
 		static void UpdateServer(bool limit = true);
 		static void UpdateServerLater(int64 delayInMillis);
 
-		static void MakeEventUploadPostRequest(JsonArray ^events, int64 maxId);
+		static void OnUploadCompleted(UploadResult result, int64 remaining);
+
+		static void StartNewSessionIfNeeded(int64 timestamp, int64 monotonic);
+
+		// A session_end is held by the SessionTracker until the session can
+		// no longer be resumed, and only then stored, ahead of whatever was
+		// logged while it was held.
+		static void ScheduleSessionEndExpiry();
+		static void CommitExpiredSessionEnd(int64 now, int64 monotonic);
 
-		static void StartNewSessionIfNeeded(int64 timestamp);
-		static void StartNewSession(int64 timestamp);
+		static bool TryCoalesceEvent(String ^eventName, JsonObject ^eventProperties, const std::wstring &globalProperties, int64 timestamp, int64 monotonic);
+		static void ScheduleCoalescedFlush();
+		// 'now' is by Clock::MonotonicMillis().
+		static void FlushCoalescedEvents(int64 now, bool all);
 
-		static void OpenSession();
-		static void CloseSession();
+		static void ScheduleAggregateFlush();
+		static void FlushAggregates(int64 timestamp, int64 monotonic);
 	};
 }
@@ -0,0 +1,13 @@
+#include "pch.h"
+#include "FlushReport.h"
+
+using namespace Amplitude;
+
+FlushReport::FlushReport(int64 eventsPersisted, int64 eventsStored, bool completed, bool uploading, bool timedOut) :
+	eventsPersisted(eventsPersisted),
+	eventsStored(eventsStored),
+	completed(completed),
+	uploading(uploading),
+	timedOut(timedOut)
+{
+}
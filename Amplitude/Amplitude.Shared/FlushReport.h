@@ -0,0 +1,40 @@
+#pragma once
+
+namespace Amplitude
+{
+	// What EventReporter::Flush() managed to do before its deadline.
+	public ref class FlushReport sealed
+	{
+	public:
+		// Events written to the database by the flush, in one transaction.
+		property int64 EventsPersisted { int64 get() { return eventsPersisted; } }
+
+		// Events in the database afterwards, waiting to be uploaded; -1 if
+		// the flush didn't get that far.
+		property int64 EventsStored { int64 get() { return eventsStored; } }
+
+		// Whether everything queued before the flush was stored.  If not,
+		// whatever was left is still queued, and is lost if the app is
+		// terminated.
+		property bool Completed { bool get() { return completed; } }
+
+		// Whether an upload was under way when the flush finished.  It may
+		// still be waiting for a response, which is lost if the app is
+		// suspended first; the events are only deleted once it's accepted.
+		property bool Uploading { bool get() { return uploading; } }
+
+		// Whether the deadline passed before the worker reported back.  The
+		// other properties are then as far as it had got.
+		property bool TimedOut { bool get() { return timedOut; } }
+
+	internal:
+		FlushReport(int64 eventsPersisted, int64 eventsStored, bool completed, bool uploading, bool timedOut);
+
+	private:
+		int64 eventsPersisted;
+		int64 eventsStored;
+		bool completed;
+		bool uploading;
+		bool timedOut;
+	};
+}
@@ -0,0 +1,70 @@
+#include "pch.h"
+#include "GlobalProperties.h"
+
+using namespace Amplitude;
+
+using Platform::String;
+using Windows::Data::Json::JsonValue;
+
+GlobalProperties::GlobalProperties()
+{
+	auto snapshot = std::make_shared<GlobalPropertiesSnapshot>();
+	snapshot->json = L"{}";
+	current = snapshot;
+}
+
+std::shared_ptr<const GlobalPropertiesSnapshot>
+GlobalProperties::Current() const
+{
+	return std::atomic_load(&current);
+}
+
+void
+GlobalProperties::Set(const std::wstring &key, IJsonValue ^value)
+{
+	// Serialize outside of the lock; it's the expensive part.
+	std::wstring serialized(value->Stringify()->Data());
+
+	std::lock_guard<std::mutex> lock(writeMutex);
+	auto values = current->values;
+	values[key] = std::move(serialized);
+	Publish(std::move(values));
+}
+
+void
+GlobalProperties::Unset(const std::wstring &key)
+{
+	std::lock_guard<std::mutex> lock(writeMutex);
+	if (current->values.find(key) == current->values.end())
+	{
+		return;
+	}
+
+	auto values = current->values;
+	values.erase(key);
+	Publish(std::move(values));
+}
+
+void
+GlobalProperties::Publish(std::map<std::wstring, std::wstring> &&values)
+{
+	// The values are JSON already; only the keys need quoting.
+	std::wstring json(L"{");
+	for (const auto &entry : values)
+	{
+		if (json.size() > 1)
+		{
+			json.push_back(L',');
+		}
+		json.append(JsonValue::CreateStringValue(ref new String(entry.first.c_str()))->Stringify()->Data());
+		json.push_back(L':');
+		json.append(entry.second);
+	}
+	json.push_back(L'}');
+
+	auto snapshot = std::make_shared<GlobalPropertiesSnapshot>();
+	snapshot->values = std::move(values);
+	snapshot->json = std::move(json);
+
+	std::atomic_store(&current, std::shared_ptr<const GlobalPropertiesSnapshot>(snapshot));
+}
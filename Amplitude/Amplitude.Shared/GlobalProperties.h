@@ -0,0 +1,49 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace Amplitude
+{
+	using Windows::Data::Json::IJsonValue;
+
+	// An immutable set of global properties.  Values are serialized when the
+	// snapshot is built, so later changes to the caller's objects can't leak
+	// in, and the snapshot can be shared by any number of events.
+	struct GlobalPropertiesSnapshot
+	{
+		// Each value as JSON, by key; the next snapshot starts from these.
+		std::map<std::wstring, std::wstring> values;
+
+		// The whole set as a JSON object, serialized once, when the snapshot
+		// is published; events splice it in as it is.
+		std::wstring json;
+	};
+
+	// Publishes the current global properties.  Readers get the current
+	// snapshot without contending with writers; each change builds a new
+	// snapshot and swaps it in.
+	class GlobalProperties
+	{
+	public:
+		GlobalProperties();
+
+		GlobalProperties(GlobalProperties const&) = delete;
+		GlobalProperties& operator=(GlobalProperties const&) = delete;
+
+		std::shared_ptr<const GlobalPropertiesSnapshot> Current() const;
+
+		void Set(const std::wstring &key, IJsonValue ^value);
+		void Unset(const std::wstring &key);
+
+	private:
+		void Publish(std::map<std::wstring, std::wstring> &&values);
+
+		std::shared_ptr<const GlobalPropertiesSnapshot> current;
+
+		// Serializes writers; readers never take it.
+		std::mutex writeMutex;
+	};
+}
@@ -0,0 +1,477 @@
+#include "pch.h"
+#include "LoadGenerator.h"
+
+#if defined(_DEBUG) || defined(AMPLITUDE_LOAD_GENERATOR)
+
+#include "Clock.h"
+#include "EventReporter.h"
+#include "FlushReport.h"
+#include "LocalCollector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+using namespace Amplitude;
+using namespace concurrency;
+
+using Windows::Data::Json::IJsonValue;
+using Windows::Data::Json::JsonArray;
+using Windows::Data::Json::JsonObject;
+using Windows::Data::Json::JsonValue;
+using Windows::Data::Json::JsonValueType;
+
+static String ^ const LIVE_EVENT = L"load_event";
+static String ^ const BACKLOG_EVENT = L"load_backlog_event";
+
+// How often the run loop wakes up to log what's due.
+static const unsigned int kTickMillis = 10;
+
+// Backlog events are logged this many at a time.
+static const int kBacklogChunkSize = 500;
+
+// A copy of the generator's properties, for the run to use off the UI
+// thread.
+struct LoadOptions
+{
+	double eventsPerSecond;
+	int propertySize;
+	int64 durationMillis;
+	int64 sessionLengthMillis;
+	int64 offlinePeriodMillis;
+	int64 offlineDurationMillis;
+	int backlogEvents;
+	int64 backlogSpanMillis;
+	int64 collectorLatencyMillis;
+	int64 sampleIntervalMillis;
+	int64 settleMillis;
+};
+
+// What the collector has accepted so far.  Updated from whichever thread
+// answers each upload.
+struct LoadRun
+{
+	LoadRun() :
+		liveAccepted(0),
+		backlogAccepted(0),
+		lastLiveAccepted(0),
+		lastBacklogAccepted(0),
+		latencyCount(0),
+		maxLatency(0)
+	{
+	}
+
+	std::mutex mutex;
+
+	int64 liveAccepted;
+	int64 backlogAccepted;
+
+	// By GetTickCount64().
+	int64 lastLiveAccepted;
+	int64 lastBacklogAccepted;
+
+	// End-to-end latencies of live events, in milliseconds, rounded by
+	// Quantize(), with how often each was seen.
+	std::map<int64, int64> latencies;
+	int64 latencyCount;
+	int64 maxLatency;
+};
+
+// Rounds down to two significant figures, so percentiles are good to a few
+// per cent without keeping every sample.
+static int64 Quantize(int64 millis)
+{
+	int64 scale = 1;
+	while (millis / scale >= 100)
+	{
+		scale *= 10;
+	}
+	return millis / scale * scale;
+}
+
+static int64 GetPercentile(const LoadRun &run, double fraction)
+{
+	auto target = static_cast<int64>(std::ceil(run.latencyCount * fraction));
+	int64 seen = 0;
+	for (const auto &entry : run.latencies)
+	{
+		seen += entry.second;
+		if (seen >= target)
+		{
+			return entry.first;
+		}
+	}
+	return run.maxLatency;
+}
+
+static int64 GetTimestamp(JsonObject ^event)
+{
+	auto value = event->GetNamedValue("timestamp");
+	return value->ValueType == JsonValueType::String
+		? _wtoi64(value->GetString()->Data())
+		: static_cast<int64>(value->GetNumber());
+}
+
+static void OnEventAccepted(LoadRun &run, JsonObject ^event)
+{
+	auto type = event->GetNamedString("event_type", nullptr);
+	auto tick = static_cast<int64>(GetTickCount64());
+
+	if (type == BACKLOG_EVENT)
+	{
+		std::lock_guard<std::mutex> lock(run.mutex);
+		run.backlogAccepted++;
+		run.lastBacklogAccepted = tick;
+	}
+	else if (type == LIVE_EVENT)
+	{
+		auto latency = std::max(0LL, Clock::NowMillis() - GetTimestamp(event));
+
+		std::lock_guard<std::mutex> lock(run.mutex);
+		run.liveAccepted++;
+		run.lastLiveAccepted = tick;
+		run.latencies[Quantize(latency)]++;
+		run.latencyCount++;
+		run.maxLatency = std::max(run.maxLatency, latency);
+	}
+}
+
+static int64 GetMemoryUsage()
+{
+#if WINAPI_FAMILY == WINAPI_FAMILY_PHONE_APP
+	return static_cast<int64>(Windows::System::MemoryManager::AppMemoryUsage);
+#else
+	// Windows Store apps can't ask.
+	return -1;
+#endif
+}
+
+static IJsonValue^ ToJsonNumber(int64 value)
+{
+	return JsonValue::CreateNumberValue(static_cast<double>(value));
+}
+
+static int64 GetStat(JsonObject ^stats, String ^section, String ^name)
+{
+	return static_cast<int64>(stats->GetNamedObject(section)->GetNamedNumber(name));
+}
+
+static bool IsOffline(const LoadOptions &options, int64 elapsed)
+{
+	if (options.offlinePeriodMillis <= 0 || options.offlineDurationMillis <= 0)
+	{
+		return false;
+	}
+
+	// Offline at the end of each period, so the run starts online.
+	return elapsed % options.offlinePeriodMillis >= options.offlinePeriodMillis - options.offlineDurationMillis;
+}
+
+static JsonObject^ MakeProperties(String ^payload, int64 sequence)
+{
+	auto properties = ref new JsonObject();
+	properties->Insert("payload", JsonValue::CreateStringValue(payload));
+	properties->Insert("sequence", ToJsonNumber(sequence));
+	return properties;
+}
+
+static void LogBacklog(const LoadOptions &options, String ^payload)
+{
+	auto now = Clock::NowMillis();
+	auto spacing = options.backlogSpanMillis / std::max(1, options.backlogEvents);
+
+	for (int first = 0; first < options.backlogEvents; first += kBacklogChunkSize)
+	{
+		auto events = ref new JsonArray();
+		auto last = std::min(options.backlogEvents, first + kBacklogChunkSize);
+		for (int i = first; i < last; ++i)
+		{
+			auto event = ref new JsonObject();
+			event->Insert("event_type", JsonValue::CreateStringValue(BACKLOG_EVENT));
+			event->Insert("properties", MakeProperties(payload, i));
+			event->Insert("timestamp", ToJsonNumber(now - options.backlogSpanMillis + i * spacing));
+			events->Append(event);
+		}
+		EventReporter::LogEvents(events);
+	}
+
+	// Make sure it's all in the store before the collector comes online.
+	EventReporter::Flush(60 * 1000, false);
+}
+
+// Puts back the upload transport a run replaced, however the run ends.
+class TransportRestorer
+{
+public:
+	TransportRestorer(std::shared_ptr<IUploadTransport> previous) :
+		previous(previous)
+	{
+	}
+
+	TransportRestorer(TransportRestorer const&) = delete;
+	TransportRestorer& operator=(TransportRestorer const&) = delete;
+
+	~TransportRestorer()
+	{
+		if (previous == nullptr)
+		{
+			return;
+		}
+
+		try
+		{
+			EventReporter::SetUploadTransport(previous).wait();
+		}
+		catch (Platform::Exception^)
+		{
+			// The reporter is shutting down; there's nothing left to send.
+		}
+	}
+
+private:
+	std::shared_ptr<IUploadTransport> previous;
+};
+
+static String^ Run(const LoadOptions &options, String ^apiKey, progress_reporter<String^> reporter)
+{
+	auto run = std::make_shared<LoadRun>();
+	std::weak_ptr<LoadRun> weakRun = run;
+
+	LocalCollectorOptions collectorOptions;
+	collectorOptions.latencyMillis = options.collectorLatencyMillis;
+	collectorOptions.onEventAccepted = [weakRun](JsonObject ^event)
+	{
+		// Uploads still in flight when the run ends are answered after it.
+		if (auto run = weakRun.lock())
+		{
+			OnEventAccepted(*run, event);
+		}
+	};
+
+	auto collector = std::make_shared<LocalCollector>(apiKey, collectorOptions);
+	TransportRestorer restorer(EventReporter::SetUploadTransport(collector).get());
+
+	auto payload = ref new String(std::wstring(std::max(0, options.propertySize), L'x').c_str());
+
+	if (options.backlogEvents > 0)
+	{
+		collector->SetOffline(true);
+		LogBacklog(options, payload);
+	}
+
+	auto start = static_cast<int64>(GetTickCount64());
+	auto nextSample = options.sampleIntervalMillis;
+	auto nextSession = options.sessionLengthMillis;
+	auto lastSampleAccepted = 0LL;
+	auto logged = 0LL;
+	auto settling = false;
+
+	auto peakMemory = GetMemoryUsage();
+	auto peakStoreBytes = 0LL;
+	auto peakStoredEvents = 0LL;
+
+	EventReporter::StartSession();
+
+	for (;;)
+	{
+		auto now = static_cast<int64>(GetTickCount64());
+		auto elapsed = now - start;
+
+		if (!settling && elapsed >= options.durationMillis)
+		{
+			// Stop logging, and give everything a chance to go up.
+			settling = true;
+			EventReporter::EndSession();
+			collector->SetOffline(false);
+			EventReporter::UploadEvents();
+		}
+
+		if (!settling)
+		{
+			collector->SetOffline(IsOffline(options, elapsed));
+
+			if (options.sessionLengthMillis > 0 && elapsed >= nextSession)
+			{
+				EventReporter::EndSession();
+				EventReporter::StartSession();
+				nextSession += options.sessionLengthMillis;
+			}
+
+			auto due = static_cast<int64>(elapsed * options.eventsPerSecond / 1000.0);
+			for (; logged < due; ++logged)
+			{
+				EventReporter::LogEvent(LIVE_EVENT, MakeProperties(payload, logged));
+			}
+		}
+		else
+		{
+			// Uploads go oldest first, so once the live events are in, so is
+			// whatever was left of the backlog; some of it may have been
+			// evicted to keep the store within its limit.
+			bool drained;
+			{
+				std::lock_guard<std::mutex> lock(run->mutex);
+				drained = run->liveAccepted >= logged;
+			}
+
+			if (drained || elapsed >= options.durationMillis + options.settleMillis)
+			{
+				break;
+			}
+		}
+
+		if (elapsed >= nextSample)
+		{
+			auto stats = EventReporter::GetStats();
+			auto memory = GetMemoryUsage();
+			auto storedEvents = GetStat(stats, "store", "events");
+			auto storeBytes = GetStat(stats, "store", "bytes");
+
+			peakMemory = std::max(peakMemory, memory);
+			peakStoredEvents = std::max(peakStoredEvents, storedEvents);
+			peakStoreBytes = std::max(peakStoreBytes, storeBytes);
+
+			int64 accepted;
+			{
+				std::lock_guard<std::mutex> lock(run->mutex);
+				accepted = run->liveAccepted + run->backlogAccepted;
+			}
+
+			auto sample = ref new JsonObject();
+			sample->Insert("elapsed_ms", ToJsonNumber(elapsed));
+			sample->Insert("offline", JsonValue::CreateBooleanValue(!settling && IsOffline(options, elapsed)));
+			sample->Insert("logged", ToJsonNumber(logged));
+			sample->Insert("accepted", ToJsonNumber(accepted));
+			sample->Insert("accepted_per_second", JsonValue::CreateNumberValue((accepted - lastSampleAccepted) * 1000.0 / options.sampleIntervalMillis));
+			sample->Insert("queue_depth", ToJsonNumber(GetStat(stats, "queue", "depth")));
+			sample->Insert("stored_events", ToJsonNumber(storedEvents));
+			sample->Insert("store_bytes", ToJsonNumber(storeBytes));
+			sample->Insert("memory_bytes", ToJsonNumber(memory));
+			reporter.report(sample->Stringify());
+
+			lastSampleAccepted = accepted;
+			nextSample += options.sampleIntervalMillis;
+		}
+
+		wait(kTickMillis);
+	}
+
+	auto end = static_cast<int64>(GetTickCount64());
+	auto stats = EventReporter::GetStats();
+	auto collectorStats = collector->GetStats();
+
+	std::lock_guard<std::mutex> lock(run->mutex);
+
+	auto latency = ref new JsonObject();
+	latency->Insert("count", ToJsonNumber(run->latencyCount));
+	latency->Insert("p50", ToJsonNumber(GetPercentile(*run, 0.50)));
+	latency->Insert("p90", ToJsonNumber(GetPercentile(*run, 0.90)));
+	latency->Insert("p99", ToJsonNumber(GetPercentile(*run, 0.99)));
+	latency->Insert("max", ToJsonNumber(run->maxLatency));
+
+	// Up to when the last event went up, rather than to when the run gave
+	// up waiting.
+	auto acceptedSpan = run->lastLiveAccepted > start ? run->lastLiveAccepted - start : end - start;
+
+	auto backlog = ref new JsonObject();
+	backlog->Insert("logged", ToJsonNumber(options.backlogEvents));
+	backlog->Insert("accepted", ToJsonNumber(run->backlogAccepted));
+	backlog->Insert("drain_ms", run->backlogAccepted > 0 ? ToJsonNumber(run->lastBacklogAccepted - start) : JsonValue::CreateNullValue());
+
+	auto collected = ref new JsonObject();
+	collected->Insert("requests", ToJsonNumber(collectorStats.requests));
+	collected->Insert("network_errors", ToJsonNumber(collectorStats.networkErrors));
+	collected->Insert("rejected", ToJsonNumber(collectorStats.rejected));
+	collected->Insert("accepted_events", ToJsonNumber(collectorStats.acceptedEvents));
+	collected->Insert("accepted_bytes", ToJsonNumber(collectorStats.acceptedBytes));
+
+	auto summary = ref new JsonObject();
+	summary->Insert("elapsed_ms", ToJsonNumber(end - start));
+	summary->Insert("logged", ToJsonNumber(logged));
+	summary->Insert("accepted", ToJsonNumber(run->liveAccepted));
+	summary->Insert("logged_per_second", JsonValue::CreateNumberValue(logged * 1000.0 / std::max(1LL, options.durationMillis)));
+	summary->Insert("accepted_per_second", JsonValue::CreateNumberValue(run->liveAccepted * 1000.0 / std::max(1LL, acceptedSpan)));
+	summary->Insert("latency_ms", latency);
+	summary->Insert("peak_memory_bytes", ToJsonNumber(std::max(peakMemory, GetMemoryUsage())));
+	summary->Insert("peak_stored_events", ToJsonNumber(peakStoredEvents));
+	summary->Insert("peak_store_bytes", ToJsonNumber(peakStoreBytes));
+	summary->Insert("backlog", backlog);
+	summary->Insert("collector", collected);
+	summary->Insert("reporter", stats);
+	return summary->Stringify();
+}
+
+LoadGenerator::LoadGenerator()
+{
+	EventsPerSecond = 10.0;
+	PropertySize = 64;
+	DurationMillis = 60 * 1000;
+	SessionLengthMillis = 0;
+	OfflinePeriodMillis = 0;
+	OfflineDurationMillis = 0;
+	BacklogEvents = 0;
+	BacklogSpanMillis = 0;
+	CollectorLatencyMillis = 100;
+	SampleIntervalMillis = 1000;
+	SettleMillis = 2 * 60 * 1000;
+}
+
+LoadGenerator^
+LoadGenerator::CreateOneHourBurst()
+{
+	auto generator = ref new LoadGenerator();
+	generator->EventsPerSecond = 50.0;
+	generator->PropertySize = 256;
+	generator->DurationMillis = 60 * 60 * 1000;
+	generator->SessionLengthMillis = 5 * 60 * 1000;
+	generator->OfflinePeriodMillis = 15 * 60 * 1000;
+	generator->OfflineDurationMillis = 60 * 1000;
+	generator->CollectorLatencyMillis = 200;
+	generator->SampleIntervalMillis = 10 * 1000;
+	return generator;
+}
+
+LoadGenerator^
+LoadGenerator::CreateTwoDayOfflineDrain()
+{
+	auto generator = ref new LoadGenerator();
+
+	// An event a minute, for two days.
+	generator->BacklogEvents = 2 * 24 * 60;
+	generator->BacklogSpanMillis = 2LL * 24 * 60 * 60 * 1000;
+
+	generator->EventsPerSecond = 1.0;
+	generator->PropertySize = 128;
+	generator->DurationMillis = 10 * 60 * 1000;
+	generator->SessionLengthMillis = 2 * 60 * 1000;
+	generator->CollectorLatencyMillis = 200;
+	generator->SampleIntervalMillis = 5 * 1000;
+	return generator;
+}
+
+IAsyncOperationWithProgress<String^, String^>^
+LoadGenerator::RunAsync(String ^apiKey)
+{
+	LoadOptions options;
+	options.eventsPerSecond = EventsPerSecond;
+	options.propertySize = PropertySize;
+	options.durationMillis = DurationMillis;
+	options.sessionLengthMillis = SessionLengthMillis;
+	options.offlinePeriodMillis = OfflinePeriodMillis;
+	options.offlineDurationMillis = OfflineDurationMillis;
+	options.backlogEvents = BacklogEvents;
+	options.backlogSpanMillis = BacklogSpanMillis;
+	options.collectorLatencyMillis = CollectorLatencyMillis;
+	options.sampleIntervalMillis = std::max(1LL, SampleIntervalMillis);
+	options.settleMillis = SettleMillis;
+
+	return create_async([options, apiKey](progress_reporter<String^> reporter)
+	{
+		return Run(options, apiKey, reporter);
+	});
+}
+
+#endif
@@ -0,0 +1,80 @@
+#pragma once
+
+// Not for release builds; define AMPLITUDE_LOAD_GENERATOR to get it anyway.
+#if defined(_DEBUG) || defined(AMPLITUDE_LOAD_GENERATOR)
+
+namespace Amplitude
+{
+	using Platform::String;
+	using Windows::Foundation::IAsyncOperationWithProgress;
+
+	// Drives EventReporter the way a busy app would: a steady stream of
+	// events with properties of a given size, sessions starting and ending,
+	// and spells without a network.  Uploads go to a LocalCollector, which
+	// the generator takes offline and online again as configured.
+	//
+	// For soak and load testing; an app shouldn't run it against a reporter
+	// it means to send real events with.
+	[Windows::Foundation::Metadata::WebHostHidden]
+	public ref class LoadGenerator sealed
+	{
+	public:
+		LoadGenerator();
+
+		// Events logged per second, spread evenly over the run.
+		property double EventsPerSecond;
+
+		// The length of the string property attached to each event.
+		property int PropertySize;
+
+		// How long to log events for.
+		property int64 DurationMillis;
+
+		// Ends the session and starts a new one this often; zero never does.
+		property int64 SessionLengthMillis;
+
+		// Every OfflinePeriodMillis, the collector is unreachable for the
+		// first OfflineDurationMillis.  Zero for either stays online.
+		property int64 OfflinePeriodMillis;
+		property int64 OfflineDurationMillis;
+
+		// Events logged up front, while the collector is offline, stamped
+		// evenly over the BacklogSpanMillis before the run; the collector
+		// comes online when the run starts, and the report says how long the
+		// backlog took to drain.
+		property int BacklogEvents;
+		property int64 BacklogSpanMillis;
+
+		// How long the collector takes to answer each request.
+		property int64 CollectorLatencyMillis;
+
+		// How often to report progress.
+		property int64 SampleIntervalMillis;
+
+		// How long to wait, once logging has stopped, for what was logged to
+		// be uploaded.
+		property int64 SettleMillis;
+
+		// An hour of heavy logging with short sessions and a minute offline
+		// every quarter of an hour.
+		static LoadGenerator^ CreateOneHourBurst();
+
+		// Two days' worth of events logged offline, then ten minutes of
+		// light logging while they drain.
+		static LoadGenerator^ CreateTwoDayOfflineDrain();
+
+		// Runs the scenario against a reporter already initialized with the
+		// given API key.  Replaces the reporter's upload transport with the
+		// collector while it runs, and puts the old one back when it's done.
+		//
+		// Progress is one JSON object per sample interval: what has been
+		// logged and accepted so far, throughput over the interval, the queue
+		// depth, the size of the store and the app's memory usage.  The
+		// result is a JSON summary: sustained throughput, end-to-end latency
+		// percentiles, peak memory and store size, the backlog drain, and the
+		// reporter's own stats.
+		IAsyncOperationWithProgress<String^, String^>^ RunAsync(String ^apiKey);
+	};
+}
+
+#endif
@@ -0,0 +1,184 @@
+#include "pch.h"
+#include "LocalCollector.h"
+
+#include <chrono>
+
+using namespace Amplitude;
+using namespace concurrency;
+
+using Windows::Data::Json::JsonArray;
+using Windows::Foundation::TimeSpan;
+using Windows::System::Threading::ThreadPoolTimer;
+using Windows::System::Threading::TimerElapsedHandler;
+
+static task<void> Delay(int64 millis)
+{
+	task_completion_event<void> tce;
+	if (millis <= 0)
+	{
+		tce.set();
+		return create_task(tce);
+	}
+
+	TimeSpan delay;
+	delay.Duration = millis * 10000;
+
+	ThreadPoolTimer::CreateTimer(ref new TimerElapsedHandler([tce](ThreadPoolTimer ^ignored)
+	{
+		tce.set();
+	}), delay);
+
+	return create_task(tce);
+}
+
+static String^ Field(IMap<String^, String^> ^params, String ^key)
+{
+	return params->HasKey(key) ? params->Lookup(key) : nullptr;
+}
+
+static int64 Utf8Length(String ^str)
+{
+	return WideCharToMultiByte(CP_UTF8, 0, str->Data(), str->Length(), nullptr, 0, nullptr, nullptr);
+}
+
+LocalCollectorOptions::LocalCollectorOptions() :
+	latencyMillis(0),
+	networkErrorRate(0.0),
+	badChecksumRate(0.0),
+	dbWriteFailedRate(0.0),
+	fixedResponse(nullptr),
+	verifyChecksum(true)
+{
+}
+
+LocalCollector::LocalCollector(String ^apiKey, const LocalCollectorOptions &options) :
+	apiKey(apiKey),
+	options(options),
+	rng(static_cast<unsigned int>(std::chrono::high_resolution_clock::now().time_since_epoch().count())),
+	offline(false),
+	requests(0),
+	networkErrors(0),
+	rejected(0),
+	acceptedEvents(0),
+	acceptedBytes(0)
+{
+}
+
+task<String^>
+LocalCollector::Post(IMap<String^, String^> ^params)
+{
+	++requests;
+
+	auto self = shared_from_this();
+	auto dropped = offline.load() || Roll(options.networkErrorRate);
+	return Delay(options.latencyMillis).then([self, params, dropped]() -> String^
+	{
+		if (dropped)
+		{
+			++self->networkErrors;
+			throw ref new Platform::FailureException(L"LocalCollector: simulated network failure");
+		}
+
+		return self->Respond(params);
+	});
+}
+
+String^
+LocalCollector::Respond(IMap<String^, String^> ^params)
+{
+	if (Roll(options.badChecksumRate))
+	{
+		++rejected;
+		return L"bad_checksum";
+	}
+
+	if (Roll(options.dbWriteFailedRate))
+	{
+		++rejected;
+		return L"request_db_write_failed";
+	}
+
+	if (options.fixedResponse != nullptr)
+	{
+		if (options.fixedResponse != L"success")
+		{
+			++rejected;
+		}
+		return options.fixedResponse;
+	}
+
+	auto client = Field(params, L"client");
+	if (client == nullptr || client != apiKey)
+	{
+		++rejected;
+		return L"invalid_api_key";
+	}
+
+	auto json = Field(params, L"e");
+	if (json == nullptr)
+	{
+		++rejected;
+		return L"missing_event";
+	}
+
+	if (options.verifyChecksum)
+	{
+		auto expected = ComputeUploadChecksum(Field(params, L"v"), client, json, Field(params, L"upload_time"));
+		if (expected != Field(params, L"checksum"))
+		{
+			++rejected;
+			return L"bad_checksum";
+		}
+	}
+
+	JsonArray ^events;
+	if (!JsonArray::TryParse(json, &events))
+	{
+		++rejected;
+		return L"invalid_event_json";
+	}
+
+	acceptedEvents += events->Size;
+	acceptedBytes += Utf8Length(json);
+
+	if (options.onEventAccepted)
+	{
+		for (unsigned int i = 0; i < events->Size; ++i)
+		{
+			options.onEventAccepted(events->GetObjectAt(i));
+		}
+	}
+	return L"success";
+}
+
+bool
+LocalCollector::Roll(double rate)
+{
+	if (rate <= 0.0)
+	{
+		return false;
+	}
+
+	std::uniform_real_distribution<double> dist(0.0, 1.0);
+
+	std::lock_guard<std::mutex> lock(rngMutex);
+	return dist(rng) < rate;
+}
+
+LocalCollectorStats
+LocalCollector::GetStats() const
+{
+	LocalCollectorStats stats;
+	stats.requests = requests.load();
+	stats.networkErrors = networkErrors.load();
+	stats.rejected = rejected.load();
+	stats.acceptedEvents = acceptedEvents.load();
+	stats.acceptedBytes = acceptedBytes.load();
+	return stats;
+}
+
+void
+LocalCollector::SetOffline(bool offline)
+{
+	this->offline = offline;
+}
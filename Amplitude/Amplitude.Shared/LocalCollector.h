@@ -0,0 +1,90 @@
+#pragma once
+
+#include "UploadTransport.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+
+namespace Amplitude
+{
+	using Windows::Data::Json::JsonObject;
+
+	// Knobs for LocalCollector.  Rates are probabilities in [0, 1], evaluated
+	// independently per request, in the order they are declared.
+	struct LocalCollectorOptions
+	{
+		LocalCollectorOptions();
+
+		// How long each request takes to be answered.
+		int64 latencyMillis;
+
+		// Fraction of requests that fail as if the network were down.
+		double networkErrorRate;
+
+		// Fraction of requests answered with "bad_checksum" regardless of content.
+		double badChecksumRate;
+
+		// Fraction of requests answered with "request_db_write_failed".
+		double dbWriteFailedRate;
+
+		// If set, every request that gets this far is answered with this body.
+		String ^fixedResponse;
+
+		// Recompute each request's checksum, and reject mismatches as the
+		// real collector would.
+		bool verifyChecksum;
+
+		// If set, called with each event of every accepted upload, on
+		// whichever thread answers the request.
+		std::function<void(JsonObject ^event)> onEventAccepted;
+	};
+
+	// What a LocalCollector has seen so far.
+	struct LocalCollectorStats
+	{
+		int64 requests;
+		int64 networkErrors;
+		int64 rejected;
+		int64 acceptedEvents;
+		int64 acceptedBytes;
+	};
+
+	// An in-process stand-in for the Amplitude collector.  It answers uploads
+	// the way the real one does, with configurable latency and injected
+	// failures, so the upload path can be exercised without a network.
+	//
+	// Must be owned by a std::shared_ptr, as pending replies keep it alive.
+	class LocalCollector : public IUploadTransport, public std::enable_shared_from_this<LocalCollector>
+	{
+	public:
+		explicit LocalCollector(String ^apiKey, const LocalCollectorOptions &options = LocalCollectorOptions());
+
+		concurrency::task<String^> Post(IMap<String^, String^> ^params) override;
+
+		LocalCollectorStats GetStats() const;
+
+		// While offline, every request fails as if the network were down.
+		void SetOffline(bool offline);
+
+	private:
+		String^ Respond(IMap<String^, String^> ^params);
+		bool Roll(double rate);
+
+		String ^apiKey;
+		LocalCollectorOptions options;
+
+		std::mutex rngMutex;
+		std::minstd_rand rng;
+
+		std::atomic<bool> offline;
+
+		std::atomic<int64> requests;
+		std::atomic<int64> networkErrors;
+		std::atomic<int64> rejected;
+		std::atomic<int64> acceptedEvents;
+		std::atomic<int64> acceptedBytes;
+	};
+}
@@ -1,9 +1,10 @@
 #include "pch.h"
 #include "Settings.h"
 #include "constants.h"
+#include "Logger.h"
 
+#include <cwchar>
 #include <string>
-#include <unordered_set>
 
 using namespace Amplitude;
 using namespace Platform;
@@ -19,19 +20,28 @@ using Windows::System::Profile::HardwareIdentification;
 using Windows::System::UserProfile::AdvertisingManager;
 using Windows::System::UserProfile::GlobalizationPreferences;
 
+// IDs that whole batches of devices report, and so identify nothing.
+static const wchar_t * const kInvalidDeviceIds[] =
+{
+	L"",
+	L"9774d56d682e549c",
+	L"unknown",
+	L"DEFACE",
+	L"000000000000000"
+};
+
 static bool
 IsValid(Platform::String ^deviceId)
 {
-	std::unordered_set<std::wstring> invalidIds = {
-		std::wstring(L""),
-		L"9774d56d682e549c",
-		L"unknown",
-		L"DEFACE",
-		L"000000000000000"
-	};
-
-	std::wstring wideId(deviceId->Data());
-	return invalidIds.find(wideId) == invalidIds.end();
+	auto id = deviceId->Data();
+	for (auto invalidId : kInvalidDeviceIds)
+	{
+		if (wcscmp(id, invalidId) == 0)
+		{
+			return false;
+		}
+	}
+	return true;
 }
 
 static String^
@@ -198,6 +208,7 @@ public:
 	~Impl();
 
 	String^ GetDeviceId();
+	String^ GetStoredDeviceId();
 	String^ GetAdvertisingId();
 	String^ GetArchitecture();
 
@@ -210,8 +221,8 @@ public:
 	int64 GetLastEventTime();
 	int64 GetLastEventId();
 
+	std::wstring GetPendingSessionEnd();
 	int64 GetLastEndSessionTime();
-	int64 GetLastEndSessionId();
 
 	int64 GetLastSessionTime();
 	int64 GetLastSessionId();
@@ -219,7 +230,7 @@ public:
 	void SetLastEventId(int64 eventId);
 	void SetLastEventTime(int64 timestamp);
 
-	void SetLastEndSessionId(int64 sessionId);
+	void SetPendingSessionEnd(const std::wstring &event);
 	void SetLastEndSessionTime(int64 timestamp);
 
 	void SetLastSessionId(int64 sessionId);
@@ -240,8 +251,8 @@ private:
 	Int64Setting lastEventTime;
 	Int64Setting lastEventId;
 
+	StringSetting pendingSessionEnd;
 	Int64Setting lastEndSessionTime;
-	Int64Setting lastEndSessionId;
 
 	Int64Setting lastSessionTime;
 	Int64Setting lastSessionId;
@@ -252,8 +263,8 @@ Settings::Impl::Impl(ApplicationDataContainer ^settings) :
 	advertisingId(settings, PREF_ADVERTISING_ID),
 	lastEventTime(settings, PREF_PREVIOUS_EVENT_TIME),
 	lastEventId(settings, PREF_PREVIOUS_EVENT_ID),
+	pendingSessionEnd(settings, PREF_PENDING_SESSION_END),
 	lastEndSessionTime(settings, PREF_PREVIOUS_SESSION_END_TIME),
-	lastEndSessionId(settings, PREF_PREVIOUS_SESSION_END_ID),
 	lastSessionTime(settings, PREF_PREVIOUS_SESSION_TIME),
 	lastSessionId(settings, PREF_PREVIOUS_SESSION_ID)
 {
@@ -320,16 +331,17 @@ Settings::Impl::GetArchitecture()
 	return architecture;
 }
 
-int64
-Settings::Impl::GetLastEndSessionTime()
+std::wstring
+Settings::Impl::GetPendingSessionEnd()
 {
-	return lastEndSessionTime.Get(-1);
+	auto event = pendingSessionEnd.Get(nullptr);
+	return event == nullptr ? std::wstring() : std::wstring(event->Data(), event->Length());
 }
 
 int64
-Settings::Impl::GetLastEndSessionId()
+Settings::Impl::GetLastEndSessionTime()
 {
-	return lastEndSessionId.Get(-1);
+	return lastEndSessionTime.Get(-1);
 }
 
 int64
@@ -450,6 +462,12 @@ Settings::Impl::GetDeviceId()
 	throw ref new COMException(hresult);
 }
 
+String^
+Settings::Impl::GetStoredDeviceId()
+{
+	return deviceId.Get(nullptr);
+}
+
 void
 Settings::Impl::SetLastEventId(int64 eventId)
 {
@@ -463,9 +481,19 @@ Settings::Impl::SetLastEventTime(int64 timestamp)
 }
 
 void
-Settings::Impl::SetLastEndSessionId(int64 sessionId)
+Settings::Impl::SetPendingSessionEnd(const std::wstring &event)
 {
-	lastEndSessionId.Set(sessionId);
+	try
+	{
+		pendingSessionEnd.Set(ref new String(event.data(), static_cast<unsigned int>(event.length())));
+	}
+	catch (Exception ^ex)
+	{
+		// Settings hold no more than 8KB each, and the event carries the
+		// global properties.  It's still held in memory.
+		AMPLITUDE_LOG_WARNING("[Amplitude] Couldn't journal the session_end");
+		pendingSessionEnd.Clear();
+	}
 }
 
 void
@@ -489,7 +517,7 @@ Settings::Impl::SetLastSessionTime(int64 timestamp)
 void
 Settings::Impl::ClearEndSession()
 {
-	lastEndSessionId.Clear();
+	pendingSessionEnd.Clear();
 	lastEndSessionTime.Clear();
 }
 
@@ -504,6 +532,12 @@ Settings::GetDeviceId()
 	return impl->GetDeviceId();
 }
 
+String^
+Settings::GetStoredDeviceId()
+{
+	return impl->GetStoredDeviceId();
+}
+
 String^
 Settings::GetAdvertisingId()
 {
@@ -552,16 +586,16 @@ Settings::GetLastEventId()
 	return impl->GetLastEventId();
 }
 
-int64
-Settings::GetLastEndSessionTime()
+std::wstring
+Settings::GetPendingSessionEnd()
 {
-	return impl->GetLastEndSessionTime();
+	return impl->GetPendingSessionEnd();
 }
 
 int64
-Settings::GetLastEndSessionId()
+Settings::GetLastEndSessionTime()
 {
-	return impl->GetLastEndSessionId();
+	return impl->GetLastEndSessionTime();
 }
 
 int64
@@ -589,9 +623,9 @@ Settings::SetLastEventTime(int64 timestamp)
 }
 
 void
-Settings::SetLastEndSessionId(int64 sessionId)
+Settings::SetPendingSessionEnd(const std::wstring &event)
 {
-	impl->SetLastEndSessionId(sessionId);
+	impl->SetPendingSessionEnd(event);
 }
 
 void
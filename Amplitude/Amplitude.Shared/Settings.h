@@ -1,18 +1,24 @@
 #pragma once
 
+#include "SessionTracker.h"
+
 namespace Amplitude
 {
 	using Platform::Object;
 	using Platform::String;
 	using Windows::Storage::ApplicationDataContainer;
 
-	class Settings
+	class Settings : public ISessionStore
 	{
 	public:
 		Settings(ApplicationDataContainer ^settings);
 
 	public:
 		String^ GetDeviceId();
+
+		// The device ID from an earlier run, without resolving one if
+		// there isn't; null in that case.
+		String^ GetStoredDeviceId();
 		String^ GetAdvertisingId();
 		String^ GetArchitecture();
 
@@ -22,25 +28,26 @@ namespace Amplitude
 		String^ GetAppPackage();
 		String^ GetAppVersion();
 
-		int64 GetLastEventTime();
+		int64 GetLastEventTime() override;
 		int64 GetLastEventId();
 
-		int64 GetLastEndSessionTime();
-		int64 GetLastEndSessionId();
+		std::wstring GetPendingSessionEnd() override;
+		int64 GetLastEndSessionTime() override;
 
 		int64 GetLastSessionTime();
-		int64 GetLastSessionId();
+		int64 GetLastSessionId() override;
 
 		void SetLastEventId(int64 eventId);
-		void SetLastEventTime(int64 timestamp);
+		void SetLastEventTime(int64 timestamp) override;
 
-		void SetLastEndSessionId(int64 sessionId);
-		void SetLastEndSessionTime(int64 timestamp);
+		// Best effort; a session_end too big for a setting isn't journaled.
+		void SetPendingSessionEnd(const std::wstring &event) override;
+		void SetLastEndSessionTime(int64 timestamp) override;
 
-		void SetLastSessionId(int64 sessionId);
+		void SetLastSessionId(int64 sessionId) override;
 		void SetLastSessionTime(int64 timestamp);
 
-		void ClearEndSession();
+		void ClearEndSession() override;
 
 	private:
 		class Impl;
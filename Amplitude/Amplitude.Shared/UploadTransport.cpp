@@ -0,0 +1,128 @@
+#include "pch.h"
+#include "constants.h"
+#include "Logger.h"
+#include "UploadTransport.h"
+#include "Trace.h"
+
+using namespace Amplitude;
+using namespace concurrency;
+
+using Windows::Web::Http::HttpClient;
+using Windows::Web::Http::HttpFormUrlEncodedContent;
+using Windows::Web::Http::HttpResponseMessage;
+
+String^
+Amplitude::ComputeUploadChecksum(String ^apiVersion, String ^apiKey, String ^json, String ^uploadTime)
+{
+	UploadRequest request;
+	request.apiVersion = apiVersion->Data();
+	request.apiKey = apiKey->Data();
+	request.events = json->Data();
+	request.uploadTime = uploadTime->Data();
+	return ref new String(ComputeUploadChecksum(request).c_str());
+}
+
+UploadResult
+Amplitude::ClassifyUploadResponse(String ^response)
+{
+	if (response == "success")
+	{
+		return UploadResult::Success;
+	}
+	else if (response == "invalid_api_key")
+	{
+		AMPLITUDE_LOG_ERROR("[Amplitude] Invalid API key, make sure your API key is correct in initialize()");
+		return UploadResult::InvalidApiKey;
+	}
+	else if (response == "bad_checksum")
+	{
+		AMPLITUDE_LOG_WARNING("[Amplitude] Bad checksum, post request was mangled in transit, will attempt to reupload later");
+		return UploadResult::BadChecksum;
+	}
+	else if (response == "request_db_write_failed")
+	{
+		AMPLITUDE_LOG_WARNING(L"[Amplitude] Couldn't write to request database on server, will attempt to reupload later");
+		return UploadResult::RequestDbWriteFailed;
+	}
+	else
+	{
+		AMPLITUDE_LOG_WARNING(("[Amplitude] Upload failed, " + response + ", will attempt to re-upload later")->Data());
+		return UploadResult::UnknownResponse;
+	}
+}
+
+HttpUploadTransport::HttpUploadTransport() : client(ref new HttpClient())
+{
+}
+
+task<String^>
+HttpUploadTransport::Post(IMap<String^, String^> ^params)
+{
+	auto content = ref new HttpFormUrlEncodedContent(params);
+
+	return create_task(client->PostAsync(EVENT_UPLOAD_URI, content)).then([](HttpResponseMessage ^response)
+	{
+		return create_task(response->Content->ReadAsStringAsync());
+	});
+}
+
+TransportUploadSender::TransportUploadSender(std::shared_ptr<IUploadTransport> transport) :
+	transport(transport)
+{
+}
+
+std::shared_ptr<IUploadTransport>
+TransportUploadSender::SetTransport(std::shared_ptr<IUploadTransport> transport)
+{
+	auto previous = std::move(this->transport);
+	this->transport = transport;
+	return previous;
+}
+
+void
+TransportUploadSender::Send(const UploadRequest &request, UniqueFunction<void(UploadResult)> done)
+{
+	AMPLITUDE_TRACE_SPAN("TransportUploadSender::Send");
+
+	auto params = ref new Platform::Collections::Map<String^, String^>();
+	params->Insert("v", ref new String(request.apiVersion.c_str()));
+	params->Insert("e", ref new String(request.events.c_str()));
+	params->Insert("client", ref new String(request.apiKey.c_str()));
+	params->Insert("upload_time", ref new String(request.uploadTime.c_str()));
+	params->Insert("checksum", ref new String(request.checksum.c_str()));
+
+	// Continuations must be copyable; the handler isn't.
+	auto handler = std::make_shared<UniqueFunction<void(UploadResult)>>(std::move(done));
+
+	task<String^> posted;
+	try
+	{
+		posted = transport->Post(params);
+	}
+	catch (Platform::Exception ^ex)
+	{
+		AMPLITUDE_LOG_WARNING(ex->ToString()->Data());
+		(*handler)(UploadResult::NetworkError);
+		return;
+	}
+
+	// Task-based, so that it runs however the post turned out.
+	posted.then([handler](task<String^> t)
+	{
+		auto result = UploadResult::NetworkError;
+		try
+		{
+			result = ClassifyUploadResponse(t.get());
+		}
+		catch (Platform::Exception ^ex)
+		{
+			AMPLITUDE_LOG_WARNING(ex->ToString()->Data());
+		}
+		catch (const std::exception &ex)
+		{
+			AMPLITUDE_LOG_WARNING(ex.what());
+		}
+
+		(*handler)(result);
+	});
+}
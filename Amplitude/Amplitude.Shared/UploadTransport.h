@@ -0,0 +1,59 @@
+#pragma once
+
+#include "pch.h"
+
+#include <memory>
+
+#include "UploadPipeline.h"
+
+namespace Amplitude
+{
+	using Platform::String;
+	using Windows::Foundation::Collections::IMap;
+
+	// ComputeUploadChecksum, for the fields as a collector receives them.
+	String^ ComputeUploadChecksum(String ^apiVersion, String ^apiKey, String ^json, String ^uploadTime);
+
+	// Makes sense of a collector's response body.
+	UploadResult ClassifyUploadResponse(String ^response);
+
+	// Delivers a batch of events, as the form fields of an upload request, to
+	// a collector.  The returned task yields the collector's response body,
+	// e.g. "success" or "bad_checksum"; failing to deliver the request at all
+	// is reported by the task throwing.
+	class IUploadTransport
+	{
+	public:
+		virtual ~IUploadTransport() {}
+
+		virtual concurrency::task<String^> Post(IMap<String^, String^> ^params) = 0;
+	};
+
+	// The production transport: form-posts to EVENT_UPLOAD_URI.
+	class HttpUploadTransport : public IUploadTransport
+	{
+	public:
+		HttpUploadTransport();
+
+		concurrency::task<String^> Post(IMap<String^, String^> ^params) override;
+
+	private:
+		Windows::Web::Http::HttpClient ^client;
+	};
+
+	// Sends UploadPipeline's requests through an IUploadTransport.
+	class TransportUploadSender : public IUploadSender
+	{
+	public:
+		TransportUploadSender(std::shared_ptr<IUploadTransport> transport);
+
+		// Takes effect for the next request; returns the transport it
+		// replaced.  Not thread-safe; call it where the pipeline runs.
+		std::shared_ptr<IUploadTransport> SetTransport(std::shared_ptr<IUploadTransport> transport);
+
+		void Send(const UploadRequest &request, UniqueFunction<void(UploadResult)> done) override;
+
+	private:
+		std::shared_ptr<IUploadTransport> transport;
+	};
+}
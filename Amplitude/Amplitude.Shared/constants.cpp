@@ -19,14 +19,18 @@ namespace Amplitude
 	int const EVENT_UPLOAD_MAX_BATCH_SIZE = 100;
 	int const EVENT_MAX_COUNT = 1000;
 	int const EVENT_REMOVE_BATCH_SIZE = 20;
+	int const DEFERRED_EVENT_MAX_COUNT = 1000;
 	int64 const EVENT_UPLOAD_PERIOD_MILLIS = 30 * 1000; // 30s
 	int64 const MIN_TIME_BETWEEN_SESSIONS_MILLIS = 15 * 1000; // 15s
 	int64 const SESSION_TIMEOUT_MILLIS = 30 * 60 * 1000; // 30m
+	int64 const AGGREGATE_FLUSH_PERIOD_MILLIS = 60 * 1000; // 1m
+	int64 const EXPIRED_EVENT_PURGE_PERIOD_MILLIS = 10 * 60 * 1000; // 10m
 
 	namespace EventNames
 	{
 		String ^ const SESSION_START = L"session_start";
 		String ^ const SESSION_END = L"session_end";
+		String ^ const AGGREGATES = L"aggregates";
 	}
 
 	String ^ const PREF_CONTAINER_NAME = L"Amplitude";
@@ -34,7 +38,7 @@ namespace Amplitude
 	String ^ const PREF_PREVIOUS_SESSION_TIME = L"LastSessionTime";
 	String ^ const PREF_PREVIOUS_SESSION_ID = L"LastSessionId";
 	String ^ const PREF_PREVIOUS_SESSION_END_TIME = L"LastSessionEndTime";
-	String ^ const PREF_PREVIOUS_SESSION_END_ID = L"LastSessionEndId";
+	String ^ const PREF_PENDING_SESSION_END = L"PendingSessionEnd";
 	String ^ const PREF_PREVIOUS_EVENT_TIME = L"LastEventTime";
 	String ^ const PREF_PREVIOUS_EVENT_ID = L"LastEventId";
 	String ^ const PREF_USER_ID = L"UserId";
@@ -11,13 +11,17 @@ namespace Amplitude
 	extern int const EVENT_UPLOAD_MAX_BATCH_SIZE;
 	extern int const EVENT_MAX_COUNT;
 	extern int const EVENT_REMOVE_BATCH_SIZE;
+	extern int const DEFERRED_EVENT_MAX_COUNT;
 	extern int64 const EVENT_UPLOAD_PERIOD_MILLIS;
 	extern int64 const MIN_TIME_BETWEEN_SESSIONS_MILLIS;
 	extern int64 const SESSION_TIMEOUT_MILLIS;
+	extern int64 const AGGREGATE_FLUSH_PERIOD_MILLIS;
+	extern int64 const EXPIRED_EVENT_PURGE_PERIOD_MILLIS;
 
 	namespace EventNames {
 		extern Platform::String ^ const SESSION_START;
 		extern Platform::String ^ const SESSION_END;
+		extern Platform::String ^ const AGGREGATES;
 	}
 
 	extern Platform::String ^ const PREF_CONTAINER_NAME;
@@ -25,7 +29,7 @@ namespace Amplitude
 	extern Platform::String ^ const PREF_PREVIOUS_SESSION_TIME;
 	extern Platform::String ^ const PREF_PREVIOUS_SESSION_ID;
 	extern Platform::String ^ const PREF_PREVIOUS_SESSION_END_TIME;
-	extern Platform::String ^ const PREF_PREVIOUS_SESSION_END_ID;
+	extern Platform::String ^ const PREF_PENDING_SESSION_END;
 	extern Platform::String ^ const PREF_PREVIOUS_EVENT_TIME;
 	extern Platform::String ^ const PREF_PREVIOUS_EVENT_ID;
 	extern Platform::String ^ const PREF_USER_ID;
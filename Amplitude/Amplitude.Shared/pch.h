@@ -5,7 +5,3 @@
 #include <concrt.h>
 #include <ppltasks.h>
 #include <sqlite3.h>
-
-void Log(Platform::String ^statement);
-void LogDebug(const char *statement);
-void LogDebug(const wchar_t *statement);
\ No newline at end of file
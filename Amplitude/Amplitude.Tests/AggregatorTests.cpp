@@ -0,0 +1,160 @@
+// Tests for Aggregator: counters and histograms keyed by name and
+// properties, which bucket a value falls in, and that draining empties it
+// and asks for the next flush to be scheduled.
+
+// The core headers expect what the precompiled header provides.
+#include "pch.h"
+
+#include "Test.h"
+
+#include "Aggregator.h"
+
+#include <string>
+
+using namespace Amplitude;
+
+static const Aggregator::Counter* FindCounter(const Aggregator::Snapshot &snapshot, const std::wstring &name, const std::wstring &properties)
+{
+	for (const auto &counter : snapshot.counters)
+	{
+		if (counter.name == name && counter.properties == properties)
+		{
+			return &counter;
+		}
+	}
+	return nullptr;
+}
+
+// The index of the one bucket 'histogram' has counted anything in, or -1.
+static int OnlyBucket(const Aggregator::Histogram &histogram)
+{
+	auto found = -1;
+	for (size_t i = 0; i < histogram.buckets.size(); ++i)
+	{
+		if (histogram.buckets[i] != 0)
+		{
+			if (found != -1)
+			{
+				return -1;
+			}
+			found = static_cast<int>(i);
+		}
+	}
+	return found;
+}
+
+AMPLITUDE_TEST(OnlyTheFirstRecordSinceADrainAsksForAFlush)
+{
+	Aggregator aggregator;
+	Aggregator::Snapshot snapshot;
+	AMPLITUDE_CHECK(!aggregator.Drain(snapshot));
+
+	AMPLITUDE_CHECK(aggregator.Increment(L"tap", L"{}", 1, 1000));
+	AMPLITUDE_CHECK(!aggregator.Increment(L"tap", L"{}", 1, 2000));
+	AMPLITUDE_CHECK(!aggregator.Observe(L"load", L"{}", 5.0, 3000));
+
+	AMPLITUDE_CHECK(aggregator.Drain(snapshot));
+	AMPLITUDE_CHECK(snapshot.startTime == 1000);
+	AMPLITUDE_CHECK(!aggregator.Drain(snapshot));
+
+	AMPLITUDE_CHECK(aggregator.Observe(L"load", L"{}", 5.0, 4000));
+	AMPLITUDE_CHECK(aggregator.Drain(snapshot));
+	AMPLITUDE_CHECK(snapshot.startTime == 4000);
+	AMPLITUDE_CHECK(snapshot.counters.empty());
+	AMPLITUDE_CHECK(snapshot.histograms.size() == 1);
+}
+
+AMPLITUDE_TEST(CountersAreKeyedByNameAndProperties)
+{
+	Aggregator aggregator;
+	aggregator.Increment(L"tap", L"{}", 1, 0);
+	aggregator.Increment(L"tap", L"{}", 2, 0);
+	aggregator.Increment(L"tap", L"{\"button\":\"ok\"}", 1, 0);
+	aggregator.Increment(L"swipe", L"{}", 5, 0);
+
+	// Neither half of the key can stand in for the other.
+	aggregator.Increment(L"a", L"b", 1, 0);
+	aggregator.Increment(L"ab", L"", 1, 0);
+
+	Aggregator::Snapshot snapshot;
+	AMPLITUDE_CHECK(aggregator.Drain(snapshot));
+	AMPLITUDE_CHECK(snapshot.counters.size() == 5);
+	AMPLITUDE_CHECK(FindCounter(snapshot, L"tap", L"{}")->count == 3);
+	AMPLITUDE_CHECK(FindCounter(snapshot, L"tap", L"{\"button\":\"ok\"}")->count == 1);
+	AMPLITUDE_CHECK(FindCounter(snapshot, L"swipe", L"{}")->count == 5);
+	AMPLITUDE_CHECK(FindCounter(snapshot, L"a", L"b")->count == 1);
+	AMPLITUDE_CHECK(FindCounter(snapshot, L"ab", L"")->count == 1);
+
+	// Counting starts again from zero.
+	aggregator.Increment(L"tap", L"{}", 1, 0);
+	AMPLITUDE_CHECK(aggregator.Drain(snapshot));
+	AMPLITUDE_CHECK(snapshot.counters.size() == 1);
+	AMPLITUDE_CHECK(FindCounter(snapshot, L"tap", L"{}")->count == 1);
+}
+
+AMPLITUDE_TEST(HistogramsSummarizeWhatTheyObserve)
+{
+	Aggregator aggregator;
+	aggregator.Observe(L"load", L"{}", 12.0, 0);
+	aggregator.Observe(L"load", L"{}", 3.0, 0);
+	aggregator.Observe(L"load", L"{}", 700.0, 0);
+
+	Aggregator::Snapshot snapshot;
+	AMPLITUDE_CHECK(aggregator.Drain(snapshot));
+	AMPLITUDE_CHECK(snapshot.histograms.size() == 1);
+
+	const auto &histogram = snapshot.histograms[0];
+	AMPLITUDE_CHECK(histogram.name == L"load");
+	AMPLITUDE_CHECK(histogram.count == 3);
+	AMPLITUDE_CHECK(histogram.sum == 715.0);
+	AMPLITUDE_CHECK(histogram.min == 3.0);
+	AMPLITUDE_CHECK(histogram.max == 700.0);
+	AMPLITUDE_CHECK(histogram.buckets.size() == Aggregator::GetBucketBounds().size() + 1);
+
+	int64 total = 0;
+	for (auto count : histogram.buckets)
+	{
+		total += count;
+	}
+	AMPLITUDE_CHECK(total == 3);
+}
+
+// Each bound is inclusive; anything past the last goes in the unbounded
+// bucket at the end.
+AMPLITUDE_TEST(ValuesFallInTheFirstBucketThatBoundsThem)
+{
+	const auto &bounds = Aggregator::GetBucketBounds();
+	AMPLITUDE_CHECK(bounds.front() == 1.0);
+
+	struct Case
+	{
+		double value;
+		int bucket;
+	};
+	const Case cases[] = {
+		{ -5.0, 0 },
+		{ 0.5, 0 },
+		{ 1.0, 0 },
+		{ 1.5, 1 },
+		{ 2.0, 1 },
+		{ 1000.0, 9 },
+		{ 1000.5, 10 },
+		{ bounds.back(), static_cast<int>(bounds.size()) - 1 },
+		{ bounds.back() * 10, static_cast<int>(bounds.size()) }
+	};
+
+	for (const auto &c : cases)
+	{
+		Aggregator aggregator;
+		aggregator.Observe(L"value", L"{}", c.value, 0);
+
+		Aggregator::Snapshot snapshot;
+		AMPLITUDE_CHECK(aggregator.Drain(snapshot));
+		AMPLITUDE_CHECK(OnlyBucket(snapshot.histograms[0]) == c.bucket);
+	}
+}
+
+int main()
+{
+	return RunTests();
+}
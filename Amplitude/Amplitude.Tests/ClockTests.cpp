@@ -0,0 +1,72 @@
+// Tests for Clock: that the monotonic clock never goes backward and keeps
+// time, that wall-clock time follows the system clock, and that the two
+// convert into each other.
+
+// The core headers expect what the precompiled header provides.
+#include "pch.h"
+
+#include "Test.h"
+
+#include "Clock.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+
+using namespace Amplitude;
+
+static int64 SystemMillis()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+AMPLITUDE_TEST(MonotonicClockNeverGoesBackward)
+{
+	auto last = Clock::MonotonicMillis();
+	for (int i = 0; i < 100000; ++i)
+	{
+		auto now = Clock::MonotonicMillis();
+		AMPLITUDE_CHECK(now >= last);
+		last = now;
+	}
+}
+
+AMPLITUDE_TEST(MonotonicClockKeepsTime)
+{
+	auto start = Clock::MonotonicMillis();
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	auto elapsed = Clock::MonotonicMillis() - start;
+
+	// Both ends are truncated to the millisecond.
+	AMPLITUDE_CHECK(elapsed >= 49);
+	AMPLITUDE_CHECK(elapsed < 5000);
+}
+
+AMPLITUDE_TEST(WallClockFollowsTheSystemClock)
+{
+	Clock::Recalibrate();
+	AMPLITUDE_CHECK(std::llabs(Clock::NowMillis() - SystemMillis()) <= 50);
+
+	// Still close once the offset has been trusted for a while, and then
+	// sampled again.
+	std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+	AMPLITUDE_CHECK(std::llabs(Clock::NowMillis() - SystemMillis()) <= 50);
+	AMPLITUDE_CHECK(std::llabs(Clock::NowMillis() - SystemMillis()) <= 50);
+}
+
+AMPLITUDE_TEST(WallClockTimesMapOntoTheMonotonicClock)
+{
+	Clock::Recalibrate();
+
+	auto monotonic = Clock::MonotonicMillis();
+	auto wall = Clock::NowMillis();
+	AMPLITUDE_CHECK(std::llabs(Clock::ToMonotonicMillis(wall) - monotonic) <= 5);
+
+	// Differences carry over unchanged.
+	AMPLITUDE_CHECK(Clock::ToMonotonicMillis(wall - 60000) == Clock::ToMonotonicMillis(wall) - 60000);
+}
+
+int main()
+{
+	return RunTests();
+}
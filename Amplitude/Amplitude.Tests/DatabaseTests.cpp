@@ -0,0 +1,185 @@
+// Tests for Database: upgrading a version 1 store, removing expired
+// events, rewriting stored events, and storing an event out of order.
+
+// The core headers expect what the precompiled header provides.
+#include "pch.h"
+
+#include "Test.h"
+
+#include "Database.h"
+
+#include <climits>
+#include <cstdio>
+
+#include <sqlite3.h>
+
+using namespace Amplitude;
+
+static const char * const kPath = "DatabaseTests.db";
+
+// A fresh, empty file for each test.
+static std::wstring FreshPath()
+{
+	std::remove(kPath);
+	return L"DatabaseTests.db";
+}
+
+static std::wstring Event(int n)
+{
+	return L"{\"n\":" + std::to_wstring(n) + L"}";
+}
+
+// Every stored event, oldest first, as GetEventsSince returns them.
+static std::wstring AllEvents(Database &db)
+{
+	return db.GetEventsSince(-1, 0, LLONG_MIN).second;
+}
+
+// Runs 'sql' on the file directly, as an older version of the app would.
+static void Execute(const char *sql)
+{
+	sqlite3 *db = nullptr;
+	AMPLITUDE_CHECK(sqlite3_open(kPath, &db) == SQLITE_OK);
+	auto rc = sqlite3_exec(db, sql, nullptr, nullptr, nullptr);
+	sqlite3_close(db);
+	AMPLITUDE_CHECK(rc == SQLITE_OK);
+}
+
+static int64 QueryInt(const char *sql)
+{
+	sqlite3 *db = nullptr;
+	AMPLITUDE_CHECK(sqlite3_open(kPath, &db) == SQLITE_OK);
+	sqlite3_stmt *stmt = nullptr;
+	auto rc = sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+	auto result = rc == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int64(stmt, 0) : -1;
+	sqlite3_finalize(stmt);
+	sqlite3_close(db);
+	return result;
+}
+
+AMPLITUDE_TEST(VersionOneStoreIsUpgraded)
+{
+	FreshPath();
+	Execute(
+		"CREATE TABLE events (id INTEGER PRIMARY KEY AUTOINCREMENT, event TEXT);"
+		"INSERT INTO events (event) VALUES ('{\"n\":1}');"
+		"INSERT INTO events (event) VALUES ('{\"n\":2}');");
+
+	{
+		Database db(L"DatabaseTests.db");
+		AMPLITUDE_CHECK(db.GetEventCount() == 2);
+
+		// Events from before there were timestamps are never expired.
+		AMPLITUDE_CHECK(db.RemoveExpiredEvents(LLONG_MAX, 10) == 0);
+		AMPLITUDE_CHECK(db.GetEventsSince(-1, 0, 1000).first == 2);
+
+		AMPLITUDE_CHECK(db.AddEvent(Event(3), 500) == 3);
+		AMPLITUDE_CHECK(AllEvents(db) == L"[{\"event_id\":1,\"n\":1},{\"event_id\":2,\"n\":2},{\"event_id\":3,\"n\":3}]");
+	}
+
+	AMPLITUDE_CHECK(QueryInt("PRAGMA user_version;") == 2);
+	AMPLITUDE_CHECK(QueryInt("SELECT COUNT(*) FROM sqlite_master WHERE type = 'index' AND name = 'events_timestamp';") == 1);
+
+	// Opening it again changes nothing.
+	{
+		Database db(L"DatabaseTests.db");
+		AMPLITUDE_CHECK(db.GetEventCount() == 3);
+	}
+	AMPLITUDE_CHECK(QueryInt("PRAGMA user_version;") == 2);
+}
+
+AMPLITUDE_TEST(NewStoreIsCurrent)
+{
+	{
+		Database db(FreshPath());
+		AMPLITUDE_CHECK(db.GetEventCount() == 0);
+		AMPLITUDE_CHECK(db.GetLastEventId() == 0);
+		AMPLITUDE_CHECK(db.GetEventsSince(-1, 0, LLONG_MIN).first == -1);
+	}
+	AMPLITUDE_CHECK(QueryInt("PRAGMA user_version;") == 2);
+}
+
+AMPLITUDE_TEST(ExpiredEventsAreRemovedOldestFirst)
+{
+	Database db(FreshPath());
+
+	// Stamped out of order, as events replayed from elsewhere can be.
+	vector<EventRecord> events;
+	events.emplace_back(Event(1), 300);
+	events.emplace_back(Event(2), 100);
+	events.emplace_back(Event(3), 200);
+	events.emplace_back(Event(4), 1000);
+	AMPLITUDE_CHECK(db.AddEvents(events) == 4);
+
+	AMPLITUDE_CHECK(db.RemoveExpiredEvents(500, 2) == 2);
+	AMPLITUDE_CHECK(AllEvents(db) == L"[{\"event_id\":1,\"n\":1},{\"event_id\":4,\"n\":4}]");
+
+	AMPLITUDE_CHECK(db.RemoveExpiredEvents(500, 10) == 1);
+	AMPLITUDE_CHECK(db.RemoveExpiredEvents(500, 10) == 0);
+	AMPLITUDE_CHECK(db.GetEventCount() == 1);
+
+	// The cutoff itself isn't expired.
+	AMPLITUDE_CHECK(db.RemoveExpiredEvents(1000, 10) == 0);
+	AMPLITUDE_CHECK(db.RemoveExpiredEvents(1001, 10) == 1);
+}
+
+AMPLITUDE_TEST(ExpiredEventsAreSkippedWhenRead)
+{
+	Database db(FreshPath());
+	db.AddEvent(Event(1), 100);
+	db.AddEvent(Event(2), 900);
+	db.AddEvent(Event(3), 200);
+
+	auto batch = db.GetEventsSince(-1, 0, 500);
+	AMPLITUDE_CHECK(batch.first == 2);
+	AMPLITUDE_CHECK(batch.second == L"[{\"event_id\":2,\"n\":2}]");
+}
+
+AMPLITUDE_TEST(ReplaceRewritesOnlyMatchingEvents)
+{
+	Database db(FreshPath());
+	db.AddEvent(L"{\"device_id\":\"\",\"n\":1}", 1);
+	db.AddEvent(L"{\"device_id\":\"known\",\"n\":2}", 2);
+	db.AddEvent(L"{\"device_id\":\"\",\"n\":3}", 3);
+
+	AMPLITUDE_CHECK(db.ReplaceInEvents(L"\"device_id\":\"\"", L"\"device_id\":\"abc\"") == 2);
+	AMPLITUDE_CHECK(AllEvents(db) ==
+		L"[{\"event_id\":1,\"device_id\":\"abc\",\"n\":1},"
+		L"{\"event_id\":2,\"device_id\":\"known\",\"n\":2},"
+		L"{\"event_id\":3,\"device_id\":\"abc\",\"n\":3}]");
+
+	AMPLITUDE_CHECK(db.ReplaceInEvents(L"\"device_id\":\"\"", L"\"device_id\":\"abc\"") == 0);
+}
+
+AMPLITUDE_TEST(ReplaceHandlesNonAsciiText)
+{
+	Database db(FreshPath());
+	db.AddEvent(L"{\"city\":\"Z\u00fcrich\"}", 1);
+
+	AMPLITUDE_CHECK(db.ReplaceInEvents(L"Z\u00fcrich", L"\u6771\u4eac") == 1);
+	AMPLITUDE_CHECK(AllEvents(db) == L"[{\"event_id\":1,\"city\":\"\u6771\u4eac\"}]");
+}
+
+AMPLITUDE_TEST(EventAddedAfterAnEarlierOneMovesTheRestBehindIt)
+{
+	Database db(FreshPath());
+	db.AddEvent(Event(1), 1);
+	auto afterId = db.GetLastEventId();
+	db.AddEvent(Event(3), 3);
+	db.AddEvent(Event(4), 4);
+
+	AMPLITUDE_CHECK(db.AddEventAfter(Event(2), 2, afterId) == 4);
+	AMPLITUDE_CHECK(AllEvents(db) == L"[{\"event_id\":1,\"n\":1},{\"event_id\":4,\"n\":2},{\"event_id\":5,\"n\":3},{\"event_id\":6,\"n\":4}]");
+	AMPLITUDE_CHECK(db.GetLastEventId() == 6);
+
+	// With nothing after it, it's just added.
+	AMPLITUDE_CHECK(db.AddEventAfter(Event(5), 5, 6) == 7);
+	AMPLITUDE_CHECK(db.GetEventCount() == 5);
+}
+
+int main()
+{
+	auto failures = RunTests();
+	std::remove(kPath);
+	return failures;
+}
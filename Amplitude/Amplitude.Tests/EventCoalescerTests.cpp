@@ -0,0 +1,180 @@
+// Tests for EventCoalescer: that repeats within a window merge into one
+// event with a count and the time of the last of them, that windows run
+// on the monotonic clock whatever the wall clock does, and that events
+// logged with different global properties are kept apart.
+
+// The core headers expect what the precompiled header provides.
+#include "pch.h"
+
+#include "Test.h"
+
+#include "EventCoalescer.h"
+
+#include <string>
+#include <vector>
+
+using namespace Amplitude;
+
+typedef EventCoalescer::Result Result;
+
+static const std::wstring kGlobals = L"{\"plan\":\"free\"}";
+
+static std::vector<EventCoalescer::Entry> Flush(EventCoalescer &coalescer, int64 now, bool all = false)
+{
+	std::vector<EventCoalescer::Entry> emitted;
+	coalescer.Flush(now, all, [&emitted](const EventCoalescer::Entry &entry)
+	{
+		emitted.push_back(entry);
+	});
+	return emitted;
+}
+
+AMPLITUDE_TEST(DisabledCoalescerRefusesEverything)
+{
+	EventCoalescer coalescer;
+	AMPLITUDE_CHECK(!coalescer.IsEnabled());
+	AMPLITUDE_CHECK(coalescer.Add(L"tap", L"{}", kGlobals, 1000, 10) == Result::Refused);
+
+	coalescer.SetWindow(-5);
+	AMPLITUDE_CHECK(!coalescer.IsEnabled());
+	AMPLITUDE_CHECK(coalescer.GetNextDeadline() == -1);
+}
+
+AMPLITUDE_TEST(RepeatsWithinTheWindowMerge)
+{
+	EventCoalescer coalescer;
+	coalescer.SetWindow(100);
+
+	AMPLITUDE_CHECK(coalescer.Add(L"tap", L"{}", kGlobals, 1000, 50) == Result::Held);
+	AMPLITUDE_CHECK(coalescer.Add(L"tap", L"{}", kGlobals, 1030, 80) == Result::Merged);
+	AMPLITUDE_CHECK(coalescer.Add(L"tap", L"{}", kGlobals, 1040, 90) == Result::Merged);
+	AMPLITUDE_CHECK(coalescer.GetNextDeadline() == 150);
+
+	AMPLITUDE_CHECK(Flush(coalescer, 149).empty());
+
+	auto emitted = Flush(coalescer, 150);
+	AMPLITUDE_CHECK(emitted.size() == 1);
+	AMPLITUDE_CHECK(emitted[0].name == L"tap");
+	AMPLITUDE_CHECK(emitted[0].globalProperties == kGlobals);
+	AMPLITUDE_CHECK(emitted[0].count == 3);
+	AMPLITUDE_CHECK(emitted[0].firstTimestamp == 1000);
+	AMPLITUDE_CHECK(emitted[0].lastTimestamp == 1040);
+	AMPLITUDE_CHECK(coalescer.GetNextDeadline() == -1);
+}
+
+// The wall clock jumping, either way, neither closes a window early nor
+// holds one open.
+AMPLITUDE_TEST(WindowsRunOnTheMonotonicClock)
+{
+	EventCoalescer coalescer;
+	coalescer.SetWindow(100);
+
+	AMPLITUDE_CHECK(coalescer.Add(L"tap", L"{}", kGlobals, 5000, 10) == Result::Held);
+
+	// Set forward an hour, then back past where it started.
+	AMPLITUDE_CHECK(coalescer.Add(L"tap", L"{}", kGlobals, 5000 + 3600000, 20) == Result::Merged);
+	AMPLITUDE_CHECK(coalescer.Add(L"tap", L"{}", kGlobals, 1000, 30) == Result::Merged);
+	AMPLITUDE_CHECK(coalescer.GetNextDeadline() == 110);
+
+	AMPLITUDE_CHECK(Flush(coalescer, 109).empty());
+
+	auto emitted = Flush(coalescer, 110);
+	AMPLITUDE_CHECK(emitted.size() == 1);
+	AMPLITUDE_CHECK(emitted[0].count == 3);
+	AMPLITUDE_CHECK(emitted[0].firstTimestamp == 5000);
+	AMPLITUDE_CHECK(emitted[0].lastTimestamp == 5000 + 3600000);
+	AMPLITUDE_CHECK(emitted[0].firstMonotonic == 10);
+}
+
+// Merging into a window that has closed, but not been flushed yet, would
+// stretch it.
+AMPLITUDE_TEST(ClosedWindowRefusesRepeats)
+{
+	EventCoalescer coalescer;
+	coalescer.SetWindow(100);
+
+	AMPLITUDE_CHECK(coalescer.Add(L"tap", L"{}", kGlobals, 1000, 0) == Result::Held);
+	AMPLITUDE_CHECK(coalescer.Add(L"tap", L"{}", kGlobals, 1100, 100) == Result::Refused);
+
+	auto emitted = Flush(coalescer, 100);
+	AMPLITUDE_CHECK(emitted.size() == 1);
+	AMPLITUDE_CHECK(emitted[0].count == 1);
+}
+
+AMPLITUDE_TEST(DifferentGlobalPropertiesAreKeptApart)
+{
+	EventCoalescer coalescer;
+	coalescer.SetWindow(100);
+
+	AMPLITUDE_CHECK(coalescer.Add(L"tap", L"{}", L"{\"plan\":\"free\"}", 1000, 0) == Result::Held);
+	AMPLITUDE_CHECK(coalescer.Add(L"tap", L"{}", L"{\"plan\":\"paid\"}", 1010, 10) == Result::Held);
+	AMPLITUDE_CHECK(coalescer.Add(L"tap", L"{}", L"{\"plan\":\"free\"}", 1020, 20) == Result::Merged);
+
+	// Nor do properties merge with names, or global properties with
+	// properties.
+	AMPLITUDE_CHECK(coalescer.Add(L"tap{}", L"", L"{\"plan\":\"free\"}", 1030, 30) == Result::Held);
+	AMPLITUDE_CHECK(coalescer.Add(L"tap", L"{}{\"plan\":\"free\"}", L"", 1040, 40) == Result::Held);
+
+	auto emitted = Flush(coalescer, 0, true);
+	AMPLITUDE_CHECK(emitted.size() == 4);
+	AMPLITUDE_CHECK(emitted[0].globalProperties == L"{\"plan\":\"free\"}");
+	AMPLITUDE_CHECK(emitted[0].count == 2);
+	AMPLITUDE_CHECK(emitted[1].globalProperties == L"{\"plan\":\"paid\"}");
+	AMPLITUDE_CHECK(emitted[1].count == 1);
+}
+
+AMPLITUDE_TEST(FlushEmitsOldestFirstAndKeepsTheRest)
+{
+	EventCoalescer coalescer;
+	coalescer.SetWindow(100);
+
+	for (int i = 0; i < 10; ++i)
+	{
+		auto name = L"event" + std::to_wstring(9 - i);
+		AMPLITUDE_CHECK(coalescer.Add(name, L"{}", kGlobals, 1000 + i, i * 10) == Result::Held);
+	}
+
+	// Windows opened at 0 through 40 have closed.
+	auto emitted = Flush(coalescer, 140);
+	AMPLITUDE_CHECK(emitted.size() == 5);
+	for (size_t i = 0; i < emitted.size(); ++i)
+	{
+		AMPLITUDE_CHECK(emitted[i].firstMonotonic == static_cast<int64>(i) * 10);
+	}
+	AMPLITUDE_CHECK(coalescer.GetNextDeadline() == 150);
+
+	// Whatever is left can still be found, and merged into.
+	AMPLITUDE_CHECK(coalescer.Add(L"event0", L"{}", kGlobals, 2000, 95) == Result::Merged);
+
+	emitted = Flush(coalescer, 0, true);
+	AMPLITUDE_CHECK(emitted.size() == 5);
+	AMPLITUDE_CHECK(emitted.back().name == L"event0");
+	AMPLITUDE_CHECK(emitted.back().count == 2);
+}
+
+AMPLITUDE_TEST(FullTableRefusesNewEvents)
+{
+	EventCoalescer coalescer;
+	coalescer.SetWindow(100);
+
+	auto held = 0;
+	for (int i = 0; i < 100; ++i)
+	{
+		if (coalescer.Add(L"event" + std::to_wstring(i), L"{}", kGlobals, 1000, 0) == Result::Held)
+		{
+			++held;
+		}
+	}
+	AMPLITUDE_CHECK(held > 0 && held < 100);
+
+	// Repeats of what is already held still merge.
+	AMPLITUDE_CHECK(coalescer.Add(L"event0", L"{}", kGlobals, 1000, 0) == Result::Merged);
+
+	AMPLITUDE_CHECK(static_cast<int>(Flush(coalescer, 100).size()) == held);
+	AMPLITUDE_CHECK(coalescer.Add(L"event99", L"{}", kGlobals, 1000, 100) == Result::Held);
+}
+
+int main()
+{
+	return RunTests();
+}
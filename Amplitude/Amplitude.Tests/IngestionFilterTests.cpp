@@ -0,0 +1,163 @@
+// Tests for IngestionFilter: the token bucket's bursts and refills, and
+// sampling by a hash of the device ID, including holding events back
+// until the device ID is known.
+
+// The core headers expect what the precompiled header provides.
+#include "pch.h"
+
+#include "Test.h"
+
+#include "IngestionFilter.h"
+
+#include <cstdint>
+#include <string>
+
+using namespace Amplitude;
+
+static Admission Admit(IngestionFilter &filter, const std::wstring &eventType, int64 now)
+{
+	return filter.Admit(eventType.data(), eventType.length(), now);
+}
+
+// The filter's bucket for a device ID: 64-bit FNV-1a, folded to its upper
+// 32 bits.
+static uint64_t ExpectedBucket(const std::wstring &deviceId)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	for (auto ch : deviceId)
+	{
+		hash ^= static_cast<uint64_t>(ch);
+		hash *= 1099511628211ULL;
+	}
+	return hash >> 32;
+}
+
+AMPLITUDE_TEST(EventsWithoutRulesAreAdmitted)
+{
+	IngestionFilter filter;
+	AMPLITUDE_CHECK(Admit(filter, L"click", 0) == Admission::Admit);
+
+	filter.SetRateLimit(L"scroll", 1.0, 1);
+	for (int i = 0; i < 10; ++i)
+	{
+		AMPLITUDE_CHECK(Admit(filter, L"click", 1000) == Admission::Admit);
+	}
+	AMPLITUDE_CHECK(filter.GetRateLimitedCount() == 0);
+}
+
+AMPLITUDE_TEST(TokenBucketAllowsABurstThenRefills)
+{
+	IngestionFilter filter;
+	filter.SetRateLimit(L"click", 10.0, 3);
+
+	// A full bucket to start with.
+	AMPLITUDE_CHECK(Admit(filter, L"click", 1000) == Admission::Admit);
+	AMPLITUDE_CHECK(Admit(filter, L"click", 1000) == Admission::Admit);
+	AMPLITUDE_CHECK(Admit(filter, L"click", 1000) == Admission::Admit);
+	AMPLITUDE_CHECK(Admit(filter, L"click", 1000) == Admission::Drop);
+
+	// A token every 100ms.
+	AMPLITUDE_CHECK(Admit(filter, L"click", 1050) == Admission::Drop);
+	AMPLITUDE_CHECK(Admit(filter, L"click", 1100) == Admission::Admit);
+	AMPLITUDE_CHECK(Admit(filter, L"click", 1100) == Admission::Drop);
+
+	// Refills no further than the burst, however long it has been.
+	for (int i = 0; i < 3; ++i)
+	{
+		AMPLITUDE_CHECK(Admit(filter, L"click", 60000) == Admission::Admit);
+	}
+	AMPLITUDE_CHECK(Admit(filter, L"click", 60000) == Admission::Drop);
+
+	AMPLITUDE_CHECK(filter.GetRateLimitedCount() == 4);
+	AMPLITUDE_CHECK(filter.GetSampledOutCount() == 0);
+}
+
+AMPLITUDE_TEST(NonPositiveRateRemovesTheLimit)
+{
+	IngestionFilter filter;
+	filter.SetRateLimit(L"click", 1.0, 1);
+	AMPLITUDE_CHECK(Admit(filter, L"click", 1000) == Admission::Admit);
+	AMPLITUDE_CHECK(Admit(filter, L"click", 1000) == Admission::Drop);
+
+	filter.SetRateLimit(L"click", 0.0, 0);
+	for (int i = 0; i < 10; ++i)
+	{
+		AMPLITUDE_CHECK(Admit(filter, L"click", 1000) == Admission::Admit);
+	}
+}
+
+// A type's rate limit and its sampling are set separately; setting one
+// keeps the other.
+AMPLITUDE_TEST(RateLimitAndSamplingCombine)
+{
+	IngestionFilter filter;
+	filter.SetDeviceId(L"device");
+	filter.SetRateLimit(L"click", 1.0, 1);
+	filter.SetSamplingRate(L"click", 1.0);
+
+	AMPLITUDE_CHECK(Admit(filter, L"click", 1000) == Admission::Admit);
+	AMPLITUDE_CHECK(Admit(filter, L"click", 1000) == Admission::Drop);
+
+	filter.SetSamplingRate(L"click", 0.0);
+	AMPLITUDE_CHECK(Admit(filter, L"click", 5000) == Admission::Drop);
+	AMPLITUDE_CHECK(filter.GetSampledOutCount() == 1);
+	AMPLITUDE_CHECK(filter.GetRateLimitedCount() == 1);
+}
+
+AMPLITUDE_TEST(SampledEventsAreDeferredUntilTheDeviceIdIsKnown)
+{
+	IngestionFilter filter;
+	filter.SetSamplingRate(L"view", 0.0);
+	filter.SetSamplingRate(L"tap", 1.0);
+
+	// Unsampled types don't wait.
+	AMPLITUDE_CHECK(Admit(filter, L"click", 0) == Admission::Admit);
+	AMPLITUDE_CHECK(Admit(filter, L"view", 0) == Admission::Defer);
+
+	// A rate of one keeps every device, so there's nothing to wait for.
+	AMPLITUDE_CHECK(Admit(filter, L"tap", 0) == Admission::Admit);
+
+	filter.SetDeviceId(L"device");
+	AMPLITUDE_CHECK(!filter.AdmitDeferred(L"view", 4));
+	AMPLITUDE_CHECK(filter.AdmitDeferred(L"tap", 3));
+	AMPLITUDE_CHECK(filter.AdmitDeferred(L"click", 5));
+	AMPLITUDE_CHECK(filter.GetSampledOutCount() == 1);
+
+	AMPLITUDE_CHECK(Admit(filter, L"view", 0) == Admission::Drop);
+	AMPLITUDE_CHECK(Admit(filter, L"tap", 0) == Admission::Admit);
+}
+
+// Whether a device is in the sample depends on the FNV-1a hash of its ID
+// alone, so the same ID always gets the same answer.
+AMPLITUDE_TEST(SamplingFollowsTheDeviceIdHash)
+{
+	static const int kDevices = 1000;
+
+	IngestionFilter filter;
+	filter.SetSamplingRate(L"view", 0.25);
+	auto threshold = static_cast<uint64_t>(0.25 * (1ULL << 32));
+
+	auto kept = 0;
+	for (int i = 0; i < kDevices; ++i)
+	{
+		auto deviceId = L"device-" + std::to_wstring(i);
+		filter.SetDeviceId(deviceId);
+
+		auto admitted = Admit(filter, L"view", 0) == Admission::Admit;
+		AMPLITUDE_CHECK(admitted == (ExpectedBucket(deviceId) < threshold));
+		AMPLITUDE_CHECK((Admit(filter, L"view", 0) == Admission::Admit) == admitted);
+		if (admitted)
+		{
+			++kept;
+		}
+	}
+
+	// Roughly the fraction asked for.
+	AMPLITUDE_CHECK(kept > kDevices / 8 && kept < kDevices * 3 / 8);
+	AMPLITUDE_CHECK(filter.GetSampledOutCount() == 2 * (kDevices - kept));
+}
+
+int main()
+{
+	return RunTests();
+}
@@ -0,0 +1,163 @@
+// Tests for Logger: that records reach the sink in order, are cut short
+// without splitting a character, and are converted from UTF-16/32; that a
+// thread's last records survive it exiting; and that a writer which gets
+// ahead of a stuck sink loses records instead of waiting, and they're
+// counted.
+
+// The core headers expect what the precompiled header provides.
+#include "pch.h"
+
+#include "Test.h"
+
+#include "Logger.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Amplitude;
+
+struct Received
+{
+	LogLevel level;
+	std::string message;
+};
+
+static std::mutex gReceivedMutex;
+static std::vector<Received> gReceived;
+
+// While set, the sink waits in its first record until it's cleared.
+static std::atomic<bool> gHoldSink(false);
+static std::atomic<bool> gSinkHeld(false);
+
+static void CollectingSink(LogLevel level, const char *message)
+{
+	while (gHoldSink.load())
+	{
+		gSinkHeld.store(true);
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	Received received = { level, message };
+	std::lock_guard<std::mutex> lock(gReceivedMutex);
+	gReceived.push_back(received);
+}
+
+// Everything the sink has received since the last call.
+static std::vector<Received> TakeReceived()
+{
+	Logger::Flush();
+
+	std::lock_guard<std::mutex> lock(gReceivedMutex);
+	std::vector<Received> received;
+	received.swap(gReceived);
+	return received;
+}
+
+AMPLITUDE_TEST(RecordsReachTheSinkInOrder)
+{
+	Logger::SetSink(CollectingSink);
+	TakeReceived();
+
+	Logger::Write(LogLevel::Info, "first");
+	Logger::Write(LogLevel::Error, "second");
+	Logger::Write(LogLevel::Debug, L"third");
+
+	auto received = TakeReceived();
+	AMPLITUDE_CHECK(received.size() == 3);
+	AMPLITUDE_CHECK(received[0].level == LogLevel::Info);
+	AMPLITUDE_CHECK(received[0].message == "first");
+	AMPLITUDE_CHECK(received[1].level == LogLevel::Error);
+	AMPLITUDE_CHECK(received[1].message == "second");
+	AMPLITUDE_CHECK(received[2].level == LogLevel::Debug);
+	AMPLITUDE_CHECK(received[2].message == "third");
+}
+
+AMPLITUDE_TEST(LongRecordsAreCutWithoutSplittingACharacter)
+{
+	Logger::SetSink(CollectingSink);
+	TakeReceived();
+
+	Logger::Write(LogLevel::Info, std::string(Logger::kMaxMessageSize + 10, 'a').c_str());
+
+	// Two-byte characters, the last of which would straddle the limit.
+	auto split = std::string(Logger::kMaxMessageSize - 1, 'a') + "\xC3\xA9";
+	Logger::Write(LogLevel::Info, split.c_str());
+	Logger::Write(LogLevel::Info, (std::wstring(Logger::kMaxMessageSize - 1, L'a') + L"\u00e9").c_str());
+
+	auto received = TakeReceived();
+	AMPLITUDE_CHECK(received.size() == 3);
+	AMPLITUDE_CHECK(received[0].message == std::string(Logger::kMaxMessageSize, 'a'));
+	AMPLITUDE_CHECK(received[1].message == std::string(Logger::kMaxMessageSize - 1, 'a'));
+	AMPLITUDE_CHECK(received[2].message == std::string(Logger::kMaxMessageSize - 1, 'a'));
+}
+
+AMPLITUDE_TEST(WideRecordsAreWrittenAsUtf8)
+{
+	Logger::SetSink(CollectingSink);
+	TakeReceived();
+
+	Logger::Write(LogLevel::Warning, L"caf\u00e9 \u20ac");
+
+	// An unpaired surrogate can't be encoded; it's replaced.
+	wchar_t unpaired[] = { L'a', static_cast<wchar_t>(0xDC00), L'b', L'\0' };
+	Logger::Write(LogLevel::Warning, unpaired);
+
+	auto received = TakeReceived();
+	AMPLITUDE_CHECK(received.size() == 2);
+	AMPLITUDE_CHECK(received[0].message == "caf\xC3\xA9 \xE2\x82\xAC");
+	AMPLITUDE_CHECK(received[1].message == "a\xEF\xBF\xBD" "b");
+}
+
+AMPLITUDE_TEST(RecordsOutliveTheThreadThatWroteThem)
+{
+	Logger::SetSink(CollectingSink);
+	TakeReceived();
+
+	std::thread writer([]
+	{
+		Logger::Write(LogLevel::Info, "from a thread");
+	});
+	writer.join();
+
+	auto received = TakeReceived();
+	AMPLITUDE_CHECK(received.size() == 1);
+	AMPLITUDE_CHECK(received[0].message == "from a thread");
+}
+
+AMPLITUDE_TEST(WriterAheadOfAStuckSinkDropsRecords)
+{
+	static const int kRecords = 1000;
+
+	Logger::SetSink(CollectingSink);
+	TakeReceived();
+	auto droppedBefore = Logger::GetDroppedCount();
+
+	// The drain thread takes the first record, and gets stuck on it.
+	gSinkHeld = false;
+	gHoldSink = true;
+	Logger::Write(LogLevel::Info, "stuck");
+	auto held = WaitFor([] { return gSinkHeld.load(); });
+
+	for (int i = 0; i < kRecords && held; ++i)
+	{
+		Logger::Write(LogLevel::Info, "more");
+	}
+
+	gHoldSink = false;
+	AMPLITUDE_CHECK(held);
+
+	auto dropped = Logger::GetDroppedCount() - droppedBefore;
+	auto received = TakeReceived();
+	AMPLITUDE_CHECK(dropped > 0);
+	AMPLITUDE_CHECK(static_cast<int64>(received.size()) + dropped == kRecords + 1);
+	AMPLITUDE_CHECK(received[0].message == "stuck");
+}
+
+int main()
+{
+	return RunTests();
+}
@@ -0,0 +1,169 @@
+// Tests for MpscQueue: that a parked consumer is always woken, and that
+// evicting the oldest item makes room in order.
+
+// The core headers expect what the precompiled header provides.
+#include "pch.h"
+
+#include "Test.h"
+
+#include "MpscQueue.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace Amplitude;
+
+// One item at a time, each only once the consumer has taken the last, so
+// that the consumer parks before nearly every one.  A lost wakeup leaves
+// an item sitting in the queue.
+AMPLITUDE_TEST(ParkedConsumerIsWokenForEveryItem)
+{
+	static const int kItems = 2000;
+
+	MpscQueue<int> queue(16);
+	std::atomic<int> consumed(0);
+
+	std::thread consumer([&queue, &consumed]
+	{
+		int item;
+		while (queue.TryDequeue(item))
+		{
+			consumed.fetch_add(1);
+		}
+	});
+
+	auto woken = true;
+	for (int i = 0; i < kItems && woken; ++i)
+	{
+		// Long enough, now and then, for the consumer to stop spinning.
+		if (i % 100 == 0)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		woken = queue.TryEnqueue(i) && WaitFor([&consumed, i] { return consumed.load() == i + 1; });
+	}
+
+	queue.Complete();
+	consumer.join();
+	AMPLITUDE_CHECK(woken);
+}
+
+// Several producers racing a consumer that keeps parking.
+AMPLITUDE_TEST(ParkedConsumerIsWokenByConcurrentProducers)
+{
+	static const int kProducers = 4;
+	static const int kItemsPerProducer = 5000;
+
+	MpscQueue<int> queue(64);
+	std::atomic<int> consumed(0);
+
+	std::thread consumer([&queue, &consumed]
+	{
+		int item;
+		while (queue.TryDequeue(item))
+		{
+			consumed.fetch_add(1);
+		}
+	});
+
+	std::vector<std::thread> producers;
+	for (int p = 0; p < kProducers; ++p)
+	{
+		producers.emplace_back([&queue]
+		{
+			for (int i = 0; i < kItemsPerProducer; ++i)
+			{
+				while (!queue.TryEnqueue(i))
+				{
+					std::this_thread::yield();
+				}
+				if (i % 500 == 0)
+				{
+					std::this_thread::sleep_for(std::chrono::microseconds(200));
+				}
+			}
+		});
+	}
+
+	for (auto &producer : producers)
+	{
+		producer.join();
+	}
+
+	auto drained = WaitFor([&consumed] { return consumed.load() == kProducers * kItemsPerProducer; });
+	queue.Complete();
+	consumer.join();
+	AMPLITUDE_CHECK(drained);
+}
+
+AMPLITUDE_TEST(EvictingTheOldestMakesRoomInOrder)
+{
+	MpscQueue<int> queue(std::vector<unsigned int>(1, 4), 0);
+
+	for (int i = 1; i <= 4; ++i)
+	{
+		AMPLITUDE_CHECK(queue.TryEnqueue(i));
+	}
+	AMPLITUDE_CHECK(!queue.TryEnqueue(5));
+
+	int evicted = 0;
+	AMPLITUDE_CHECK(queue.TryEvictOldest(0, evicted));
+	AMPLITUDE_CHECK(evicted == 1);
+	AMPLITUDE_CHECK(queue.TryEnqueue(5));
+
+	queue.Complete();
+
+	std::vector<int> items;
+	int item;
+	while (queue.TryDequeue(item))
+	{
+		items.push_back(item);
+	}
+	AMPLITUDE_CHECK((items == std::vector<int>{ 2, 3, 4, 5 }));
+}
+
+AMPLITUDE_TEST(EvictingFromAnEmptyLaneFails)
+{
+	MpscQueue<int> queue(std::vector<unsigned int>{ 4, 4 }, 0);
+	AMPLITUDE_CHECK(queue.TryEnqueue(1, 1));
+
+	int evicted = 0;
+	AMPLITUDE_CHECK(!queue.TryEvictOldest(0, evicted));
+	AMPLITUDE_CHECK(!queue.TryEvictOldest(2, evicted));
+	AMPLITUDE_CHECK(queue.TryEvictOldest(1, evicted));
+	AMPLITUDE_CHECK(evicted == 1);
+	AMPLITUDE_CHECK(!queue.TryEvictOldest(1, evicted));
+}
+
+// Evicting from an unbounded lane only takes from its ring, which holds
+// everything older than what spilled.
+AMPLITUDE_TEST(EvictingFromASpilledLaneTakesTheOldest)
+{
+	MpscQueue<int> queue(std::vector<unsigned int>(1, 0), 0);
+	for (int i = 0; i < 3000; ++i)
+	{
+		AMPLITUDE_CHECK(queue.TryEnqueue(i));
+	}
+
+	int evicted = -1;
+	AMPLITUDE_CHECK(queue.TryEvictOldest(0, evicted));
+	AMPLITUDE_CHECK(evicted == 0);
+
+	queue.Complete();
+
+	auto expected = 1;
+	int item;
+	while (queue.TryDequeue(item))
+	{
+		AMPLITUDE_CHECK(item == expected);
+		++expected;
+	}
+	AMPLITUDE_CHECK(expected == 3000);
+}
+
+int main()
+{
+	return RunTests();
+}
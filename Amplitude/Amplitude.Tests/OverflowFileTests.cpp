@@ -0,0 +1,137 @@
+// Tests for OverflowFile: records come back in order and the file is
+// emptied, records left by a previous run are picked up, and a record torn
+// partway through doesn't take the next one with it.
+
+// The core headers expect what the precompiled header provides.
+#include "pch.h"
+
+#include "Test.h"
+
+#include "OverflowFile.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace Amplitude;
+
+static const char * const kPath = "OverflowFileTests.spill";
+
+// A fresh, empty file for each test.
+static std::wstring FreshPath()
+{
+	std::remove(kPath);
+	return L"OverflowFileTests.spill";
+}
+
+// Writes 'contents' as the whole file, as a previous run might have left it.
+static void WriteFile(const std::string &contents)
+{
+	auto file = std::fopen(kPath, "wb");
+	std::fwrite(contents.data(), 1, contents.size(), file);
+	std::fclose(file);
+}
+
+static bool FileExists()
+{
+	auto file = std::fopen(kPath, "rb");
+	if (file == nullptr)
+	{
+		return false;
+	}
+	std::fclose(file);
+	return true;
+}
+
+AMPLITUDE_TEST(RecordsComeBackInOrder)
+{
+	OverflowFile overflow(FreshPath());
+	AMPLITUDE_CHECK(!overflow.HasRecords());
+
+	AMPLITUDE_CHECK(overflow.Append(L"{\"n\":1}"));
+	AMPLITUDE_CHECK(overflow.Append(L"{\"n\":2,\"name\":\"caf\u00e9\"}"));
+	AMPLITUDE_CHECK(overflow.HasRecords());
+
+	std::vector<std::wstring> records;
+	records.push_back(L"already there");
+	overflow.TakeAll(records);
+	AMPLITUDE_CHECK((records == std::vector<std::wstring>{ L"already there", L"{\"n\":1}", L"{\"n\":2,\"name\":\"caf\u00e9\"}" }));
+	AMPLITUDE_CHECK(!overflow.HasRecords());
+	AMPLITUDE_CHECK(!FileExists());
+
+	// It carries on as a fresh file.
+	AMPLITUDE_CHECK(overflow.Append(L"{\"n\":3}"));
+	records.clear();
+	overflow.TakeAll(records);
+	AMPLITUDE_CHECK((records == std::vector<std::wstring>{ L"{\"n\":3}" }));
+
+	records.clear();
+	overflow.TakeAll(records);
+	AMPLITUDE_CHECK(records.empty());
+}
+
+AMPLITUDE_TEST(RecordsFromAPreviousRunArePickedUp)
+{
+	FreshPath();
+	WriteFile("{\"n\":1}\n{\"n\":2}\n");
+
+	OverflowFile overflow(L"OverflowFileTests.spill");
+	AMPLITUDE_CHECK(overflow.HasRecords());
+	AMPLITUDE_CHECK(overflow.Append(L"{\"n\":3}"));
+
+	std::vector<std::wstring> records;
+	overflow.TakeAll(records);
+	AMPLITUDE_CHECK((records == std::vector<std::wstring>{ L"{\"n\":1}", L"{\"n\":2}", L"{\"n\":3}" }));
+}
+
+AMPLITUDE_TEST(EmptyFileHasNoRecords)
+{
+	FreshPath();
+	WriteFile("");
+
+	OverflowFile overflow(L"OverflowFileTests.spill");
+	AMPLITUDE_CHECK(!overflow.HasRecords());
+}
+
+// The torn record comes back as it is, on a line of its own, for the
+// replay to reject; the one appended after it is intact.
+AMPLITUDE_TEST(RecordAfterATornOneStartsOnANewLine)
+{
+	FreshPath();
+	WriteFile("{\"n\":1}\n{\"n\":");
+
+	OverflowFile overflow(L"OverflowFileTests.spill");
+	AMPLITUDE_CHECK(overflow.HasRecords());
+	AMPLITUDE_CHECK(overflow.Append(L"{\"n\":3}"));
+	AMPLITUDE_CHECK(overflow.Append(L"{\"n\":4}"));
+
+	std::vector<std::wstring> records;
+	overflow.TakeAll(records);
+	AMPLITUDE_CHECK((records == std::vector<std::wstring>{ L"{\"n\":1}", L"{\"n\":", L"{\"n\":3}", L"{\"n\":4}" }));
+}
+
+// With nothing appended after it, a torn record at the end is dropped.
+AMPLITUDE_TEST(TornRecordAtTheEndIsDropped)
+{
+	FreshPath();
+	WriteFile("{\"n\":1}\n{\"n\":");
+
+	OverflowFile overflow(L"OverflowFileTests.spill");
+
+	std::vector<std::wstring> records;
+	overflow.TakeAll(records);
+	AMPLITUDE_CHECK((records == std::vector<std::wstring>{ L"{\"n\":1}" }));
+
+	// What was torn is gone with the file.
+	AMPLITUDE_CHECK(overflow.Append(L"{\"n\":2}"));
+	records.clear();
+	overflow.TakeAll(records);
+	AMPLITUDE_CHECK((records == std::vector<std::wstring>{ L"{\"n\":2}" }));
+}
+
+int main()
+{
+	auto failures = RunTests();
+	std::remove(kPath);
+	return failures;
+}
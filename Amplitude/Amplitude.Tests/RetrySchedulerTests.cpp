@@ -0,0 +1,106 @@
+// Tests for RetryScheduler: that each kind of failure backs off within its
+// policy's bounds, and that a permanent one trips the breaker for good.
+
+// The core headers expect what the precompiled header provides.
+#include "pch.h"
+
+#include "Test.h"
+
+#include "RetryScheduler.h"
+
+#include <algorithm>
+
+using namespace Amplitude;
+
+static const int64 kSecond = 1000;
+static const int64 kMinute = 60 * kSecond;
+static const int64 kHour = 60 * kMinute;
+
+// Fails 'attempts' times in a row with 'result', checking that each delay
+// is between half and all of the exponential ceiling.
+static void CheckBackoff(UploadResult result, int64 base, int64 cap, int attempts)
+{
+	RetryScheduler scheduler;
+	auto now = int64(1000000);
+	auto ceiling = base;
+	for (int i = 0; i < attempts; ++i)
+	{
+		auto delay = scheduler.RecordResult(result, now);
+		AMPLITUDE_CHECK(delay >= ceiling / 2 && delay <= ceiling);
+		AMPLITUDE_CHECK(scheduler.GetDelayUntilNextAttempt(now) == delay);
+		AMPLITUDE_CHECK(scheduler.GetDelayUntilNextAttempt(now + delay) == 0);
+
+		now += delay;
+		ceiling = std::min(cap, ceiling * 2);
+	}
+	AMPLITUDE_CHECK(ceiling == cap);
+	AMPLITUDE_CHECK(!scheduler.IsSuspended());
+}
+
+AMPLITUDE_TEST(NetworkErrorBacksOffToAnHour)
+{
+	CheckBackoff(UploadResult::NetworkError, 30 * kSecond, kHour, 12);
+}
+
+AMPLITUDE_TEST(BadChecksumBacksOffToFiveMinutes)
+{
+	CheckBackoff(UploadResult::BadChecksum, 5 * kSecond, 5 * kMinute, 10);
+}
+
+AMPLITUDE_TEST(RequestDbWriteFailedBacksOffToHalfAnHour)
+{
+	CheckBackoff(UploadResult::RequestDbWriteFailed, 30 * kSecond, 30 * kMinute, 10);
+}
+
+AMPLITUDE_TEST(UnknownResponseBacksOffToAnHour)
+{
+	CheckBackoff(UploadResult::UnknownResponse, kMinute, kHour, 10);
+}
+
+// Many more failures than it takes to reach the cap don't overflow it.
+AMPLITUDE_TEST(LongOutageStaysAtTheCap)
+{
+	RetryScheduler scheduler;
+	int64 delay = 0;
+	for (int i = 0; i < 100; ++i)
+	{
+		delay = scheduler.RecordResult(UploadResult::NetworkError, 0);
+	}
+	AMPLITUDE_CHECK(delay >= kHour / 2 && delay <= kHour);
+}
+
+AMPLITUDE_TEST(SuccessResetsTheBackoff)
+{
+	RetryScheduler scheduler;
+	for (int i = 0; i < 5; ++i)
+	{
+		scheduler.RecordResult(UploadResult::NetworkError, 0);
+	}
+
+	AMPLITUDE_CHECK(scheduler.RecordResult(UploadResult::Success, 0) == 0);
+	AMPLITUDE_CHECK(scheduler.GetDelayUntilNextAttempt(0) == 0);
+
+	auto delay = scheduler.RecordResult(UploadResult::NetworkError, 0);
+	AMPLITUDE_CHECK(delay >= 15 * kSecond && delay <= 30 * kSecond);
+}
+
+AMPLITUDE_TEST(InvalidApiKeyTripsTheBreaker)
+{
+	RetryScheduler scheduler;
+	AMPLITUDE_CHECK(scheduler.GetDelayUntilNextAttempt(0) == 0);
+
+	AMPLITUDE_CHECK(scheduler.RecordResult(UploadResult::InvalidApiKey, 0) == -1);
+	AMPLITUDE_CHECK(scheduler.IsSuspended());
+	AMPLITUDE_CHECK(scheduler.GetDelayUntilNextAttempt(kHour * 24) == -1);
+
+	// Nothing brings it back; the key is fixed for the life of the app.
+	scheduler.RecordResult(UploadResult::Success, 0);
+	scheduler.RecordResult(UploadResult::NetworkError, 0);
+	AMPLITUDE_CHECK(scheduler.IsSuspended());
+	AMPLITUDE_CHECK(scheduler.GetDelayUntilNextAttempt(kHour * 24) == -1);
+}
+
+int main()
+{
+	return RunTests();
+}
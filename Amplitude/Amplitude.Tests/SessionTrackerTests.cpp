@@ -0,0 +1,242 @@
+// Tests for SessionTracker: how a session moves between Closed, Open and
+// Ending, and that an ending session survives a restart.
+
+// The core headers expect what the precompiled header provides.
+#include "pch.h"
+
+#include "Test.h"
+
+#include "SessionTracker.h"
+
+using namespace Amplitude;
+
+static const int64 kMinTimeBetweenSessions = 15 * 1000;
+static const int64 kSessionTimeout = 30 * 60 * 1000;
+
+// Keeps what Settings would, in memory.
+class MemorySessionStore : public ISessionStore
+{
+public:
+	MemorySessionStore() :
+		lastEventTime(-1),
+		lastSessionId(-1),
+		lastEndSessionTime(-1)
+	{
+	}
+
+	int64 GetLastEventTime() override { return lastEventTime; }
+	void SetLastEventTime(int64 timestamp) override { lastEventTime = timestamp; }
+
+	int64 GetLastSessionId() override { return lastSessionId; }
+	void SetLastSessionId(int64 sessionId) override { lastSessionId = sessionId; }
+
+	std::wstring GetPendingSessionEnd() override { return pendingSessionEnd; }
+	int64 GetLastEndSessionTime() override { return lastEndSessionTime; }
+	void SetPendingSessionEnd(const std::wstring &event) override { pendingSessionEnd = event; }
+	void SetLastEndSessionTime(int64 timestamp) override { lastEndSessionTime = timestamp; }
+
+	void ClearEndSession() override
+	{
+		pendingSessionEnd.clear();
+		lastEndSessionTime = -1;
+	}
+
+	int64 lastEventTime;
+	int64 lastSessionId;
+	std::wstring pendingSessionEnd;
+	int64 lastEndSessionTime;
+};
+
+// Starts a session at 'now', as the reporter does for its first event.
+static void Open(SessionTracker &tracker, int64 now, int64 monotonic)
+{
+	AMPLITUDE_CHECK(tracker.CheckSession(now, monotonic));
+	tracker.OnEvent(now, monotonic);
+}
+
+AMPLITUDE_TEST(FirstEventOpensASession)
+{
+	MemorySessionStore store;
+	SessionTracker tracker(store, kMinTimeBetweenSessions, kSessionTimeout);
+	AMPLITUDE_CHECK(tracker.GetState() == SessionState::Closed);
+
+	Open(tracker, 1000, 10);
+	AMPLITUDE_CHECK(tracker.GetState() == SessionState::Open);
+	AMPLITUDE_CHECK(tracker.GetSessionId() == 1000);
+	AMPLITUDE_CHECK(store.lastSessionId == 1000);
+
+	// Later events within the timeout stay in it.
+	AMPLITUDE_CHECK(!tracker.CheckSession(2000, 1010));
+	AMPLITUDE_CHECK(tracker.GetSessionId() == 1000);
+}
+
+AMPLITUDE_TEST(IdleSessionTimesOut)
+{
+	MemorySessionStore store;
+	SessionTracker tracker(store, kMinTimeBetweenSessions, kSessionTimeout);
+	Open(tracker, 1000, 10);
+
+	AMPLITUDE_CHECK(tracker.CheckSession(1000 + kSessionTimeout + 1, 10 + kSessionTimeout + 1));
+	AMPLITUDE_CHECK(tracker.GetSessionId() == 1000 + kSessionTimeout + 1);
+}
+
+// Elapsed time goes by the monotonic clock, so setting the wall clock
+// forward doesn't end the session.
+AMPLITUDE_TEST(WallClockJumpDoesNotSplitASession)
+{
+	MemorySessionStore store;
+	SessionTracker tracker(store, kMinTimeBetweenSessions, kSessionTimeout);
+	Open(tracker, 1000, 10);
+
+	AMPLITUDE_CHECK(!tracker.CheckSession(1000 + 10 * kSessionTimeout, 20));
+	AMPLITUDE_CHECK(tracker.GetSessionId() == 1000);
+}
+
+// A batch of events from an earlier, offline session, logged late with
+// their own timestamps, don't move the last activity back, so the live
+// session isn't split by the next event.
+AMPLITUDE_TEST(LateEventsDoNotMoveActivityBack)
+{
+	MemorySessionStore store;
+	SessionTracker tracker(store, kMinTimeBetweenSessions, kSessionTimeout);
+	Open(tracker, 10000000, 5000000);
+
+	auto gap = 2 * kSessionTimeout;
+	AMPLITUDE_CHECK(tracker.PrecedesSession(10000000 - gap, 5000000 - gap));
+	tracker.OnEvent(10000000 - gap, 5000000 - gap);
+	AMPLITUDE_CHECK(store.lastEventTime == 10000000);
+
+	AMPLITUDE_CHECK(!tracker.CheckSession(10001000, 5001000));
+	AMPLITUDE_CHECK(tracker.GetSessionId() == 10000000);
+}
+
+AMPLITUDE_TEST(OnlyEventsBeforeTheStartPrecedeTheSession)
+{
+	MemorySessionStore store;
+	SessionTracker tracker(store, kMinTimeBetweenSessions, kSessionTimeout);
+
+	// Nothing precedes no session.
+	AMPLITUDE_CHECK(!tracker.PrecedesSession(0, 0));
+
+	Open(tracker, 1000, 10);
+	AMPLITUDE_CHECK(tracker.PrecedesSession(999, 9));
+	AMPLITUDE_CHECK(!tracker.PrecedesSession(1000, 10));
+
+	// By the monotonic clock, while it's known.
+	AMPLITUDE_CHECK(!tracker.PrecedesSession(500, 20));
+
+	// Across a restart, by the wall clock.
+	AMPLITUDE_CHECK(tracker.Close(5000, 4010));
+	tracker.HoldSessionEnd(L"end");
+	SessionTracker restarted(store, kMinTimeBetweenSessions, kSessionTimeout);
+	AMPLITUDE_CHECK(restarted.PrecedesSession(999, 50000));
+	AMPLITUDE_CHECK(!restarted.PrecedesSession(1000, 0));
+}
+
+AMPLITUDE_TEST(CloseHoldsTheSessionEnd)
+{
+	MemorySessionStore store;
+	SessionTracker tracker(store, kMinTimeBetweenSessions, kSessionTimeout);
+	Open(tracker, 1000, 10);
+
+	AMPLITUDE_CHECK(tracker.Close(5000, 4010));
+	AMPLITUDE_CHECK(tracker.GetState() == SessionState::Ending);
+	tracker.HoldSessionEnd(L"end");
+	AMPLITUDE_CHECK(store.pendingSessionEnd == L"end");
+	AMPLITUDE_CHECK(store.lastEndSessionTime == 5000);
+
+	// Only an open session can be closed.
+	AMPLITUDE_CHECK(!tracker.Close(6000, 5010));
+
+	// Events while it's ending belong to it, and don't reopen it.
+	AMPLITUDE_CHECK(!tracker.CheckSession(6000, 5010));
+	AMPLITUDE_CHECK(tracker.GetState() == SessionState::Ending);
+	AMPLITUDE_CHECK(tracker.GetSessionId() == 1000);
+}
+
+AMPLITUDE_TEST(ResumingInTimeReopensTheSession)
+{
+	MemorySessionStore store;
+	SessionTracker tracker(store, kMinTimeBetweenSessions, kSessionTimeout);
+	Open(tracker, 1000, 10);
+	AMPLITUDE_CHECK(tracker.Close(5000, 4010));
+	tracker.HoldSessionEnd(L"end");
+
+	std::wstring event;
+	int64 timestamp;
+	AMPLITUDE_CHECK(!tracker.TakeExpiredSessionEnd(5000 + kMinTimeBetweenSessions - 1, 4010 + kMinTimeBetweenSessions - 1, event, timestamp));
+
+	tracker.Resume(5000 + kMinTimeBetweenSessions - 1, 4010 + kMinTimeBetweenSessions - 1);
+	AMPLITUDE_CHECK(tracker.GetState() == SessionState::Open);
+	AMPLITUDE_CHECK(tracker.GetSessionId() == 1000);
+	AMPLITUDE_CHECK(store.pendingSessionEnd.empty());
+	AMPLITUDE_CHECK(store.lastEndSessionTime == -1);
+}
+
+AMPLITUDE_TEST(ExpiredSessionEndIsHandedOver)
+{
+	MemorySessionStore store;
+	SessionTracker tracker(store, kMinTimeBetweenSessions, kSessionTimeout);
+	Open(tracker, 1000, 10);
+	AMPLITUDE_CHECK(tracker.Close(5000, 4010));
+	tracker.HoldSessionEnd(L"end");
+
+	std::wstring event;
+	int64 timestamp = 0;
+	AMPLITUDE_CHECK(tracker.TakeExpiredSessionEnd(5000 + kMinTimeBetweenSessions, 4010 + kMinTimeBetweenSessions, event, timestamp));
+	AMPLITUDE_CHECK(event == L"end");
+	AMPLITUDE_CHECK(timestamp == 5000);
+	AMPLITUDE_CHECK(tracker.GetState() == SessionState::Closed);
+	AMPLITUDE_CHECK(store.pendingSessionEnd.empty());
+
+	// Too late to resume; the next event starts a new session.
+	tracker.Resume(5000 + kMinTimeBetweenSessions, 4010 + kMinTimeBetweenSessions);
+	AMPLITUDE_CHECK(tracker.GetState() == SessionState::Closed);
+	AMPLITUDE_CHECK(tracker.CheckSession(30000, 29010));
+	AMPLITUDE_CHECK(tracker.GetSessionId() == 30000);
+	AMPLITUDE_CHECK(!tracker.TakeExpiredSessionEnd(100000, 99010, event, timestamp));
+}
+
+// A session that was ending when the process went away is picked up
+// again, and timed by the wall clock, as that's all that survived.
+AMPLITUDE_TEST(EndingSessionSurvivesARestart)
+{
+	MemorySessionStore store;
+	{
+		SessionTracker tracker(store, kMinTimeBetweenSessions, kSessionTimeout);
+		Open(tracker, 1000, 10);
+		AMPLITUDE_CHECK(tracker.Close(5000, 4010));
+		tracker.HoldSessionEnd(L"end");
+	}
+
+	SessionTracker resumed(store, kMinTimeBetweenSessions, kSessionTimeout);
+	AMPLITUDE_CHECK(resumed.GetState() == SessionState::Ending);
+	AMPLITUDE_CHECK(resumed.GetSessionId() == 1000);
+	resumed.Resume(6000, 0);
+	AMPLITUDE_CHECK(resumed.GetState() == SessionState::Open);
+
+	{
+		SessionTracker tracker(store, kMinTimeBetweenSessions, kSessionTimeout);
+		AMPLITUDE_CHECK(tracker.GetState() == SessionState::Closed);
+	}
+
+	MemorySessionStore expiredStore;
+	{
+		SessionTracker tracker(expiredStore, kMinTimeBetweenSessions, kSessionTimeout);
+		Open(tracker, 1000, 10);
+		AMPLITUDE_CHECK(tracker.Close(5000, 4010));
+		tracker.HoldSessionEnd(L"end");
+	}
+
+	SessionTracker expired(expiredStore, kMinTimeBetweenSessions, kSessionTimeout);
+	std::wstring event;
+	int64 timestamp = 0;
+	AMPLITUDE_CHECK(expired.TakeExpiredSessionEnd(5000 + kMinTimeBetweenSessions, 0, event, timestamp));
+	AMPLITUDE_CHECK(event == L"end");
+	AMPLITUDE_CHECK(timestamp == 5000);
+}
+
+int main()
+{
+	return RunTests();
+}
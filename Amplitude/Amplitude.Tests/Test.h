@@ -0,0 +1,95 @@
+// A few lines of harness shared by the tests.  Each test executable
+// defines its cases with AMPLITUDE_TEST, checks with AMPLITUDE_CHECK, and
+// runs them all from main with RunTests(), which prints one line per case
+// and returns nonzero if any failed, for ctest.
+//
+// A failed check ends its case there and then; the other cases still run.
+
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct TestCase
+{
+	const char *name;
+	void (*body)();
+};
+
+inline std::vector<TestCase>& GetTestCases()
+{
+	static std::vector<TestCase> cases;
+	return cases;
+}
+
+struct TestRegistration
+{
+	TestRegistration(const char *name, void (*body)())
+	{
+		TestCase testCase = { name, body };
+		GetTestCases().push_back(testCase);
+	}
+};
+
+struct TestFailure : std::runtime_error
+{
+	TestFailure(const std::string &message) :
+		std::runtime_error(message)
+	{
+	}
+};
+
+#define AMPLITUDE_TEST(name) \
+	static void name(); \
+	static TestRegistration name##Registration(#name, name); \
+	static void name()
+
+#define AMPLITUDE_CHECK(condition) \
+	do \
+	{ \
+		if (!(condition)) \
+		{ \
+			throw TestFailure(std::string(__FILE__) + ":" + std::to_string(__LINE__) + ": " + #condition); \
+		} \
+	} while (false)
+
+// Polls 'condition' until it holds or 'timeoutMillis' pass; for waiting on
+// other threads without hanging the run if they never get there.
+inline bool WaitFor(const std::function<bool()> &condition, int timeoutMillis = 5000)
+{
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMillis);
+	while (!condition())
+	{
+		if (std::chrono::steady_clock::now() >= deadline)
+		{
+			return false;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return true;
+}
+
+inline int RunTests()
+{
+	auto failures = 0;
+	for (const auto &testCase : GetTestCases())
+	{
+		try
+		{
+			testCase.body();
+			std::printf("PASS %s\n", testCase.name);
+		}
+		catch (const std::exception &e)
+		{
+			std::printf("FAIL %s: %s\n", testCase.name, e.what());
+			++failures;
+		}
+		std::fflush(stdout);
+	}
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,182 @@
+// Tests for TimerWheel, and for WorkerThread's timers on top of it: that a
+// cancelled timer never fires, and that one rescheduled fires only at its
+// new time.
+
+// The core headers expect what the precompiled header provides.
+#include "pch.h"
+
+#include "Test.h"
+
+#include "TimerWheel.h"
+#include "WorkerThread.h"
+
+#include <atomic>
+#include <vector>
+
+using namespace Amplitude;
+
+// Advances 'wheel' to 'now' and runs whatever came due; returns how many.
+static size_t Fire(TimerWheel &wheel, int64 now)
+{
+	std::vector<TimerWheel::Callback> expired;
+	wheel.Advance(now, expired);
+	for (auto &callback : expired)
+	{
+		callback();
+	}
+	return expired.size();
+}
+
+AMPLITUDE_TEST(TimersFireInDeadlineOrder)
+{
+	TimerWheel wheel(1000);
+	std::vector<int> fired;
+
+	// Spread across the levels, added out of order.
+	wheel.Add(3, 1000 + 5000, [&fired] { fired.push_back(3); });
+	wheel.Add(1, 1000 + 10, [&fired] { fired.push_back(1); });
+	wheel.Add(4, 1000 + 300000, [&fired] { fired.push_back(4); });
+	wheel.Add(2, 1000 + 70, [&fired] { fired.push_back(2); });
+	AMPLITUDE_CHECK(wheel.GetCount() == 4);
+
+	AMPLITUDE_CHECK(Fire(wheel, 1000 + 9) == 0);
+	AMPLITUDE_CHECK(Fire(wheel, 1000 + 5000) == 3);
+	AMPLITUDE_CHECK(Fire(wheel, 1000 + 299999) == 0);
+	AMPLITUDE_CHECK(Fire(wheel, 1000 + 300000) == 1);
+
+	AMPLITUDE_CHECK((fired == std::vector<int>{ 1, 2, 3, 4 }));
+	AMPLITUDE_CHECK(wheel.GetCount() == 0);
+	AMPLITUDE_CHECK(wheel.GetNextDeadline() == -1);
+}
+
+// The current tick has already been dealt with, so it's the next one.
+AMPLITUDE_TEST(PassedDeadlineFiresOnTheNextTick)
+{
+	TimerWheel wheel(1000);
+	auto fired = false;
+	wheel.Add(1, 500, [&fired] { fired = true; });
+
+	AMPLITUDE_CHECK(wheel.GetNextDeadline() == 1001);
+	AMPLITUDE_CHECK(Fire(wheel, 1001) == 1);
+	AMPLITUDE_CHECK(fired);
+}
+
+// Beyond what the wheel spans, a timer waits in the top level and goes
+// round again.
+AMPLITUDE_TEST(TimerBeyondTheWheelFiresOnTime)
+{
+	static const int64 kDay = 24LL * 60 * 60 * 1000;
+
+	TimerWheel wheel(0);
+	auto fired = false;
+	wheel.Add(1, kDay, [&fired] { fired = true; });
+
+	auto now = int64(0);
+	while (!fired)
+	{
+		auto next = wheel.GetNextDeadline();
+		AMPLITUDE_CHECK(next > now && next <= kDay);
+		now = next;
+		Fire(wheel, now);
+	}
+	AMPLITUDE_CHECK(now == kDay);
+}
+
+AMPLITUDE_TEST(CancelledTimerNeverFires)
+{
+	TimerWheel wheel(0);
+	auto fired = false;
+	wheel.Add(1, 100, [&fired] { fired = true; });
+	wheel.Add(2, 100000, [&fired] { fired = true; });
+
+	AMPLITUDE_CHECK(wheel.Cancel(1));
+	AMPLITUDE_CHECK(wheel.Cancel(2));
+	AMPLITUDE_CHECK(!wheel.Cancel(1));
+	AMPLITUDE_CHECK(wheel.GetCount() == 0);
+
+	AMPLITUDE_CHECK(Fire(wheel, 200000) == 0);
+	AMPLITUDE_CHECK(!fired);
+}
+
+AMPLITUDE_TEST(CancellingAFiredTimerFails)
+{
+	TimerWheel wheel(0);
+	wheel.Add(1, 10, [] {});
+	AMPLITUDE_CHECK(Fire(wheel, 10) == 1);
+	AMPLITUDE_CHECK(!wheel.Cancel(1));
+}
+
+// Rescheduling is cancelling and adding again, here under the same ID,
+// both sooner and later than before.
+AMPLITUDE_TEST(RescheduledTimerFiresOnlyAtItsNewTime)
+{
+	TimerWheel wheel(0);
+	auto fired = 0;
+
+	wheel.Add(1, 1000, [&fired] { ++fired; });
+	AMPLITUDE_CHECK(wheel.Cancel(1));
+	wheel.Add(1, 5000, [&fired] { ++fired; });
+
+	AMPLITUDE_CHECK(Fire(wheel, 1000) == 0);
+	AMPLITUDE_CHECK(Fire(wheel, 4999) == 0);
+
+	AMPLITUDE_CHECK(wheel.Cancel(1));
+	wheel.Add(1, 4000, [&fired] { ++fired; });
+	AMPLITUDE_CHECK(wheel.GetNextDeadline() <= 5000);
+
+	AMPLITUDE_CHECK(Fire(wheel, 10000) == 1);
+	AMPLITUDE_CHECK(fired == 1);
+}
+
+AMPLITUDE_TEST(WorkerRunsScheduledItems)
+{
+	WorkerThread worker;
+	std::atomic<int> ran(0);
+
+	AMPLITUDE_CHECK(worker.Schedule([&ran] { ran.fetch_add(1); }, 0) != 0);
+	AMPLITUDE_CHECK(worker.Schedule([&ran] { ran.fetch_add(1); }, 20) != 0);
+
+	AMPLITUDE_CHECK(WaitFor([&ran] { return ran.load() == 2; }));
+}
+
+AMPLITUDE_TEST(WorkerCancelsFromAnotherThread)
+{
+	WorkerThread worker;
+	std::atomic<bool> cancelledRan(false);
+	std::atomic<bool> laterRan(false);
+
+	auto id = worker.Schedule([&cancelledRan] { cancelledRan = true; }, 50);
+	worker.Cancel(id);
+	worker.Schedule([&laterRan] { laterRan = true; }, 100);
+
+	AMPLITUDE_CHECK(WaitFor([&laterRan] { return laterRan.load(); }));
+	AMPLITUDE_CHECK(!cancelledRan);
+}
+
+// As the reporter does with its upload timer: from the worker, cancel the
+// pending timer and schedule it again further out.
+AMPLITUDE_TEST(WorkerReschedulesFromAWorkItem)
+{
+	WorkerThread worker;
+	std::atomic<int> fired(0);
+	std::atomic<bool> done(false);
+
+	auto id = worker.Schedule([&fired] { fired.fetch_add(1); }, 30);
+	AMPLITUDE_CHECK(worker.TryAddWorkItem([&worker, &fired, &done, id]
+	{
+		worker.Cancel(id);
+		worker.Schedule([&fired, &done]
+		{
+			fired.fetch_add(1);
+			done = true;
+		}, 80);
+	}));
+
+	AMPLITUDE_CHECK(WaitFor([&done] { return done.load(); }));
+	AMPLITUDE_CHECK(fired == 1);
+}
+
+int main()
+{
+	return RunTests();
+}
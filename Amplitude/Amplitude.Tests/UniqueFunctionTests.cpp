@@ -0,0 +1,143 @@
+// Tests for UniqueFunction: which callables are stored inline and which
+// on the heap, that it holds callables that can't be copied, and that
+// whatever it holds is destroyed exactly once, however it's moved.
+
+// The core headers expect what the precompiled header provides.
+#include "pch.h"
+
+#include "Test.h"
+
+#include "UniqueFunction.h"
+
+#include <functional>
+#include <memory>
+#include <utility>
+
+using namespace Amplitude;
+
+// As many handles as EventReporter's work items capture, plus a timestamp
+// and a flag.
+struct WorkItemCaptures
+{
+	void *name;
+	void *properties;
+	void *apiProperties;
+	void *globalProperties;
+	long long timestamp;
+	bool checkSession;
+};
+
+AMPLITUDE_TEST(EmptyFunctionThrowsWhenCalled)
+{
+	UniqueFunction<int()> fn;
+	AMPLITUDE_CHECK(!fn);
+
+	auto threw = false;
+	try
+	{
+		fn();
+	}
+	catch (const std::bad_function_call&)
+	{
+		threw = true;
+	}
+	AMPLITUDE_CHECK(threw);
+}
+
+AMPLITUDE_TEST(WorkItemSizedCapturesAreStoredInline)
+{
+	static_assert(sizeof(UniqueFunction<void()>) <= 64, "a work item should fit in a cache line");
+
+	WorkItemCaptures captures = { nullptr, nullptr, nullptr, nullptr, 42, true };
+	UniqueFunction<long long()> fn([captures] { return captures.timestamp; });
+	AMPLITUDE_CHECK(fn);
+	AMPLITUDE_CHECK(!fn.IsOnHeap());
+	AMPLITUDE_CHECK(fn() == 42);
+}
+
+AMPLITUDE_TEST(LargeCapturesGoOnTheHeap)
+{
+	struct Large
+	{
+		char bytes[UniqueFunction<void()>::kInlineSize + 1];
+	};
+
+	Large large = {};
+	large.bytes[0] = 7;
+	UniqueFunction<int()> fn([large] { return static_cast<int>(large.bytes[0]); });
+	AMPLITUDE_CHECK(fn.IsOnHeap());
+	AMPLITUDE_CHECK(fn() == 7);
+
+	// Only the pointer moves.
+	UniqueFunction<int()> moved(std::move(fn));
+	AMPLITUDE_CHECK(!fn);
+	AMPLITUDE_CHECK(moved.IsOnHeap());
+	AMPLITUDE_CHECK(moved() == 7);
+}
+
+AMPLITUDE_TEST(ArgumentsAreForwarded)
+{
+	UniqueFunction<int(std::unique_ptr<int>, int)> fn([](std::unique_ptr<int> value, int offset)
+	{
+		return *value + offset;
+	});
+	AMPLITUDE_CHECK(fn(std::unique_ptr<int>(new int(40)), 2) == 42);
+}
+
+// Moved on, never copied: the same object comes out the other end.
+AMPLITUDE_TEST(MoveOnlyCallablesAreHeld)
+{
+	struct Owner
+	{
+		std::unique_ptr<int> value;
+		int* operator()() { return value.get(); }
+	};
+
+	Owner owner = { std::unique_ptr<int>(new int(5)) };
+	auto raw = owner.value.get();
+
+	UniqueFunction<int*()> fn(std::move(owner));
+	AMPLITUDE_CHECK(!fn.IsOnHeap());
+	AMPLITUDE_CHECK(fn() == raw);
+
+	UniqueFunction<int*()> other;
+	other = std::move(fn);
+	AMPLITUDE_CHECK(!fn);
+	AMPLITUDE_CHECK(other() == raw);
+}
+
+AMPLITUDE_TEST(CapturesAreDestroyedExactlyOnce)
+{
+	auto tracker = std::make_shared<int>(0);
+	std::weak_ptr<int> watch = tracker;
+
+	{
+		UniqueFunction<long()> fn([tracker] { return tracker.use_count(); });
+		tracker.reset();
+		AMPLITUDE_CHECK(fn() == 1);
+
+		UniqueFunction<long()> moved(std::move(fn));
+		AMPLITUDE_CHECK(moved() == 1);
+
+		UniqueFunction<long()> assigned;
+		assigned = std::move(moved);
+		AMPLITUDE_CHECK(!watch.expired());
+
+		assigned = nullptr;
+		AMPLITUDE_CHECK(watch.expired());
+	}
+
+	// Replacing what a function holds destroys the old callable.
+	auto first = std::make_shared<int>(1);
+	std::weak_ptr<int> watchFirst = first;
+	UniqueFunction<int()> fn([first] { return *first; });
+	first.reset();
+	fn = UniqueFunction<int()>([] { return 2; });
+	AMPLITUDE_CHECK(watchFirst.expired());
+	AMPLITUDE_CHECK(fn() == 2);
+}
+
+int main()
+{
+	return RunTests();
+}
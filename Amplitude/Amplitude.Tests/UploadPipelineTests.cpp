@@ -0,0 +1,251 @@
+// Tests for UploadPipeline: an upload that goes through, one that's
+// refused, and that the pipeline carries on after a step fails.
+
+// The core headers expect what the precompiled header provides.
+#include "pch.h"
+
+#include "Test.h"
+
+#include "UploadPipeline.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace Amplitude;
+
+// Hands out events 1..count, a batch at a time, and can be told to fail.
+class FakeUploadSource : public IUploadSource
+{
+public:
+	FakeUploadSource(int64 count) :
+		firstId(1),
+		count(count),
+		failReads(0),
+		failDeletes(0)
+	{
+	}
+
+	UploadBatch ReadBatch(int64 maxCount) override
+	{
+		if (failReads > 0)
+		{
+			--failReads;
+			throw std::runtime_error("read failed");
+		}
+
+		UploadBatch batch;
+		auto size = maxCount < 0 ? count : std::min(count, maxCount);
+		batch.maxId = size == 0 ? -1 : firstId + size - 1;
+		batch.events = L"[" + std::to_wstring(size) + L"]";
+		return batch;
+	}
+
+	int64 Delete(int64 maxId) override
+	{
+		if (failDeletes > 0)
+		{
+			--failDeletes;
+			throw std::runtime_error("delete failed");
+		}
+
+		count -= maxId - firstId + 1;
+		firstId = maxId + 1;
+		return count;
+	}
+
+	int64 firstId;
+	int64 count;
+	int failReads;
+	int failDeletes;
+};
+
+// Keeps each request, and its callback, until the test answers it.
+class FakeUploadSender : public IUploadSender
+{
+public:
+	FakeUploadSender() :
+		sent(0)
+	{
+	}
+
+	void Send(const UploadRequest &request, UniqueFunction<void(UploadResult)> done) override
+	{
+		++sent;
+		lastRequest = request;
+		pending = std::move(done);
+	}
+
+	void Respond(UploadResult result)
+	{
+		auto done = std::move(pending);
+		pending = nullptr;
+		done(result);
+	}
+
+	int sent;
+	UploadRequest lastRequest;
+	UniqueFunction<void(UploadResult)> pending;
+};
+
+// What an upload reported when it completed.
+struct Completion
+{
+	Completion() :
+		calls(0),
+		result(UploadResult::Success),
+		remaining(0)
+	{
+	}
+
+	UploadPipeline::CompletionHandler Handler()
+	{
+		return [this](UploadResult result, int64 remaining)
+		{
+			++calls;
+			this->result = result;
+			this->remaining = remaining;
+		};
+	}
+
+	int calls;
+	UploadResult result;
+	int64 remaining;
+};
+
+static std::wstring FixedChecksum(const UploadRequest&)
+{
+	return L"checksum";
+}
+
+struct Fixture
+{
+	Fixture(int64 count) :
+		source(count),
+		pipeline(executor, source, sender, FixedChecksum, 2, stats)
+	{
+		pipeline.SetApiKey(L"key");
+	}
+
+	ManualExecutor executor;
+	FakeUploadSource source;
+	FakeUploadSender sender;
+	RuntimeStats stats;
+	UploadPipeline pipeline;
+};
+
+AMPLITUDE_TEST(AcceptedBatchIsDeleted)
+{
+	Fixture fixture(5);
+	Completion completion;
+
+	AMPLITUDE_CHECK(fixture.pipeline.Start(3, 1234, completion.Handler()));
+	AMPLITUDE_CHECK(fixture.pipeline.GetStage() == UploadPipeline::Stage::AwaitResponse);
+	AMPLITUDE_CHECK(fixture.sender.sent == 1);
+	AMPLITUDE_CHECK(fixture.sender.lastRequest.apiVersion == L"2");
+	AMPLITUDE_CHECK(fixture.sender.lastRequest.apiKey == L"key");
+	AMPLITUDE_CHECK(fixture.sender.lastRequest.events == L"[3]");
+	AMPLITUDE_CHECK(fixture.sender.lastRequest.uploadTime == L"1234");
+	AMPLITUDE_CHECK(fixture.sender.lastRequest.checksum == L"checksum");
+
+	// Only one upload at a time.
+	AMPLITUDE_CHECK(!fixture.pipeline.Start(3, 1234, completion.Handler()));
+
+	// The response carries on from the executor, not the sender's thread.
+	fixture.sender.Respond(UploadResult::Success);
+	AMPLITUDE_CHECK(completion.calls == 0);
+	AMPLITUDE_CHECK(fixture.executor.RunPending() == 1);
+
+	AMPLITUDE_CHECK(completion.calls == 1);
+	AMPLITUDE_CHECK(completion.result == UploadResult::Success);
+	AMPLITUDE_CHECK(completion.remaining == 2);
+	AMPLITUDE_CHECK(fixture.source.firstId == 4);
+	AMPLITUDE_CHECK(!fixture.pipeline.IsRunning());
+}
+
+AMPLITUDE_TEST(EmptyBatchIsNotAnAttempt)
+{
+	Fixture fixture(0);
+	Completion completion;
+
+	AMPLITUDE_CHECK(!fixture.pipeline.Start(-1, 0, completion.Handler()));
+	AMPLITUDE_CHECK(fixture.sender.sent == 0);
+	AMPLITUDE_CHECK(completion.calls == 0);
+	AMPLITUDE_CHECK(!fixture.pipeline.IsRunning());
+}
+
+AMPLITUDE_TEST(RefusedBatchIsKept)
+{
+	Fixture fixture(5);
+	Completion completion;
+
+	AMPLITUDE_CHECK(fixture.pipeline.Start(-1, 0, completion.Handler()));
+	fixture.sender.Respond(UploadResult::NetworkError);
+	fixture.executor.RunPending();
+
+	AMPLITUDE_CHECK(completion.calls == 1);
+	AMPLITUDE_CHECK(completion.result == UploadResult::NetworkError);
+	AMPLITUDE_CHECK(completion.remaining == -1);
+	AMPLITUDE_CHECK(fixture.source.count == 5);
+
+	// The retry sends the same events.
+	AMPLITUDE_CHECK(fixture.pipeline.Start(-1, 0, completion.Handler()));
+	AMPLITUDE_CHECK(fixture.sender.lastRequest.events == L"[5]");
+	fixture.sender.Respond(UploadResult::Success);
+	fixture.executor.RunPending();
+	AMPLITUDE_CHECK(completion.result == UploadResult::Success);
+	AMPLITUDE_CHECK(completion.remaining == 0);
+}
+
+// A read that throws is reported as a failed attempt, and the next one
+// starts over from the beginning.
+AMPLITUDE_TEST(ResumesAfterAFailedRead)
+{
+	Fixture fixture(5);
+	Completion completion;
+	fixture.source.failReads = 1;
+
+	AMPLITUDE_CHECK(fixture.pipeline.Start(-1, 0, completion.Handler()));
+	AMPLITUDE_CHECK(completion.calls == 1);
+	AMPLITUDE_CHECK(completion.result == UploadResult::UnknownResponse);
+	AMPLITUDE_CHECK(completion.remaining == -1);
+	AMPLITUDE_CHECK(fixture.sender.sent == 0);
+	AMPLITUDE_CHECK(fixture.pipeline.GetStage() == UploadPipeline::Stage::Idle);
+
+	AMPLITUDE_CHECK(fixture.pipeline.Start(-1, 0, completion.Handler()));
+	fixture.sender.Respond(UploadResult::Success);
+	fixture.executor.RunPending();
+	AMPLITUDE_CHECK(completion.calls == 2);
+	AMPLITUDE_CHECK(completion.result == UploadResult::Success);
+	AMPLITUDE_CHECK(completion.remaining == 0);
+}
+
+// An accepted batch that couldn't be deleted is still stored, so the next
+// attempt sends it again, and deletes it this time.
+AMPLITUDE_TEST(ResumesAfterAFailedDelete)
+{
+	Fixture fixture(5);
+	Completion completion;
+	fixture.source.failDeletes = 1;
+
+	AMPLITUDE_CHECK(fixture.pipeline.Start(-1, 0, completion.Handler()));
+	fixture.sender.Respond(UploadResult::Success);
+	fixture.executor.RunPending();
+	AMPLITUDE_CHECK(completion.calls == 1);
+	AMPLITUDE_CHECK(completion.result == UploadResult::UnknownResponse);
+	AMPLITUDE_CHECK(fixture.source.count == 5);
+	AMPLITUDE_CHECK(!fixture.pipeline.IsRunning());
+
+	AMPLITUDE_CHECK(fixture.pipeline.Start(-1, 0, completion.Handler()));
+	AMPLITUDE_CHECK(fixture.sender.sent == 2);
+	AMPLITUDE_CHECK(fixture.sender.lastRequest.events == L"[5]");
+	fixture.sender.Respond(UploadResult::Success);
+	fixture.executor.RunPending();
+	AMPLITUDE_CHECK(completion.calls == 2);
+	AMPLITUDE_CHECK(completion.result == UploadResult::Success);
+	AMPLITUDE_CHECK(fixture.source.count == 0);
+}
+
+int main()
+{
+	return RunTests();
+}
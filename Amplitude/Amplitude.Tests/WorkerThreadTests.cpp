@@ -0,0 +1,256 @@
+// Tests for WorkerThread's overflow policies: what happens to work items
+// that arrive while the worker is stuck and their lane is full, under
+// DropNewest, DropOldest, Block and Spill.
+
+// The core headers expect what the precompiled header provides.
+#include "pch.h"
+
+#include "Test.h"
+
+#include "WorkerThread.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Amplitude;
+
+static const char * const kSpillPath = "WorkerThreadTests.spill";
+
+// More items than any lane holds.
+static const int kItems = 2000;
+
+// Holds the worker up in a work item until it's opened, so that its queue
+// fills.  Declared after the worker, it opens as the test ends, however it
+// ends, so that the worker can be joined.
+class Gate
+{
+public:
+	Gate() :
+		entered(std::make_shared<std::atomic<bool>>(false)),
+		open(std::make_shared<std::atomic<bool>>(false))
+	{
+	}
+
+	~Gate()
+	{
+		Open();
+	}
+
+	// Queues the item that holds the worker up, and waits for the worker
+	// to get to it.
+	bool Hold(WorkerThread &worker)
+	{
+		auto entered = this->entered;
+		auto open = this->open;
+		auto queued = worker.TryAddWorkItem([entered, open]
+		{
+			entered->store(true);
+			while (!open->load())
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+		}, WorkPriority::Critical);
+
+		return queued && WaitFor([entered] { return entered->load(); });
+	}
+
+	void Open()
+	{
+		open->store(true);
+	}
+
+private:
+	std::shared_ptr<std::atomic<bool>> entered;
+	std::shared_ptr<std::atomic<bool>> open;
+};
+
+// Adds items to the worker's normal lane until one is refused; returns how
+// many were accepted.
+static int Fill(WorkerThread &worker, std::atomic<int> &ran)
+{
+	auto accepted = 0;
+	while (accepted < kItems && worker.TryAddWorkItem([&ran] { ran.fetch_add(1); }))
+	{
+		++accepted;
+	}
+	return accepted;
+}
+
+AMPLITUDE_TEST(DropNewestRefusesWhatDoesNotFit)
+{
+	std::atomic<int> ran(0);
+
+	WorkerThreadOptions options;
+	options.policy = OverflowPolicy::DropNewest;
+	WorkerThread worker(options);
+	Gate gate;
+	AMPLITUDE_CHECK(gate.Hold(worker));
+
+	auto accepted = Fill(worker, ran);
+	AMPLITUDE_CHECK(accepted > 0 && accepted < kItems);
+	AMPLITUDE_CHECK(!worker.TryAddWorkItem([&ran] { ran.fetch_add(1); }));
+
+	// Critical items are never refused for lack of space.
+	AMPLITUDE_CHECK(worker.TryAddWorkItem([&ran] { ran.fetch_add(1); }, WorkPriority::Critical));
+
+	auto stats = worker.GetOverflowStats();
+	AMPLITUDE_CHECK(stats.dropped == 2);
+	AMPLITUDE_CHECK(stats.evicted == 0);
+
+	gate.Open();
+	AMPLITUDE_CHECK(WaitFor([&ran, accepted] { return ran.load() == accepted + 1; }));
+}
+
+// Each item evicts the oldest waiting, so what runs is the newest a lane
+// can hold, in order.
+AMPLITUDE_TEST(DropOldestMakesRoomForTheNewest)
+{
+	std::mutex ranMutex;
+	std::vector<int> ran;
+
+	WorkerThreadOptions options;
+	options.policy = OverflowPolicy::DropOldest;
+	WorkerThread worker(options);
+	Gate gate;
+	AMPLITUDE_CHECK(gate.Hold(worker));
+
+	for (int i = 0; i < kItems; ++i)
+	{
+		AMPLITUDE_CHECK(worker.TryAddWorkItem([&ranMutex, &ran, i]
+		{
+			std::lock_guard<std::mutex> lock(ranMutex);
+			ran.push_back(i);
+		}));
+	}
+
+	auto stats = worker.GetOverflowStats();
+	AMPLITUDE_CHECK(stats.evicted > 0 && stats.evicted < kItems);
+	AMPLITUDE_CHECK(stats.dropped == 0);
+
+	gate.Open();
+	auto kept = kItems - static_cast<int>(stats.evicted);
+	AMPLITUDE_CHECK(WaitFor([&ranMutex, &ran, kept]
+	{
+		std::lock_guard<std::mutex> lock(ranMutex);
+		return static_cast<int>(ran.size()) == kept;
+	}));
+
+	std::lock_guard<std::mutex> lock(ranMutex);
+	for (int i = 0; i < kept; ++i)
+	{
+		AMPLITUDE_CHECK(ran[i] == kItems - kept + i);
+	}
+}
+
+// A producer waits for room, up to the timeout; once the worker makes
+// some, a waiting producer gets in.
+AMPLITUDE_TEST(BlockWaitsForRoomThenGivesUp)
+{
+	std::atomic<int> ran(0);
+
+	WorkerThreadOptions options;
+	options.policy = OverflowPolicy::Block;
+	options.blockTimeoutMillis = 500;
+	WorkerThread worker(options);
+	Gate gate;
+	AMPLITUDE_CHECK(gate.Hold(worker));
+
+	auto start = std::chrono::steady_clock::now();
+	auto accepted = Fill(worker, ran);
+	AMPLITUDE_CHECK(accepted > 0 && accepted < kItems);
+	AMPLITUDE_CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(options.blockTimeoutMillis));
+
+	auto stats = worker.GetOverflowStats();
+	AMPLITUDE_CHECK(stats.blocked == 1);
+	AMPLITUDE_CHECK(stats.timedOut == 1);
+	AMPLITUDE_CHECK(stats.dropped == 1);
+
+	std::atomic<bool> added(false);
+	std::thread producer([&worker, &ran, &added]
+	{
+		added = worker.TryAddWorkItem([&ran] { ran.fetch_add(1); });
+	});
+
+	auto waiting = WaitFor([&worker] { return worker.GetOverflowStats().blocked == 2; });
+	gate.Open();
+	producer.join();
+
+	AMPLITUDE_CHECK(waiting);
+	AMPLITUDE_CHECK(added);
+	AMPLITUDE_CHECK(worker.GetOverflowStats().timedOut == 1);
+	AMPLITUDE_CHECK(WaitFor([&ran, accepted] { return ran.load() == accepted + 1; }));
+}
+
+// Whatever doesn't fit is written out, and handed back to the worker once
+// it has caught up; nothing is lost, and nothing comes back twice.
+AMPLITUDE_TEST(SpillWritesOutAndReplaysWhatDoesNotFit)
+{
+	std::remove(kSpillPath);
+
+	std::mutex ranMutex;
+	std::vector<int> ran;
+
+	WorkerThreadOptions options;
+	options.policy = OverflowPolicy::Spill;
+	options.spillPath = L"WorkerThreadTests.spill";
+	options.replaySpilled = [&ranMutex, &ran](std::vector<std::wstring> &&records)
+	{
+		std::lock_guard<std::mutex> lock(ranMutex);
+		for (const auto &record : records)
+		{
+			ran.push_back(std::stoi(record));
+		}
+	};
+	WorkerThread worker(options);
+	Gate gate;
+	AMPLITUDE_CHECK(gate.Hold(worker));
+
+	for (int i = 0; i < kItems; ++i)
+	{
+		AMPLITUDE_CHECK(worker.TryAddWorkItem([&ranMutex, &ran, i]
+		{
+			std::lock_guard<std::mutex> lock(ranMutex);
+			ran.push_back(i);
+		}, WorkPriority::Normal, [i]
+		{
+			return std::to_wstring(i);
+		}));
+	}
+
+	// An item that can't describe itself can't spill.
+	AMPLITUDE_CHECK(!worker.TryAddWorkItem([] {}));
+
+	auto stats = worker.GetOverflowStats();
+	AMPLITUDE_CHECK(stats.spilled > 0 && stats.spilled < kItems);
+	AMPLITUDE_CHECK(stats.dropped == 1);
+
+	gate.Open();
+	AMPLITUDE_CHECK(WaitFor([&ranMutex, &ran]
+	{
+		std::lock_guard<std::mutex> lock(ranMutex);
+		return static_cast<int>(ran.size()) >= kItems;
+	}));
+	AMPLITUDE_CHECK(worker.GetOverflowStats().replayed == stats.spilled);
+
+	std::lock_guard<std::mutex> lock(ranMutex);
+	std::sort(ran.begin(), ran.end());
+	AMPLITUDE_CHECK(static_cast<int>(ran.size()) == kItems);
+	for (int i = 0; i < kItems; ++i)
+	{
+		AMPLITUDE_CHECK(ran[i] == i);
+	}
+}
+
+int main()
+{
+	auto failures = RunTests();
+	std::remove(kSpillPath);
+	return failures;
+}
@@ -100,9 +100,33 @@ namespace HackerNewsDaily
             container.GetInstance<IAnalytics>().StartSession();
         }
 
-        protected override void OnSuspending(object sender, SuspendingEventArgs e)
+        protected override async void OnSuspending(object sender, SuspendingEventArgs e)
         {
-            container.GetInstance<IAnalytics>().EndSession();
+            // Flushing waits on the disk; do it off the UI thread, and hold
+            // suspension off until it's done.
+            var deferral = e.SuspendingOperation.GetDeferral();
+            try
+            {
+                var analytics = container.GetInstance<IAnalytics>();
+                analytics.EndSession();
+
+                // Suspension only allows a few seconds; keep well inside that,
+                // and inside whatever is left of it.
+                var timeout = e.SuspendingOperation.Deadline - DateTimeOffset.Now - TimeSpan.FromMilliseconds(500);
+                if (timeout > TimeSpan.FromSeconds(2))
+                {
+                    timeout = TimeSpan.FromSeconds(2);
+                }
+
+                if (timeout > TimeSpan.Zero)
+                {
+                    await Task.Run(() => analytics.Flush(timeout));
+                }
+            }
+            finally
+            {
+                deferral.Complete();
+            }
         }
     }
 }
\ No newline at end of file
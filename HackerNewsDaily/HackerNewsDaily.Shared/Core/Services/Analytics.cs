@@ -21,6 +21,11 @@ namespace HackerNewsDaily.Core.Services
             EventReporter.EndSession();
         }
 
+        public void Flush(TimeSpan timeout)
+        {
+            EventReporter.Flush((long) timeout.TotalMilliseconds, true);
+        }
+
         public void TrackViewActivated(Type viewModel, JsonObject properties = null)
         {
             if (properties == null)
@@ -9,6 +9,10 @@ namespace HackerNewsDaily.Core.Services
         void StartSession();
         void EndSession();
 
+        // Stores whatever is still queued before the app is suspended,
+        // taking no longer than the given time.
+        void Flush(TimeSpan timeout);
+
         void TrackViewActivated(Type view, JsonObject properties = null);
         void TrackEvent(string eventName, JsonObject properties = null);
     }